@@ -0,0 +1,149 @@
+//
+//  Main.cpp
+//  TestWaveEdit_Batch
+//
+
+#include <JuceHeader.h>
+#include "../../Source/WaveCutList.h"
+#include "../../Source/WaveEditScript.h"
+
+// ================================================================================
+// job
+
+// one input file: load, apply the script, save; the jobs share nothing but the format manager and the script, which they only read
+class BatchEditJob : public juce::ThreadPoolJob
+{
+public:
+	juce::AudioFormatManager& audioFormatManager;
+	const WaveEditScript& script;
+	juce::File inputFile;
+	juce::File outputFile;
+	juce::Result result = juce::Result::fail("not run");
+	double seconds = 0;
+	BatchEditJob(juce::AudioFormatManager& afm, const WaveEditScript& s, const juce::File& in, const juce::File& out) : juce::ThreadPoolJob(in.getFileName()), audioFormatManager(afm), script(s), inputFile(in), outputFile(out)
+	{
+	}
+	virtual JobStatus runJob() override
+	{
+		double t0 = juce::Time::getMillisecondCounterHiRes();
+		result = process();
+		seconds = (juce::Time::getMillisecondCounterHiRes() - t0) * 0.001;
+		static juce::CriticalSection outputLock;
+		juce::ScopedLock sl(outputLock);
+		if(result.wasOk()) std::cout << inputFile.getFullPathName() << " -> " << outputFile.getFullPathName() << juce::String::formatted(" (%.2f s)", seconds) << std::endl;
+		else std::cerr << inputFile.getFullPathName() << ": " << result.getErrorMessage() << std::endl;
+		return jobHasFinished;
+	}
+	juce::Result process()
+	{
+		std::unique_ptr<juce::AudioFormatReader> reader(audioFormatManager.createReaderFor(inputFile));
+		if(!reader) return juce::Result::fail("failed to open");
+		int bps = (int)reader->bitsPerSample;
+		juce::StringPairArray metadata = reader->metadataValues;
+		WaveSourceFile::Ptr src = ArchivedWaveSourceFile::createInstance(std::move(reader), inputFile);
+		if(!src) return juce::Result::fail("failed to open");
+		WaveCutList cl;
+		cl.push_back({ src, { 0, src->length } });
+		// the pool of the batch already keeps every CPU busy, so the steps of a file run on its worker alone
+		juce::Result r = script.apply(cl, 1);
+		if(r.failed()) return r;
+		return WaveCutListWriter::writeFile(audioFormatManager, outputFile, cl, src->format, bps, metadata);
+	}
+};
+
+// ================================================================================
+// main
+
+static void printUsage(const juce::String& exe)
+{
+	std::cout << "usage: " << exe << " --script=<edits.txt> (--out=<directory> | --in-place) [--jobs=<n>] <file or directory>..." << std::endl;
+	std::cout << "  each file is loaded, edited by the script and saved in its own format; directories add the audio files directly in them" << std::endl;
+	std::cout << "  the script has one edit per line:" << std::endl;
+	std::cout << "    erase|cut|copy|fadein|fadeout|mute <begin> <end>" << std::endl;
+	std::cout << "    paste <position>" << std::endl;
+	std::cout << "    stripsilence <threshold dB> <minimum length>  erases every region below the threshold at least that long, e.g. stripsilence -50 0.5s" << std::endl;
+	std::cout << "    effect <begin> <end> <effect>...  renders the effects in series over the range, one token each, the parameters separated by commas:" << std::endl;
+	std::cout << "      gain:<dB>  dc  highpass:<Hz>  lowshelf:<Hz>,<dB>  peak:<Hz>,<dB>,<Q>  highshelf:<Hz>,<dB>" << std::endl;
+	std::cout << "      compress:<threshold dB>,<ratio>[,<attack ms>,<release ms>[,<makeup dB>]]" << std::endl;
+	std::cout << "  positions are samples, seconds with an \"s\" suffix, or \"end\"; \"end-2s\" and \"-2s\" count back from the end" << std::endl;
+	std::cout << "  --jobs defaults to the number of CPUs" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	juce::ArgumentList args(argc, argv);
+	if(args.containsOption("--help|-h") || !args.containsOption("--script") || (args.containsOption("--out") == args.containsOption("--in-place")))
+	{
+		printUsage(args.executableName);
+		return args.containsOption("--help|-h") ? 0 : 1;
+	}
+	// script
+	juce::File scriptfile = args.getFileForOption("--script");
+	if(!scriptfile.existsAsFile())
+	{
+		std::cerr << scriptfile.getFullPathName() << ": not found" << std::endl;
+		return 1;
+	}
+	WaveEditScript script;
+	juce::Result r = WaveEditScript::parse(scriptfile.loadFileAsString(), script);
+	if(r.failed())
+	{
+		std::cerr << scriptfile.getFullPathName() << ": " << r.getErrorMessage() << std::endl;
+		return 1;
+	}
+	// inputs; the values of "--option value" are not inputs
+	juce::AudioFormatManager afm;
+	afm.registerBasicFormats();
+	auto isOptionValue = [&](int i)
+	{
+		if(i == 0) return false;
+		const juce::ArgumentList::Argument& prev = args.arguments.getReference(i - 1);
+		return prev.isLongOption() && !prev.text.contains("=") && !prev.isLongOption("in-place");
+	};
+	juce::Array<juce::File> inputs;
+	for(int i = 0; i < args.size(); ++i)
+	{
+		const juce::ArgumentList::Argument& a = args.arguments.getReference(i);
+		if(a.isOption() || isOptionValue(i)) continue;
+		juce::File f = a.resolveAsFile();
+		if(f.isDirectory())
+		{
+			juce::Array<juce::File> children = f.findChildFiles(juce::File::findFiles, false, afm.getWildcardForAllFormats());
+			children.sort();
+			inputs.addArray(children);
+		}
+		else if(f.existsAsFile()) inputs.add(f);
+		else std::cerr << a.text << ": not found" << std::endl;
+	}
+	if(inputs.isEmpty())
+	{
+		std::cerr << "no input files" << std::endl;
+		return 1;
+	}
+	juce::File outdir;
+	if(args.containsOption("--out"))
+	{
+		outdir = args.getFileForOption("--out");
+		if(!outdir.createDirectory())
+		{
+			std::cerr << outdir.getFullPathName() << ": failed to create" << std::endl;
+			return 1;
+		}
+	}
+	// one worker per CPU; the edits read and write whole files, so the pool stays busy with either I/O or the fade renders
+	int numjobs = args.containsOption("--jobs") ? args.getValueForOption("--jobs").getIntValue() : juce::SystemStats::getNumCpus();
+	numjobs = juce::jlimit(1, 256, numjobs);
+	juce::ThreadPool pool(numjobs);
+	juce::OwnedArray<BatchEditJob> jobs;
+	for(const juce::File& in : inputs)
+	{
+		juce::File out = (outdir != juce::File()) ? outdir.getChildFile(in.getFileName()) : in;
+		jobs.add(new BatchEditJob(afm, script, in, out));
+		pool.addJob(jobs.getLast(), false);
+	}
+	double t0 = juce::Time::getMillisecondCounterHiRes();
+	for(BatchEditJob* job : jobs) pool.waitForJobToFinish(job, -1);
+	int numfailed = (int)std::count_if(jobs.begin(), jobs.end(), [](const BatchEditJob* job) { return job->result.failed(); });
+	std::cout << juce::String::formatted("%d of %d files edited in %.2f s with %d workers", jobs.size() - numfailed, jobs.size(), (juce::Time::getMillisecondCounterHiRes() - t0) * 0.001, numjobs) << std::endl;
+	return (numfailed == 0) ? 0 : 1;
+}
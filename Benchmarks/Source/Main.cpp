@@ -0,0 +1,692 @@
+//
+//  Main.cpp
+//  TestWaveEdit_Benchmarks
+//
+
+#include <JuceHeader.h>
+#include <numeric>
+#include "../../Source/WaveResampler.h"
+#include "../../Source/WaveLevelMeter.h"
+#include "../../Source/WaveCutListPlayer.h"
+#include "../../Source/WaveJournal.h"
+#include "../../Source/WaveNormalizer.h"
+#include "../../Source/WaveEffect.h"
+#include "../../Source/NullAudioIODevice.h"
+
+// ================================================================================
+// report
+
+// every case is printed as it finishes and collected for the JSON file written at the end
+class BenchmarkReport
+{
+public:
+	juce::Array<juce::var> results;
+	juce::DynamicObject::Ptr add(const char* suite)
+	{
+		juce::DynamicObject::Ptr obj = new juce::DynamicObject();
+		obj->setProperty("suite", suite);
+		results.add(obj.get());
+		return obj;
+	}
+	juce::var toVar() const
+	{
+		juce::DynamicObject::Ptr obj = new juce::DynamicObject();
+		obj->setProperty("version", ProjectInfo::versionString);
+		obj->setProperty("time", juce::Time::getCurrentTime().toISO8601(true));
+		obj->setProperty("os", juce::SystemStats::getOperatingSystemName());
+		obj->setProperty("cpu", juce::SystemStats::getCpuModel());
+		obj->setProperty("numCpus", juce::SystemStats::getNumCpus());
+		obj->setProperty("results", results);
+		return obj.get();
+	}
+	bool writeTo(const juce::File& file) const
+	{
+		return file.replaceWithText(juce::JSON::toString(toVar()));
+	}
+};
+
+// seconds per call of op; setup runs untimed before every call, and the calls stop once MeasureSeconds were measured or WallSeconds passed
+template<typename Setup, typename Op> static double measure(Setup setup, Op op, int maxreps = 1000)
+{
+	static constexpr double MeasureSeconds = 0.25;
+	static constexpr double WallSeconds = 3;
+	double wall0 = juce::Time::getMillisecondCounterHiRes();
+	double total = 0;
+	int reps = 0;
+	while((reps < maxreps) && (total < MeasureSeconds) && ((juce::Time::getMillisecondCounterHiRes() - wall0) < (WallSeconds * 1000)))
+	{
+		setup();
+		int64_t t0 = juce::Time::getHighResolutionTicks();
+		op();
+		total += juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - t0);
+		++reps;
+	}
+	return (0 < reps) ? (total / reps) : 0;
+}
+
+// ================================================================================
+// fixtures
+
+class NoiseAudioSource : public juce::AudioSource
+{
+public:
+	juce::Random random{ 1 };
+	virtual void prepareToPlay(int, double) override {}
+	virtual void releaseResources() override {}
+	virtual void getNextAudioBlock(const juce::AudioSourceChannelInfo& asci) override
+	{
+		for(int ich = 0; ich < asci.buffer->getNumChannels(); ++ich)
+		{
+			float* p = asci.buffer->getWritePointer(ich, asci.startSample);
+			for(int i = 0; i < asci.numSamples; ++i) p[i] = random.nextFloat() * 2 - 1;
+		}
+	}
+};
+
+static juce::File createNoiseWaveFile(double fs, int cch, double seconds)
+{
+	juce::File file = juce::File::getSpecialLocation(juce::File::tempDirectory).getNonexistentChildFile("TestWaveEditBenchmarks", ".wav");
+	std::unique_ptr<juce::OutputStream> stream = file.createOutputStream();
+	if(!stream) return {};
+	juce::WavAudioFormat wav;
+	std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(stream.get(), fs, (unsigned int)cch, 24, {}, 0));
+	if(!writer) return {};
+	stream.release(); // the writer owns it now
+	NoiseAudioSource noise;
+	juce::AudioBuffer<float> buffer(cch, 65536);
+	int64_t len = (int64_t)(seconds * fs);
+	for(int64_t pos = 0; pos < len; pos += buffer.getNumSamples())
+	{
+		noise.getNextAudioBlock(juce::AudioSourceChannelInfo(buffer));
+		buffer.applyGain(0.5f);
+		writer->writeFromAudioSampleBuffer(buffer, 0, (int)std::min(len - pos, (int64_t)buffer.getNumSamples()));
+	}
+	return file;
+}
+
+// n cuts of len samples taken from the source in a scattered order, so that no two neighbors are contiguous
+static WaveCutList createScatteredList(WaveSourceFile::Ptr src, int64_t n, int64_t len)
+{
+	int64_t nslots = std::max((int64_t)3, src->length / len);
+	int64_t stride = nslots / 2 + 1;
+	while(std::gcd(stride, nslots) != 1) ++stride;
+	WaveCutList cl;
+	for(int64_t i = 0; i < n; ++i)
+	{
+		int64_t slot = (i * stride) % nslots;
+		cl.push_back({ src, { slot * len, slot * len + len } });
+	}
+	return cl;
+}
+
+// n contiguous cuts, which mergeAdjucentContinuousCuts() joins into one
+static WaveCutList createContiguousList(WaveSourceFile::Ptr src, int64_t n)
+{
+	int64_t len = std::max((int64_t)1, src->length / n);
+	WaveCutList cl;
+	for(int64_t i = 0; i < n; ++i) cl.push_back({ src, { i * len, i * len + len } });
+	return cl;
+}
+
+// the whole source in scattered cuts of len samples, or as one cut if len is zero
+static WaveCutList createFragmentedList(WaveSourceFile::Ptr src, int64_t len)
+{
+	if(0 < len) return createScatteredList(src, src->length / len, len);
+	WaveCutList cl;
+	cl.push_back({ src, { 0, src->length } });
+	return cl;
+}
+
+// ================================================================================
+// resampler
+
+static void benchmarkResampler(BenchmarkReport& report)
+{
+	static constexpr int BlockLength = 512;
+	static constexpr int NumChannels = 2;
+	static constexpr double RenderSeconds = 20;
+	const double rates[][2] = { { 44100, 48000 }, { 48000, 44100 }, { 96000, 48000 }, { 192000, 44100 } };
+	std::cout << "resampler: " << NumChannels << "ch, " << BlockLength << " samples per block, " << RenderSeconds << " s rendered per case" << std::endl;
+	for(const auto& rate : rates)
+	{
+		for(int iq = 0; iq < WaveResampler::NumQualities; ++iq)
+		{
+			NoiseAudioSource noise;
+			WaveResampler::Quality q = (WaveResampler::Quality)iq;
+			std::unique_ptr<WaveResampler> resampler = WaveResampler::createInstance(&noise, NumChannels, q);
+			resampler->setResamplingRatio(rate[0] / rate[1]);
+			resampler->prepareToPlay(BlockLength, rate[1]);
+			juce::AudioBuffer<float> buffer(NumChannels, BlockLength);
+			// the noise generator is included, measure it alone to subtract it
+			juce::AudioBuffer<float> noisebuffer(NumChannels, juce::roundToInt(BlockLength * rate[0] / rate[1]) + 1);
+			int nblocks = (int)(RenderSeconds * rate[1] / BlockLength);
+			double t0 = juce::Time::getMillisecondCounterHiRes();
+			for(int i = 0; i < nblocks; ++i) noise.getNextAudioBlock(juce::AudioSourceChannelInfo(noisebuffer));
+			double t1 = juce::Time::getMillisecondCounterHiRes();
+			for(int i = 0; i < nblocks; ++i) resampler->getNextAudioBlock(juce::AudioSourceChannelInfo(buffer));
+			double t2 = juce::Time::getMillisecondCounterHiRes();
+			double ms = std::max(0.0, (t2 - t1) - (t1 - t0));
+			double load = ms / (RenderSeconds * 1000) * 100;
+			double ns = ms * 1e6 / ((double)nblocks * BlockLength * NumChannels);
+			std::cout << juce::String::formatted("  %6.0f -> %6.0f  %-9s  %8.2f ms  %6.3f %% of real time  %6.1f ns/sample",
+				rate[0], rate[1], WaveResampler::getQualityName(q), ms, load, ns) << std::endl;
+			juce::DynamicObject::Ptr r = report.add("resampler");
+			r->setProperty("sourceRate", rate[0]);
+			r->setProperty("deviceRate", rate[1]);
+			r->setProperty("quality", WaveResampler::getQualityName(q));
+			r->setProperty("loadPercent", load);
+			r->setProperty("nsPerSample", ns);
+			resampler->releaseResources();
+		}
+	}
+}
+
+// ================================================================================
+// level meter
+
+static void benchmarkLevelMeter(BenchmarkReport& report)
+{
+	static constexpr int NumChannels = 2;
+	static constexpr double SampleRate = 48000;
+	static constexpr double RenderSeconds = 20;
+	const int blocklengths[] = { 64, 256, 512, 1024 };
+	std::cout << "level meter: " << NumChannels << "ch, " << SampleRate << " Hz, " << RenderSeconds << " s metered per case" << std::endl;
+	for(int lbuf : blocklengths)
+	{
+		NoiseAudioSource noise;
+		juce::AudioBuffer<float> buffer(NumChannels, lbuf);
+		noise.getNextAudioBlock(juce::AudioSourceChannelInfo(buffer));
+		std::unique_ptr<WaveLevelMeter> meter = WaveLevelMeter::createInstance();
+		meter->prepare(SampleRate);
+		int nblocks = (int)(RenderSeconds * SampleRate / lbuf);
+		double t0 = juce::Time::getMillisecondCounterHiRes();
+		for(int i = 0; i < nblocks; ++i) meter->process(buffer.getArrayOfReadPointers(), NumChannels, lbuf);
+		double t1 = juce::Time::getMillisecondCounterHiRes();
+		double us = (t1 - t0) * 1000 / nblocks;
+		double period = lbuf / SampleRate * 1e6;
+		std::cout << juce::String::formatted("  %5d samples  %7.2f us per callback (max %7.2f)  %6.3f %% of the callback period",
+			lbuf, us, meter->getMaximumCost(), us / period * 100) << std::endl;
+		juce::DynamicObject::Ptr r = report.add("meter");
+		r->setProperty("blockLength", lbuf);
+		r->setProperty("usPerCallback", us);
+		r->setProperty("maxUsPerCallback", meter->getMaximumCost());
+		r->setProperty("loadPercent", us / period * 100);
+	}
+}
+
+// ================================================================================
+// playback path
+
+static void benchmarkPlayback(const juce::File& fixture, BenchmarkReport& report)
+{
+	static constexpr double RenderSeconds = 60;		// free running, looped over the source
+	static constexpr double RealTimeSeconds = 5;
+	struct Case
+	{
+		NullAudioIODevice::Cadence cadence;
+		double sampleRate;
+		int bufferSize;
+		WaveResampler::Quality quality;
+	};
+	const Case cases[] =
+	{
+		{ NullAudioIODevice::CadenceFreeRunning, 44100, 512, WaveResampler::QualityNormal },
+		{ NullAudioIODevice::CadenceFreeRunning, 48000, 512, WaveResampler::QualityPreview },
+		{ NullAudioIODevice::CadenceFreeRunning, 48000, 512, WaveResampler::QualityNormal },
+		{ NullAudioIODevice::CadenceFreeRunning, 48000, 512, WaveResampler::QualityMastering },
+		{ NullAudioIODevice::CadenceFreeRunning, 48000, 64, WaveResampler::QualityNormal },
+		{ NullAudioIODevice::CadenceFreeRunning, 96000, 1024, WaveResampler::QualityMastering },
+		{ NullAudioIODevice::CadenceRealTime, 48000, 128, WaveResampler::QualityNormal },
+	};
+	juce::AudioFormatManager afm;
+	afm.registerBasicFormats();
+	std::unique_ptr<WaveCutListDocument> document(WaveCutListDocument::createInstance(afm));
+	if(document->loadFrom(fixture, false, false).failed())
+	{
+		std::cout << "playback: failed to open the source file" << std::endl;
+		return;
+	}
+	WaveFormat fmt = document->getWaveFormat();
+	// the null device is the only type, so nothing touches the audio hardware
+	juce::AudioDeviceManager adm;
+	adm.addAudioDeviceType(NullAudioIODevice::createType(NullAudioIODevice::CadenceFreeRunning, 0));
+	std::unique_ptr<WaveCutListPlayer> player = WaveCutListPlayer::createInstance(adm, *document);
+	player->setLooping(true);
+	juce::String err = adm.initialise(0, fmt.numChannels, nullptr, false, NullAudioIODevice::DeviceName);
+	std::cout << "playback: " << fmt.numChannels << "ch " << fmt.sampleRate << " Hz 24-bit file, reader -> resampler -> null device, " << RenderSeconds << " s free running or " << RealTimeSeconds << " s in real time per case" << std::endl;
+	for(const Case& c : cases)
+	{
+		juce::AudioDeviceManager::AudioDeviceSetup setup = adm.getAudioDeviceSetup();
+		setup.sampleRate = c.sampleRate;
+		setup.bufferSize = c.bufferSize;
+		if(err.isEmpty()) err = adm.setAudioDeviceSetup(setup, true);
+		NullAudioIODevice* dev = dynamic_cast<NullAudioIODevice*>(adm.getCurrentAudioDevice());
+		if(err.isNotEmpty() || !dev)
+		{
+			std::cout << "  failed to open the null device: " << err << std::endl;
+			break;
+		}
+		player->setResamplingQuality(c.quality);
+		player->setPosition(0);
+		player->setRunning(true);
+		bool realtime = (c.cadence == NullAudioIODevice::CadenceRealTime);
+		double seconds = realtime ? RealTimeSeconds : RenderSeconds;
+		dev->setCadence(c.cadence);
+		dev->resetStatistics();
+		dev->setCallbackLimit((int64_t)(seconds * c.sampleRate / c.bufferSize));
+		bool finished = dev->waitForCallbackLimit((int)(seconds * 1000) + 10000);
+		player->setRunning(false);
+		NullAudioIODevice::Statistics st = dev->getStatistics();
+		double period = c.bufferSize / c.sampleRate;
+		std::cout << juce::String::formatted("  %-9s %6.0f Hz %4d  %-9s  %7.2f us avg  %7.2f us max  %7.2f us cpu  %6.3f %% load  %3lld misses  checksum %016llx%s",
+			realtime ? "real-time" : "free", c.sampleRate, c.bufferSize, WaveResampler::getQualityName(c.quality),
+			st.getAverageTime() * 1e6, st.maximumTime * 1e6, st.getAverageCpuTime() * 1e6, st.getAverageTime() / period * 100,
+			(long long)st.deadlineMisses, (unsigned long long)st.checksum, finished ? "" : "  (timed out)") << std::endl;
+		juce::DynamicObject::Ptr r = report.add("playback");
+		r->setProperty("cadence", realtime ? "real-time" : "free");
+		r->setProperty("deviceRate", c.sampleRate);
+		r->setProperty("bufferSize", c.bufferSize);
+		r->setProperty("quality", WaveResampler::getQualityName(c.quality));
+		r->setProperty("callbacks", (juce::int64)st.numCallbacks);
+		r->setProperty("usPerCallback", st.getAverageTime() * 1e6);
+		r->setProperty("maxUsPerCallback", st.maximumTime * 1e6);
+		r->setProperty("cpuUsPerCallback", st.getAverageCpuTime() * 1e6);
+		r->setProperty("deadlineMisses", (juce::int64)st.deadlineMisses);
+		r->setProperty("checksum", juce::String::toHexString((juce::int64)st.checksum));
+		r->setProperty("finished", finished);
+	}
+	adm.closeAudioDevice();
+	player.reset();
+	document.reset();
+}
+
+// ================================================================================
+// cut list operations
+
+static void benchmarkCutList(WaveSourceFile::Ptr src, BenchmarkReport& report)
+{
+	static constexpr int64_t CutLength = 64;
+	static constexpr int64_t EditCuts = 10;	// the inserted, erased and intersected span
+	static constexpr int64_t RangeInterval = 100;	// the cuts between the ranges of the multi-range erase
+	static constexpr int64_t MaxEraseEachCuts = 100000;	// quadratic beyond
+	const int64_t sizes[] = { 10, 100, 1000, 10000, 100000, 1000000 };
+	std::cout << "cut list: scattered cuts of " << CutLength << " samples, edits spanning " << EditCuts << " cuts in the middle, us per call" << std::endl;
+	WaveCutList clinsert = createScatteredList(src, EditCuts, CutLength);
+	for(int64_t n : sizes)
+	{
+		const WaveCutList base = createScatteredList(src, n, CutLength);
+		const WaveCutList contiguous = createContiguousList(src, n);
+		// the middle of a cut, so that the edits split one
+		int64_t mid = (n / 2) * CutLength + CutLength / 2;
+		Range64 r{ mid, std::min(mid + EditCuts * CutLength, n * CutLength) };
+		WaveCutList cl;
+		auto copybase = [&]() { cl = base; };
+		double tinsert = measure(copybase, [&]() { cl.insertList(clinsert, mid); });
+		double terase = measure(copybase, [&]() { cl.eraseRange(r); });
+		size_t nintersect = 0;
+		double tintersect = measure([]() {}, [&]() { nintersect += base.intersectRange(r).size(); });
+		double tmerge = measure(copybase, [&]() { cl.mergeAdjucentContinuousCuts(); });
+		double tmergeall = measure([&]() { cl = contiguous; }, [&]() { cl.mergeAdjucentContinuousCuts(); });
+		double tsize = measure([]() {}, [&]() { nintersect += (size_t)base.calcTotalSize(); });
+		// one range in every RangeInterval cuts, erased one at a time from the last, which walks the list for each, or in one pass
+		std::vector<Range64> ranges;
+		for(int64_t i = 0; i < n; i += RangeInterval) ranges.push_back({ i * CutLength + CutLength / 2, i * CutLength + CutLength * 3 / 2 });
+		double teraseeach = -1;
+		if(n <= MaxEraseEachCuts) teraseeach = measure(copybase, [&]() { for(auto it = ranges.rbegin(); it != ranges.rend(); ++it) cl.eraseRange(*it); });
+		double teraseranges = measure(copybase, [&]() { cl.eraseRanges(ranges); });
+		std::cout << juce::String::formatted("  %8lld cuts  insert %10.2f  erase %10.2f  intersect %10.2f  merge %10.2f  merge all %10.2f  total size %10.2f  erase %lld each %12.2f  at once %10.2f",
+			(long long)n, tinsert * 1e6, terase * 1e6, tintersect * 1e6, tmerge * 1e6, tmergeall * 1e6, tsize * 1e6, (long long)ranges.size(), teraseeach * 1e6, teraseranges * 1e6) << std::endl;
+		juce::DynamicObject::Ptr res = report.add("cutlist");
+		res->setProperty("cuts", (juce::int64)n);
+		res->setProperty("insertListUs", tinsert * 1e6);
+		res->setProperty("eraseRangeUs", terase * 1e6);
+		res->setProperty("intersectRangeUs", tintersect * 1e6);
+		res->setProperty("mergeUs", tmerge * 1e6);
+		res->setProperty("mergeAllUs", tmergeall * 1e6);
+		res->setProperty("calcTotalSizeUs", tsize * 1e6);
+		res->setProperty("numRanges", (juce::int64)ranges.size());
+		if(0 <= teraseeach) res->setProperty("eraseRangeEachUs", teraseeach * 1e6);
+		res->setProperty("eraseRangesUs", teraseranges * 1e6);
+		juce::ignoreUnused(nintersect);
+	}
+}
+
+// ================================================================================
+// reader throughput
+
+static void benchmarkReader(WaveSourceFile::Ptr src, BenchmarkReport& report)
+{
+	static constexpr int BlockLength = 4096;
+	struct Case { int64_t cutLength; bool consolidated; };
+	// zero reads the source as one cut; the consolidated case should read like it
+	const Case cases[] = { { 64, false }, { 1024, false }, { 16384, false }, { 0, false }, { 64, true } };
+	int cch = src->format.numChannels;
+	std::cout << "reader: " << cch << "ch, " << BlockLength << " samples per read, the whole source per case" << std::endl;
+	for(const Case& c : cases)
+	{
+		WaveCutList cl = createFragmentedList(src, c.cutLength);
+		int64_t numfragments = (int64_t)cl.size();
+		double consolidateseconds = 0;
+		if(c.consolidated)
+		{
+			double t0 = juce::Time::getMillisecondCounterHiRes();
+			for(Range64 span; !(span = WaveCutListConsolidator::findFragmentedSpan(cl, src->format.sampleRate)).isEmpty(); )
+			{
+				WaveCutList clspan = WaveCutListConsolidator::render(cl.intersectRange(span), { 0, span.size() });
+				if(clspan.empty()) break;
+				cl.eraseRange(span);
+				cl.insertList(clspan, span.begin);
+			}
+			consolidateseconds = (juce::Time::getMillisecondCounterHiRes() - t0) * 0.001;
+		}
+		WaveCutListReader::Ptr reader = WaveCutListReader::createInstance();
+		reader->setWaveCutList(cl);
+		reader->setPosition(0);
+		int64_t total = reader->getTotalLength();
+		juce::AudioBuffer<float> buffer(cch, BlockLength);
+		bool ok = true;
+		double t0 = juce::Time::getMillisecondCounterHiRes();
+		for(int64_t pos = 0; ok && (pos < total); pos += BlockLength) ok = reader->read(buffer.getArrayOfWritePointers(), cch, (int)std::min((int64_t)BlockLength, total - pos));
+		double seconds = (juce::Time::getMillisecondCounterHiRes() - t0) * 0.001;
+		double msps = (0 < seconds) ? ((double)total / seconds * 1e-6) : 0;
+		double xrt = (0 < seconds) ? ((double)total / src->format.sampleRate / seconds) : 0;
+		std::cout << juce::String::formatted("  cut length %6s  %8lld cuts  %8.2f Msamples/s  %8.1f x real time%s%s",
+			(0 < c.cutLength) ? juce::String(c.cutLength).toRawUTF8() : "whole", (long long)cl.size(), msps, xrt,
+			c.consolidated ? juce::String::formatted("  (consolidated from %lld cuts in %.2f s)", (long long)numfragments, consolidateseconds).toRawUTF8() : "",
+			ok ? "" : "  (read failed)") << std::endl;
+		juce::DynamicObject::Ptr r = report.add("reader");
+		r->setProperty("cutLength", (juce::int64)c.cutLength);
+		r->setProperty("cuts", (juce::int64)cl.size());
+		if(c.consolidated)
+		{
+			r->setProperty("consolidatedFrom", (juce::int64)numfragments);
+			r->setProperty("consolidateSeconds", consolidateseconds);
+		}
+		r->setProperty("megasamplesPerSecond", msps);
+		r->setProperty("realTimeFactor", xrt);
+		r->setProperty("ok", ok);
+	}
+}
+
+// ================================================================================
+// modifier renders
+
+static bool areSamplesIdentical(const WaveCutList& cla, const WaveCutList& clb)
+{
+	int64_t len = cla.calcTotalSize();
+	if(len != clb.calcTotalSize()) return false;
+	int cch = cla.front().sourceFile->format.numChannels;
+	WaveCutListReader::Ptr ra = WaveCutListReader::createInstance(), rb = WaveCutListReader::createInstance();
+	ra->setWaveCutList(cla);
+	rb->setWaveCutList(clb);
+	juce::AudioBuffer<float> bufa(cch, 16384), bufb(cch, 16384);
+	for(int64_t pos = 0; pos < len; )
+	{
+		int n = (int)std::min(len - pos, (int64_t)bufa.getNumSamples());
+		if(!ra->read(bufa.getArrayOfWritePointers(), cch, n) || !rb->read(bufb.getArrayOfWritePointers(), cch, n)) return false;
+		for(int ich = 0; ich < cch; ++ich)
+		{
+			if(std::memcmp(bufa.getReadPointer(ich), bufb.getReadPointer(ich), sizeof(float) * (size_t)n) != 0) return false;
+		}
+		pos += n;
+	}
+	return true;
+}
+
+static void benchmarkRender(WaveSourceFile::Ptr src, BenchmarkReport& report)
+{
+	static constexpr double RenderSeconds = 10;
+	const int64_t cutlengths[] = { 1024, 0 };
+	std::cout << "render: processSyncWithRamp() over " << RenderSeconds << " s, written to temporary storage" << std::endl;
+	for(int64_t lcut : cutlengths)
+	{
+		WaveCutList cl = createFragmentedList(src, lcut);
+		Range64 r{ 0, std::min(cl.calcTotalSize(), (int64_t)(RenderSeconds * src->format.sampleRate)) };
+		double t0 = juce::Time::getMillisecondCounterHiRes();
+		WaveCutList result = WaveCutListModifier::processSyncWithRamp(cl, r, 0, 1);
+		double seconds = (juce::Time::getMillisecondCounterHiRes() - t0) * 0.001;
+		double xrt = (0 < seconds) ? ((double)r.size() / src->format.sampleRate / seconds) : 0;
+		std::cout << juce::String::formatted("  cut length %6s  %8.2f ms  %8.1f x real time%s",
+			(0 < lcut) ? juce::String(lcut).toRawUTF8() : "whole", seconds * 1000, xrt, result.empty() ? "  (failed)" : "") << std::endl;
+		juce::DynamicObject::Ptr res = report.add("render");
+		res->setProperty("cutLength", (juce::int64)lcut);
+		res->setProperty("seconds", seconds);
+		res->setProperty("realTimeFactor", xrt);
+		res->setProperty("ok", !result.empty());
+	}
+	// a normalize of the whole fixture, its two passes timed apart; the serial render at the same gain is the baseline
+	std::cout << "render: normalize the whole list, measurePeak() then processParallelWithGain() on " << juce::SystemStats::getNumCpus() << " CPUs" << std::endl;
+	for(int64_t lcut : cutlengths)
+	{
+		WaveCutList cl = createFragmentedList(src, lcut);
+		Range64 r{ 0, cl.calcTotalSize() };
+		double t0 = juce::Time::getMillisecondCounterHiRes();
+		float peak = WaveNormalizer::measurePeak(cl, r);
+		double t1 = juce::Time::getMillisecondCounterHiRes();
+		float gain = (0 < peak) ? (float)(juce::Decibels::decibelsToGain(WaveNormalizer::DefaultPeakDb) / peak) : 1.0f;
+		WaveCutList result = WaveCutListModifier::processParallelWithGain(cl, r, gain);
+		double t2 = juce::Time::getMillisecondCounterHiRes();
+		WaveCutList serial = WaveCutListModifier::processSyncWithRamp(cl, r, gain, gain);
+		double t3 = juce::Time::getMillisecondCounterHiRes();
+		double seconds = (t2 - t0) * 0.001;
+		double xrt = (0 < seconds) ? ((double)r.size() / src->format.sampleRate / seconds) : 0;
+		std::cout << juce::String::formatted("  cut length %6s  peak %8.2f ms  gain %8.2f ms  %8.1f x real time  serial %8.2f ms%s",
+			(0 < lcut) ? juce::String(lcut).toRawUTF8() : "whole", t1 - t0, t2 - t1, xrt, t3 - t2, (result.empty() || (peak < 0)) ? "  (failed)" : "") << std::endl;
+		juce::DynamicObject::Ptr res = report.add("normalize");
+		res->setProperty("cutLength", (juce::int64)lcut);
+		res->setProperty("measureSeconds", (t1 - t0) * 0.001);
+		res->setProperty("gainSeconds", (t2 - t1) * 0.001);
+		res->setProperty("serialSeconds", (t3 - t2) * 0.001);
+		res->setProperty("realTimeFactor", xrt);
+		res->setProperty("ok", !result.empty() && (0 <= peak));
+	}
+	// an effect chain with state, on one piece and on a piece per CPU; the two must agree bit for bit
+	WaveEffectChain chain;
+	WaveEffectChain::parse("dc highpass:80 peak:3000,2,1 compress:-20,4", chain);
+	std::cout << "render: effect chain " << chain.getDescription().quoted() << " over the whole list, serial and on " << juce::SystemStats::getNumCpus() << " CPUs" << std::endl;
+	for(int64_t lcut : cutlengths)
+	{
+		WaveCutList cl = createFragmentedList(src, lcut);
+		Range64 r{ 0, cl.calcTotalSize() };
+		double t0 = juce::Time::getMillisecondCounterHiRes();
+		WaveCutList serial = chain.render(cl, r, 1);
+		double t1 = juce::Time::getMillisecondCounterHiRes();
+		WaveCutList parallel = chain.render(cl, r);
+		double t2 = juce::Time::getMillisecondCounterHiRes();
+		bool identical = !serial.empty() && !parallel.empty() && areSamplesIdentical(serial, parallel);
+		double xrt = (t1 < t2) ? ((double)r.size() / src->format.sampleRate / ((t2 - t1) * 0.001)) : 0;
+		std::cout << juce::String::formatted("  cut length %6s  serial %8.2f ms  parallel %8.2f ms  %8.1f x real time  %s",
+			(0 < lcut) ? juce::String(lcut).toRawUTF8() : "whole", t1 - t0, t2 - t1, xrt, identical ? "identical" : "DIFFERENT") << std::endl;
+		juce::DynamicObject::Ptr res = report.add("effect");
+		res->setProperty("cutLength", (juce::int64)lcut);
+		res->setProperty("serialSeconds", (t1 - t0) * 0.001);
+		res->setProperty("parallelSeconds", (t2 - t1) * 0.001);
+		res->setProperty("realTimeFactor", xrt);
+		res->setProperty("ok", identical);
+	}
+}
+
+// ================================================================================
+// loudness
+
+static void benchmarkLoudness(WaveSourceFile::Ptr src, BenchmarkReport& report)
+{
+	const int64_t cutlengths[] = { 0, 16384, 1024 };
+	// the summary is built once per source, as the analyzer's pool does it
+	WaveLoudnessSummary::Ptr summary = WaveLoudnessSummary::createInstance(src->format.sampleRate, src->format.numChannels, src->length);
+	src->loudnessSummary.install(summary);
+	std::unique_ptr<juce::ThreadPoolJob> job(WaveLoudnessSummary::createBuilderJob(src, summary));
+	double t0 = juce::Time::getMillisecondCounterHiRes();
+	while(job->runJob() == juce::ThreadPoolJob::jobNeedsRunningAgain) {}
+	double buildseconds = (juce::Time::getMillisecondCounterHiRes() - t0) * 0.001;
+	double xrt = (0 < buildseconds) ? ((double)src->length / src->format.sampleRate / buildseconds) : 0;
+	std::cout << "loudness: summary of the whole source " << juce::String::formatted("%.2f ms  %.1f x real time", buildseconds * 1000, xrt) << ", then the recombination after an edit, us per call" << std::endl;
+	for(int64_t lcut : cutlengths)
+	{
+		WaveCutList cl = createFragmentedList(src, lcut);
+		WaveLoudness::Result result;
+		bool ok = true;
+		double tmeasure = measure([]() {}, [&]() { ok = WaveLoudness::measure(cl, result) && ok; });
+		std::cout << juce::String::formatted("  cut length %6s  %10.2f  %.2f LUFS  LRA %.2f LU  %.2f dBTP%s",
+			(0 < lcut) ? juce::String(lcut).toRawUTF8() : "whole", tmeasure * 1e6, result.integrated, result.range, result.truePeak, ok ? "" : "  (failed)") << std::endl;
+		juce::DynamicObject::Ptr res = report.add("loudness");
+		res->setProperty("cutLength", (juce::int64)lcut);
+		res->setProperty("buildSeconds", buildseconds);
+		res->setProperty("measureUs", tmeasure * 1e6);
+		res->setProperty("integrated", result.integrated);
+		res->setProperty("ok", ok);
+	}
+	src->loudnessSummary.discard(summary);
+}
+
+// ================================================================================
+// save
+
+static void benchmarkSave(const juce::File& fixture, BenchmarkReport& report)
+{
+	static constexpr int NumErasures = 1000;
+	static constexpr int64_t ErasureLength = 64;
+	juce::AudioFormatManager afm;
+	afm.registerBasicFormats();
+	std::unique_ptr<WaveCutListDocument> document(WaveCutListDocument::createInstance(afm));
+	if(document->loadFrom(fixture, false, false).failed())
+	{
+		std::cout << "save: failed to open the source file" << std::endl;
+		return;
+	}
+	std::cout << "save: the whole document as 24-bit WAV, as loaded and after " << NumErasures << " erasures" << std::endl;
+	for(int pass = 0; pass < 2; ++pass)
+	{
+		if(pass == 1)
+		{
+			// from the end, so that the positions ahead stay valid
+			int64_t step = document->getTotalLength() / (NumErasures + 1);
+			for(int i = NumErasures; 0 < i; --i) document->erase({ step * i, step * i + ErasureLength });
+		}
+		int64_t len = document->getTotalLength();
+		size_t ncuts = document->getWaveCutlist().size();
+		juce::File file = juce::File::getSpecialLocation(juce::File::tempDirectory).getNonexistentChildFile("TestWaveEditBenchmarksSave", ".wav");
+		double t0 = juce::Time::getMillisecondCounterHiRes();
+		bool ok = document->saveAs(file, false, false, false, false) == juce::FileBasedDocument::savedOk;
+		double seconds = (juce::Time::getMillisecondCounterHiRes() - t0) * 0.001;
+		double mbps = (0 < seconds) ? ((double)file.getSize() / seconds * 1e-6) : 0;
+		double xrt = (0 < seconds) ? ((double)len / document->getWaveFormat().sampleRate / seconds) : 0;
+		std::cout << juce::String::formatted("  %8lld cuts  %8.2f ms  %8.1f MB/s  %8.1f x real time%s",
+			(long long)ncuts, seconds * 1000, mbps, xrt, ok ? "" : "  (failed)") << std::endl;
+		juce::DynamicObject::Ptr r = report.add("save");
+		r->setProperty("cuts", (juce::int64)ncuts);
+		r->setProperty("seconds", seconds);
+		r->setProperty("megabytesPerSecond", mbps);
+		r->setProperty("realTimeFactor", xrt);
+		r->setProperty("ok", ok);
+		file.deleteFile();
+	}
+}
+
+// ================================================================================
+// journal round trip
+
+// a multi-range erase written to a journal, read back and replayed into a document, which must end up with the same cuts
+static void benchmarkJournal(WaveSourceFile::Ptr src, BenchmarkReport& report)
+{
+	static constexpr int NumRanges = 1000;
+	static constexpr int64_t RangeLength = 64;
+	juce::AudioFormatManager afm;
+	afm.registerBasicFormats();
+	WaveProject::Content content;
+	content.format = src->format;
+	content.bitsPerSample = 24;
+	WaveCutList whole;
+	whole.push_back({ src, { 0, src->length } });
+	content.base = whole;
+	WaveJournal::Edit edit{ WaveJournal::Edit::EraseRanges, "erase" };
+	int64_t step = src->length / (NumRanges + 1);
+	for(int i = 1; i <= NumRanges; ++i) edit.ranges.push_back({ step * i, step * i + RangeLength });
+	WaveCutList expected = whole;
+	expected.eraseRanges(edit.ranges);
+	expected.mergeAdjucentContinuousCuts();
+	std::cout << "journal: an eraseranges record of " << NumRanges << " ranges, written, read back and replayed" << std::endl;
+	double t0 = juce::Time::getMillisecondCounterHiRes();
+	std::unique_ptr<WaveJournal> journal = WaveJournal::createInstance();
+	journal->writeCheckpoint(content, {}, false);
+	journal->writeEdit(edit);
+	journal->flush();
+	double t1 = juce::Time::getMillisecondCounterHiRes();
+	auto sameRange = [](const Range64& a, const Range64& b) { return (a.begin == b.begin) && (a.end == b.end); };
+	WaveJournal::Recovery recovery;
+	juce::Result r = WaveJournal::read(afm, journal->getFile(), recovery);
+	bool readok = r.wasOk() && (recovery.edits.size() == 1) && (recovery.edits.front().type == WaveJournal::Edit::EraseRanges) && std::equal(recovery.edits.front().ranges.begin(), recovery.edits.front().ranges.end(), edit.ranges.begin(), edit.ranges.end(), sameRange);
+	double t2 = juce::Time::getMillisecondCounterHiRes();
+	std::unique_ptr<WaveCutListDocument> document(WaveCutListDocument::createInstance(afm));
+	bool replayok = readok && document->recoverFromJournal(journal->getFile()).wasOk();
+	double t3 = juce::Time::getMillisecondCounterHiRes();
+	const WaveCutList& recovered = document->getWaveCutlist();
+	// the recovered cuts read a source reopened from the same file
+	bool identical = replayok && std::equal(recovered.begin(), recovered.end(), expected.begin(), expected.end(), [&](const WaveCut& a, const WaveCut& b)
+	{
+		return (a.sourceFile->length == b.sourceFile->length) && sameRange(a.range, b.range);
+	});
+	std::cout << juce::String::formatted("  write %8.2f ms  read %8.2f ms  replay %8.2f ms  %s",
+		t1 - t0, t2 - t1, t3 - t2, identical ? "identical" : (readok ? (replayok ? "DIFFERENT" : "replay failed") : "read failed")) << std::endl;
+	juce::DynamicObject::Ptr res = report.add("journal");
+	res->setProperty("ranges", NumRanges);
+	res->setProperty("writeSeconds", (t1 - t0) * 0.001);
+	res->setProperty("readSeconds", (t2 - t1) * 0.001);
+	res->setProperty("replaySeconds", (t3 - t2) * 0.001);
+	res->setProperty("ok", identical);
+}
+
+// ================================================================================
+// main
+
+int main(int argc, char** argv)
+{
+	static constexpr double FixtureRate = 44100;
+	static constexpr int FixtureChannels = 2;
+	static constexpr double FixtureSeconds = 60;
+	// the player and the device manager post change messages
+	juce::ScopedJuceInitialiser_GUI juceinit;
+	juce::ArgumentList args(argc, argv);
+	if(args.containsOption("--help|-h"))
+	{
+		std::cout << "usage: " << args.executableName << " [--suite=resampler,meter,playback,cutlist,reader,render,loudness,journal,save] [--json=results.json]" << std::endl;
+		return 0;
+	}
+	juce::StringArray suites = juce::StringArray::fromTokens(args.getValueForOption("--suite"), ",", "");
+	suites.removeEmptyStrings();
+	auto selected = [&](const char* name) { return suites.isEmpty() || suites.contains(name); };
+	BenchmarkReport report;
+	if(selected("resampler")) benchmarkResampler(report);
+	if(selected("meter")) benchmarkLevelMeter(report);
+	if(selected("playback") || selected("cutlist") || selected("reader") || selected("render") || selected("loudness") || selected("journal") || selected("save"))
+	{
+		juce::File fixture = createNoiseWaveFile(FixtureRate, FixtureChannels, FixtureSeconds);
+		juce::AudioFormatManager afm;
+		afm.registerBasicFormats();
+		WaveSourceFile::Ptr src = (fixture != juce::File()) ? ArchivedWaveSourceFile::createInstance(afm, fixture) : nullptr;
+		if(!src)
+		{
+			std::cout << "failed to create the fixture file" << std::endl;
+			return 1;
+		}
+		if(selected("playback")) benchmarkPlayback(fixture, report);
+		if(selected("cutlist")) benchmarkCutList(src, report);
+		if(selected("reader")) benchmarkReader(src, report);
+		if(selected("render")) benchmarkRender(src, report);
+		if(selected("loudness")) benchmarkLoudness(src, report);
+		if(selected("journal")) benchmarkJournal(src, report);
+		if(selected("save")) benchmarkSave(fixture, report);
+		src = nullptr;
+		fixture.deleteFile();
+	}
+	if(args.containsOption("--json"))
+	{
+		juce::File file = args.getFileForOption("--json");
+		if(!report.writeTo(file))
+		{
+			std::cout << "failed to write " << file.getFullPathName() << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -12,7 +12,17 @@ enum CommandIDs
 	FileOpen = 1,
 	FileSave,
 	FileSaveAs,
+	FileSaveProjectAs,
 	AppDeviceSetup,
+	AppDiagnostics,
+	AppTraceRecord,
+	AppStorageFloat,
+	AppStorageNative,
+	AppStorageCompressed,
+	AppStorageQuota1GB,
+	AppStorageQuota4GB,
+	AppStorageQuota16GB,
+	AppStorageQuotaUnlimited,
 	AppExit,
 	EditUndo,
 	EditRedo,
@@ -23,8 +33,23 @@ enum CommandIDs
 	EditFadein,
 	EditFadeout,
 	EditMute,
+	EditNormalizePeak,
+	EditNormalizeLoudness,
+	EditEffectDcRemoval,
+	EditEffectHighPass,
+	EditEffectCompressor,
+	EditEffectChain,
+	EditStripSilence,
+	EditSnapOff,
+	EditSnapZeroCrossing,
+	EditSnapTransient,
 	TransportRun,
 	TransportLoop,
+	TransportLoopSelection,
+	TransportLoopCrossfade,
 	TransportHome,
 	TransportEnd,
+	TransportQualityPreview,
+	TransportQualityNormal,
+	TransportQualityMastering,
 };
@@ -7,8 +7,15 @@
 
 #include <JuceHeader.h>
 #include "WaveCutListDocument.h"
+#include "WaveJournal.h"
+#include "WaveProject.h"
+#include "WaveSilenceDetector.h"
+#include "WaveNormalizer.h"
+#include "WaveEffect.h"
 #include "WaveCutListPlayer.h"
 #include "MainPane.h"
+#include "NullAudioIODevice.h"
+#include "WaveTrace.h"
 #include "CommandIDs.h"
 
 // ================================================================================
@@ -42,6 +49,151 @@ public:
 	}
 };
 
+// ================================================================================
+// DiagnosticsWindow
+
+class DiagnosticsWindow : public juce::DocumentWindow
+{
+protected:
+	class ContentPane : public juce::Component, public juce::Timer
+	{
+	public:
+		juce::AudioDeviceManager& audioDeviceManager;
+		WaveCutListPlayer& player;
+		juce::TextEditor textEditor;
+		juce::TextButton resetButton{ "Reset" };
+		juce::TextButton saveButton{ "Save JSON..." };
+		std::unique_ptr<juce::FileChooser> fileChooser;
+		enum { ButtonWidth = 100, ButtonHeight = 24, Margin = 4, RefreshRate = 4 };
+		ContentPane(juce::AudioDeviceManager& adm, WaveCutListPlayer& play) : audioDeviceManager(adm), player(play)
+		{
+			textEditor.setMultiLine(true);
+			textEditor.setReadOnly(true);
+			textEditor.setFont(juce::Font(juce::Font::getDefaultMonospacedFontName(), 13, juce::Font::plain));
+			addAndMakeVisible(textEditor);
+			resetButton.onClick = [this]() { player.getDiagnostics().requestReset(); };
+			addAndMakeVisible(resetButton);
+			saveButton.onClick = [this]() { saveDump(); };
+			addAndMakeVisible(saveButton);
+			setSize(720, 180);
+			update();
+			startTimerHz(RefreshRate);
+		}
+		juce::var createDump() const
+		{
+			juce::var v = player.getDiagnostics().toVar();
+			if(juce::DynamicObject* obj = v.getDynamicObject())
+			{
+				obj->setProperty("time", juce::Time::getCurrentTime().toISO8601(true));
+				if(juce::AudioIODevice* dev = audioDeviceManager.getCurrentAudioDevice())
+				{
+					obj->setProperty("device", dev->getName());
+					obj->setProperty("sampleRate", dev->getCurrentSampleRate());
+					obj->setProperty("bufferSize", dev->getCurrentBufferSizeSamples());
+				}
+				obj->setProperty("deviceXRuns", audioDeviceManager.getXRunCount());
+				TemporaryWaveSourceFile::StorageUsage usage = TemporaryWaveSourceFile::getStorageUsage();
+				obj->setProperty("temporaryFiles", usage.numFiles);
+				obj->setProperty("temporaryBytes", (juce::int64)usage.numBytes);
+			}
+			return v;
+		}
+		void update()
+		{
+			juce::String s;
+			if(juce::AudioIODevice* dev = audioDeviceManager.getCurrentAudioDevice())
+			{
+				s << dev->getName() << ", " << dev->getCurrentSampleRate() << " Hz, " << dev->getCurrentBufferSizeSamples() << " samples, " << audioDeviceManager.getXRunCount() << " xruns reported by the device\n";
+			}
+			s << player.getDiagnostics().toText();
+			TemporaryWaveSourceFile::StorageUsage usage = TemporaryWaveSourceFile::getStorageUsage();
+			s << "temporary storage " << juce::File::descriptionOfSizeInBytes(usage.numBytes) << " in " << usage.numFiles << " files\n";
+			textEditor.setText(s, false);
+		}
+		void saveDump()
+		{
+			fileChooser = std::make_unique<juce::FileChooser>("Save Diagnostics", juce::File::getSpecialLocation(juce::File::userDocumentsDirectory).getChildFile("TestWaveEditDiagnostics.json"), "*.json");
+			fileChooser->launchAsync(juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles | juce::FileBrowserComponent::warnAboutOverwriting, [this](const juce::FileChooser& fc)
+			{
+				juce::File file = fc.getResult();
+				if(file != juce::File()) file.replaceWithText(juce::JSON::toString(createDump()));
+			});
+		}
+		virtual void resized() override
+		{
+			juce::Rectangle<int> rc = getLocalBounds().reduced(Margin);
+			juce::Rectangle<int> rcbuttons = rc.removeFromBottom(ButtonHeight);
+			rc.removeFromBottom(Margin);
+			textEditor.setBounds(rc);
+			saveButton.setBounds(rcbuttons.removeFromRight(ButtonWidth));
+			rcbuttons.removeFromRight(Margin);
+			resetButton.setBounds(rcbuttons.removeFromRight(ButtonWidth));
+		}
+		virtual void timerCallback() override
+		{
+			update();
+		}
+	};
+	DiagnosticsWindow(juce::AudioDeviceManager& adm, WaveCutListPlayer& play) : DocumentWindow("Playback Diagnostics", juce::LookAndFeel::getDefaultLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId), DocumentWindow::closeButton, true)
+	{
+		setUsingNativeTitleBar(true);
+		setResizable(true, true);
+		setContentOwned(new ContentPane(adm, play), true);
+		centreAroundComponent(nullptr, getWidth(), getHeight());
+		setVisible(true);
+	}
+	virtual void closeButtonPressed() override
+	{
+		closeWindow();
+	}
+public:
+	void closeWindow()
+	{
+		delete this;
+	}
+	static juce::Component::SafePointer<DiagnosticsWindow> createWindow(juce::AudioDeviceManager& adm, WaveCutListPlayer& play)
+	{
+		return new DiagnosticsWindow(adm, play);
+	}
+};
+
+// ================================================================================
+// AnalysisWindow
+
+// runs a measurement off the message thread behind a progress window that can cancel it, then the edit it leads to on the message thread
+class AnalysisWindow : public juce::ThreadWithProgressWindow
+{
+public:
+	using Analysis = std::function<juce::Result(const std::function<bool()>& shouldcancel)>;
+protected:
+	juce::String title;
+	Analysis analysis;
+	std::function<void()> completion;
+	juce::Result result = juce::Result::ok();
+	AnalysisWindow(const juce::String& t, juce::Component* owner, Analysis a, std::function<void()> c) : ThreadWithProgressWindow(t, true, true, 10000, {}, owner), title(t), analysis(std::move(a)), completion(std::move(c))
+	{
+		setProgress(-1);
+	}
+	virtual void run() override
+	{
+		result = analysis([this]() { return threadShouldExit(); });
+	}
+	virtual void threadComplete(bool cancelled) override
+	{
+		if(!cancelled)
+		{
+			if(result.wasOk()) completion();
+			else juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::WarningIcon, title, result.getErrorMessage());
+		}
+		delete this;
+	}
+public:
+	static void launch(const juce::String& title, juce::Component* owner, Analysis analysis, std::function<void()> completion)
+	{
+		(new AnalysisWindow(title, owner, std::move(analysis), std::move(completion)))->launchThread();
+	}
+};
+
 // ================================================================================
 // toolbar commands
 
@@ -205,7 +357,7 @@ private:
 		juce::Toolbar toolbar;
 		MainPane mainPane;
 		enum { ToolBarHeight = 24 };
-		ContentPane(juce::ApplicationCommandManager& acm, juce::AudioFormatManager& afm, WaveCutListDocument& doc, WaveCutListPlayer& play) : mainPane(acm, afm, doc, play)
+		ContentPane(juce::ApplicationCommandManager& acm, WaveCutListDocument& doc, WaveCutListPlayer& play) : mainPane(acm, doc, play)
 		{
 			setOpaque(true);
 			addAndMakeVisible(menuBarComponent);
@@ -226,9 +378,17 @@ private:
 		}
 	}*contentPane;
 	juce::Component::SafePointer<SetupWindow> setupWindow;
+	juce::Component::SafePointer<DiagnosticsWindow> diagnosticsWindow;
+	std::unique_ptr<juce::FileChooser> projectFileChooser;
+	static constexpr double DefaultHighPassFrequency = 80;
+	std::unique_ptr<juce::AlertWindow> effectChainWindow;
+	juce::String effectChainText = "dc highpass:80 peak:3000,2,1 compress:-20,4";
+#if WAVE_TRACE
+	std::unique_ptr<juce::FileChooser> traceFileChooser;
+#endif
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MainWindow)
 public:
-	MainWindow(juce::String name, juce::ApplicationCommandManager& acm, juce::AudioFormatManager& afm, juce::AudioDeviceManager& adm, WaveCutListDocument& doc, WaveCutListPlayer& play)
+	MainWindow(juce::String name, juce::ApplicationCommandManager& acm, juce::AudioDeviceManager& adm, WaveCutListDocument& doc, WaveCutListPlayer& play)
 		: DocumentWindow(name, juce::Desktop::getInstance().getDefaultLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId), DocumentWindow::allButtons)
 		, applicationCommandManager(acm)
 		, audioDeviceManager(adm)
@@ -236,7 +396,7 @@ public:
 		, player(play)
 	{
 		setUsingNativeTitleBar(true);
-		contentPane = new ContentPane(applicationCommandManager, afm, doc, player);
+		contentPane = new ContentPane(applicationCommandManager, doc, player);
 		setContentOwned(contentPane, true);
 		setApplicationCommandManagerToWatch(&applicationCommandManager);
 		applicationCommandManager.registerAllCommandsForTarget(this);
@@ -254,11 +414,79 @@ public:
 	{
 		contentPane->menuBarComponent.setModel(nullptr);
 		if(setupWindow) setupWindow->closeWindow();
+		if(diagnosticsWindow) diagnosticsWindow->closeWindow();
 	}
 	void closeButtonPressed() override
 	{
 		juce::JUCEApplication::getInstance()->systemRequestedQuit();
 	}
+	// the selection, or the whole document if nothing is selected
+	Range64 getSelectionOrWhole() const
+	{
+		Range64 r = contentPane->mainPane.getSelectionRange64();
+		return !r.isEmpty() ? r : Range64{ 0, document.getTotalLength() };
+	}
+	// measures a copy of the list, which the modal progress window keeps from being edited meanwhile
+	void normalize(juce::Result (*calcgain)(const WaveCutList&, const Range64&, double, float&, const std::function<bool()>&), double target)
+	{
+		Range64 r = getSelectionOrWhole();
+		if(!document.canNormalize(r)) return;
+		WaveCutList cl = document.getWaveCutlist();
+		std::shared_ptr<float> gain = std::make_shared<float>(1.0f);
+		AnalysisWindow::launch("Normalize", this, [=](const std::function<bool()>& shouldcancel)
+		{
+			return calcgain(cl, r, target, *gain, shouldcancel);
+		}, [this, r, gain]()
+		{
+			juce::MouseCursor::showWaitCursor();
+			document.normalize(r, *gain);
+			juce::MouseCursor::hideWaitCursor();
+		});
+	}
+	// scans a copy of the list like normalize(); the peak index built for the view makes this quick on the parts it has scanned
+	void stripSilence()
+	{
+		WaveCutList cl = document.getWaveCutlist();
+		float threshold = juce::Decibels::decibelsToGain(WaveSilenceDetector::DefaultThresholdDb);
+		int64_t minlength = (int64_t)(WaveSilenceDetector::DefaultMinSeconds * document.getWaveFormat().sampleRate);
+		std::shared_ptr<std::vector<Range64>> silences = std::make_shared<std::vector<Range64>>();
+		AnalysisWindow::launch("Strip Silence", this, [=](const std::function<bool()>& shouldcancel)
+		{
+			*silences = WaveSilenceDetector::findSilences(cl, threshold, minlength, shouldcancel);
+			return juce::Result::ok();
+		}, [this, silences]()
+		{
+			juce::MouseCursor::showWaitCursor();
+			document.eraseRanges(*silences);
+			juce::MouseCursor::hideWaitCursor();
+		});
+	}
+	void applyEffect(const WaveEffectChain& chain)
+	{
+		juce::MouseCursor::showWaitCursor();
+		document.applyEffect(getSelectionOrWhole(), chain);
+		juce::MouseCursor::hideWaitCursor();
+	}
+	void showEffectChainWindow()
+	{
+		effectChainWindow = std::make_unique<juce::AlertWindow>("Effect Chain", "The effects in order, e.g.\n"
+			"gain:<dB>  dc  highpass:<Hz>  lowshelf:<Hz>,<dB>  peak:<Hz>,<dB>,<Q>  highshelf:<Hz>,<dB>\n"
+			"compress:<threshold dB>,<ratio>[,<attack ms>,<release ms>[,<makeup dB>]]", juce::MessageBoxIconType::NoIcon, this);
+		effectChainWindow->addTextEditor("chain", effectChainText);
+		effectChainWindow->addButton("Apply", 1, juce::KeyPress(juce::KeyPress::returnKey));
+		effectChainWindow->addButton("Cancel", 0, juce::KeyPress(juce::KeyPress::escapeKey));
+		effectChainWindow->enterModalState(true, juce::ModalCallbackFunction::create([this](int result)
+		{
+			effectChainWindow->exitModalState(result);
+			effectChainWindow->setVisible(false);
+			if(result != 1) return;
+			effectChainText = effectChainWindow->getTextEditorContents("chain");
+			WaveEffectChain chain;
+			juce::Result r = WaveEffectChain::parse(effectChainText, chain);
+			if(r.failed()) juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::WarningIcon, "Effect Chain", r.getErrorMessage());
+			else applyEffect(chain);
+		}));
+	}
 	// --------------------------------------------------------------------------------
 	// juce::MenuBarModel
 	virtual juce::StringArray getMenuBarNames() override
@@ -274,8 +502,28 @@ public:
 				menu.addCommandItem(&applicationCommandManager, CommandIDs::FileOpen);
 				menu.addCommandItem(&applicationCommandManager, CommandIDs::FileSave);
 				menu.addCommandItem(&applicationCommandManager, CommandIDs::FileSaveAs);
+				menu.addCommandItem(&applicationCommandManager, CommandIDs::FileSaveProjectAs);
 				menu.addSeparator();
 				menu.addCommandItem(&applicationCommandManager, CommandIDs::AppDeviceSetup);
+				menu.addCommandItem(&applicationCommandManager, CommandIDs::AppDiagnostics);
+#if WAVE_TRACE
+				menu.addCommandItem(&applicationCommandManager, CommandIDs::AppTraceRecord);
+#endif
+				{
+					juce::PopupMenu submenu;
+					submenu.addCommandItem(&applicationCommandManager, CommandIDs::AppStorageFloat);
+					submenu.addCommandItem(&applicationCommandManager, CommandIDs::AppStorageNative);
+					submenu.addCommandItem(&applicationCommandManager, CommandIDs::AppStorageCompressed);
+					submenu.addSectionHeader("Undo History Quota");
+					submenu.addCommandItem(&applicationCommandManager, CommandIDs::AppStorageQuota1GB);
+					submenu.addCommandItem(&applicationCommandManager, CommandIDs::AppStorageQuota4GB);
+					submenu.addCommandItem(&applicationCommandManager, CommandIDs::AppStorageQuota16GB);
+					submenu.addCommandItem(&applicationCommandManager, CommandIDs::AppStorageQuotaUnlimited);
+					TemporaryWaveSourceFile::StorageUsage usage = TemporaryWaveSourceFile::getStorageUsage();
+					submenu.addSectionHeader("In Use: " + juce::File::descriptionOfSizeInBytes(usage.numBytes) + " in " + juce::String(usage.numFiles) + " files");
+					submenu.addSectionHeader("Undo History: " + juce::File::descriptionOfSizeInBytes(document.getUndoHistoryCost()));
+					menu.addSubMenu("Temporary Storage", submenu);
+				}
 				menu.addSeparator();
 				menu.addCommandItem(&applicationCommandManager, CommandIDs::AppExit);
 				break;
@@ -291,12 +539,43 @@ public:
 				menu.addCommandItem(&applicationCommandManager, CommandIDs::EditFadein);
 				menu.addCommandItem(&applicationCommandManager, CommandIDs::EditFadeout);
 				menu.addCommandItem(&applicationCommandManager, CommandIDs::EditMute);
+				menu.addCommandItem(&applicationCommandManager, CommandIDs::EditNormalizePeak);
+				menu.addCommandItem(&applicationCommandManager, CommandIDs::EditNormalizeLoudness);
+				{
+					juce::PopupMenu submenu;
+					submenu.addCommandItem(&applicationCommandManager, CommandIDs::EditEffectDcRemoval);
+					submenu.addCommandItem(&applicationCommandManager, CommandIDs::EditEffectHighPass);
+					submenu.addCommandItem(&applicationCommandManager, CommandIDs::EditEffectCompressor);
+					submenu.addSeparator();
+					submenu.addCommandItem(&applicationCommandManager, CommandIDs::EditEffectChain);
+					menu.addSubMenu("Effect", submenu);
+				}
+				menu.addSeparator();
+				menu.addCommandItem(&applicationCommandManager, CommandIDs::EditStripSilence);
+				menu.addSeparator();
+				{
+					juce::PopupMenu submenu;
+					submenu.addCommandItem(&applicationCommandManager, CommandIDs::EditSnapOff);
+					submenu.addCommandItem(&applicationCommandManager, CommandIDs::EditSnapZeroCrossing);
+					submenu.addCommandItem(&applicationCommandManager, CommandIDs::EditSnapTransient);
+					menu.addSubMenu("Snap", submenu);
+				}
 				break;
 			case 2:
 				menu.addCommandItem(&applicationCommandManager, CommandIDs::TransportRun);
 				menu.addCommandItem(&applicationCommandManager, CommandIDs::TransportLoop);
+				menu.addCommandItem(&applicationCommandManager, CommandIDs::TransportLoopSelection);
+				menu.addCommandItem(&applicationCommandManager, CommandIDs::TransportLoopCrossfade);
 				menu.addCommandItem(&applicationCommandManager, CommandIDs::TransportHome);
 				menu.addCommandItem(&applicationCommandManager, CommandIDs::TransportEnd);
+				menu.addSeparator();
+				{
+					juce::PopupMenu submenu;
+					submenu.addCommandItem(&applicationCommandManager, CommandIDs::TransportQualityPreview);
+					submenu.addCommandItem(&applicationCommandManager, CommandIDs::TransportQualityNormal);
+					submenu.addCommandItem(&applicationCommandManager, CommandIDs::TransportQualityMastering);
+					menu.addSubMenu("Resampling Quality", submenu);
+				}
 				break;
 		}
 		return menu;
@@ -315,7 +594,19 @@ public:
 			CommandIDs::FileOpen,
 			CommandIDs::FileSave,
 			CommandIDs::FileSaveAs,
+			CommandIDs::FileSaveProjectAs,
 			CommandIDs::AppDeviceSetup,
+			CommandIDs::AppDiagnostics,
+#if WAVE_TRACE
+			CommandIDs::AppTraceRecord,
+#endif
+			CommandIDs::AppStorageFloat,
+			CommandIDs::AppStorageNative,
+			CommandIDs::AppStorageCompressed,
+			CommandIDs::AppStorageQuota1GB,
+			CommandIDs::AppStorageQuota4GB,
+			CommandIDs::AppStorageQuota16GB,
+			CommandIDs::AppStorageQuotaUnlimited,
 			CommandIDs::AppExit,
 			CommandIDs::EditUndo,
 			CommandIDs::EditRedo,
@@ -326,10 +617,25 @@ public:
 			CommandIDs::EditFadein,
 			CommandIDs::EditFadeout,
 			CommandIDs::EditMute,
+			CommandIDs::EditNormalizePeak,
+			CommandIDs::EditNormalizeLoudness,
+			CommandIDs::EditEffectDcRemoval,
+			CommandIDs::EditEffectHighPass,
+			CommandIDs::EditEffectCompressor,
+			CommandIDs::EditEffectChain,
+			CommandIDs::EditStripSilence,
+			CommandIDs::EditSnapOff,
+			CommandIDs::EditSnapZeroCrossing,
+			CommandIDs::EditSnapTransient,
 			CommandIDs::TransportRun,
 			CommandIDs::TransportLoop,
+			CommandIDs::TransportLoopSelection,
+			CommandIDs::TransportLoopCrossfade,
 			CommandIDs::TransportHome,
 			CommandIDs::TransportEnd,
+			CommandIDs::TransportQualityPreview,
+			CommandIDs::TransportQualityNormal,
+			CommandIDs::TransportQualityMastering,
 		};
 		c.addArray(commands);
 	}
@@ -350,9 +656,48 @@ public:
 				info.setInfo("SaveAs", "saveas", "File", 0);
 				info.setActive(document.hasValidContent());
 				break;
+			case CommandIDs::FileSaveProjectAs:
+				info.setInfo("Save Project As...", "save the edits and the undo history without rendering the audio", "File", 0);
+				info.setActive(document.hasValidContent());
+				break;
 			case CommandIDs::AppDeviceSetup:
 				info.setInfo("Setup", "setup", "Device", 0);
 				break;
+			case CommandIDs::AppDiagnostics:
+				info.setInfo("Diagnostics", "show the audio callback timing and the source reads", "Device", 0);
+				break;
+			case CommandIDs::AppTraceRecord:
+				info.setInfo("Record Trace", "record edits, renders, saves and paints, and save them as trace-event JSON when stopped", "Application", 0);
+				info.setTicked(WaveTrace::isRecording());
+				break;
+			case CommandIDs::AppStorageFloat:
+				info.setInfo("32-bit Float", "store temporary files as 32-bit float", "Application", 0);
+				info.setTicked(TemporaryWaveSourceFile::getStorageFormat() == TemporaryWaveSourceFile::StorageFloat);
+				break;
+			case CommandIDs::AppStorageNative:
+				info.setInfo("Source Bit Depth", "store temporary files at the source bit depth where lossless", "Application", 0);
+				info.setTicked(TemporaryWaveSourceFile::getStorageFormat() == TemporaryWaveSourceFile::StorageNative);
+				break;
+			case CommandIDs::AppStorageCompressed:
+				info.setInfo("Lossless Compressed", "store temporary files as FLAC where lossless", "Application", 0);
+				info.setTicked(TemporaryWaveSourceFile::getStorageFormat() == TemporaryWaveSourceFile::StorageCompressed);
+				break;
+			case CommandIDs::AppStorageQuota1GB:
+				info.setInfo("1 GB", "drop the oldest undo steps when they pin more than 1 GB of temporary files and memory", "Application", 0);
+				info.setTicked(TemporaryWaveSourceFile::getStorageQuota() == ((int64_t)1 << 30));
+				break;
+			case CommandIDs::AppStorageQuota4GB:
+				info.setInfo("4 GB", "drop the oldest undo steps when they pin more than 4 GB of temporary files and memory", "Application", 0);
+				info.setTicked(TemporaryWaveSourceFile::getStorageQuota() == ((int64_t)4 << 30));
+				break;
+			case CommandIDs::AppStorageQuota16GB:
+				info.setInfo("16 GB", "drop the oldest undo steps when they pin more than 16 GB of temporary files and memory", "Application", 0);
+				info.setTicked(TemporaryWaveSourceFile::getStorageQuota() == ((int64_t)16 << 30));
+				break;
+			case CommandIDs::AppStorageQuotaUnlimited:
+				info.setInfo("Unlimited", "keep the undo history whatever it pins", "Application", 0);
+				info.setTicked(TemporaryWaveSourceFile::getStorageQuota() == 0);
+				break;
 			case CommandIDs::AppExit:
 				info.setInfo("Exit", "exit", "Application", 0);
 				info.addDefaultKeypress(juce::KeyPress::F4Key, juce::ModifierKeys::altModifier);
@@ -399,6 +744,49 @@ public:
 				info.setInfo("Mute", "mute", "edit", 0);
 				info.setActive(document.canMute(contentPane->mainPane.getSelectionRange64()));
 				break;
+			case CommandIDs::EditNormalizePeak:
+				info.setInfo("Normalize Peak", "bring the peak of the selection, or of all if none, to " + juce::String(WaveNormalizer::DefaultPeakDb) + " dBFS", "edit", 0);
+				info.setActive(document.canNormalize(getSelectionOrWhole()));
+				break;
+			case CommandIDs::EditNormalizeLoudness:
+				info.setInfo("Normalize Loudness", "bring the integrated loudness of the selection, or of all if none, to " + juce::String(WaveNormalizer::DefaultLoudness) + " LUFS", "edit", 0);
+				info.setActive(document.canNormalize(getSelectionOrWhole()));
+				break;
+			case CommandIDs::EditEffectDcRemoval:
+				info.setInfo("Remove DC", "remove the DC offset of the selection, or of all if none", "edit", 0);
+				info.setActive(document.canApplyEffect(getSelectionOrWhole()));
+				break;
+			case CommandIDs::EditEffectHighPass:
+				info.setInfo("High-Pass " + juce::String(DefaultHighPassFrequency) + " Hz", "remove the rumble below " + juce::String(DefaultHighPassFrequency) + " Hz from the selection, or from all if none", "edit", 0);
+				info.setActive(document.canApplyEffect(getSelectionOrWhole()));
+				break;
+			case CommandIDs::EditEffectCompressor:
+			{
+				WaveEffect::CompressorParameters p;
+				info.setInfo("Compress", "compress the selection, or all if none, " + juce::String(p.ratio) + ":1 above " + juce::String(p.thresholdDb) + " dB", "edit", 0);
+				info.setActive(document.canApplyEffect(getSelectionOrWhole()));
+				break;
+			}
+			case CommandIDs::EditEffectChain:
+				info.setInfo("Chain...", "render the selection, or all if none, through a chain of effects", "edit", 0);
+				info.setActive(document.canApplyEffect(getSelectionOrWhole()));
+				break;
+			case CommandIDs::EditStripSilence:
+				info.setInfo("Strip Silence", "erase every region below " + juce::String(WaveSilenceDetector::DefaultThresholdDb) + " dB for " + juce::String(WaveSilenceDetector::DefaultMinSeconds) + " s or longer", "edit", 0);
+				info.setActive(document.hasValidContent());
+				break;
+			case CommandIDs::EditSnapOff:
+				info.setInfo("Off", "place the edit points where the mouse is", "edit", 0);
+				info.setTicked(contentPane->mainPane.getSnapMode() == WaveSnap::SnapOff);
+				break;
+			case CommandIDs::EditSnapZeroCrossing:
+				info.setInfo("Zero Crossing", "move the edit points to the nearest zero crossing", "edit", 0);
+				info.setTicked(contentPane->mainPane.getSnapMode() == WaveSnap::SnapZeroCrossing);
+				break;
+			case CommandIDs::EditSnapTransient:
+				info.setInfo("Transient", "move the edit points to the onset of the nearest transient", "edit", 0);
+				info.setTicked(contentPane->mainPane.getSnapMode() == WaveSnap::SnapTransient);
+				break;
 			case CommandIDs::TransportRun:
 				info.setInfo("Run/Stop", "run/stop", "transport", 0);
 				info.addDefaultKeypress(juce::KeyPress::spaceKey, juce::ModifierKeys::noModifiers);
@@ -409,6 +797,14 @@ public:
 				info.setInfo("Loop", "loop", "transport", 0);
 				info.setTicked(player.isLooping());
 				break;
+			case CommandIDs::TransportLoopSelection:
+				info.setInfo("Loop Selection", "loop the selection rather than the whole list", "transport", 0);
+				info.setTicked(player.isLoopingSelection());
+				break;
+			case CommandIDs::TransportLoopCrossfade:
+				info.setInfo("Loop Crossfade", "crossfade the loop end into the loop start", "transport", 0);
+				info.setTicked(player.isLoopCrossfading());
+				break;
 			case CommandIDs::TransportHome:
 				info.setInfo("Home", "home", "transport", 0);
 				info.addDefaultKeypress(juce::KeyPress::homeKey, juce::ModifierKeys::commandModifier);
@@ -420,6 +816,18 @@ public:
 				info.addDefaultKeypress(juce::KeyPress::endKey, juce::ModifierKeys::commandModifier);
 				info.setActive(document.hasValidContent());
 				break;
+			case CommandIDs::TransportQualityPreview:
+				info.setInfo("Preview", "resample with a short kernel for the lowest CPU load", "transport", 0);
+				info.setTicked(player.getResamplingQuality() == WaveResampler::QualityPreview);
+				break;
+			case CommandIDs::TransportQualityNormal:
+				info.setInfo("Normal", "resample with a medium kernel", "transport", 0);
+				info.setTicked(player.getResamplingQuality() == WaveResampler::QualityNormal);
+				break;
+			case CommandIDs::TransportQualityMastering:
+				info.setInfo("Mastering", "resample with a long kernel for a transparent pass band", "transport", 0);
+				info.setTicked(player.getResamplingQuality() == WaveResampler::QualityMastering);
+				break;
 		}
 	}
 	virtual bool perform(const InvocationInfo& info) override
@@ -438,10 +846,69 @@ public:
 			case CommandIDs::FileSaveAs:
 				document.saveAsInteractiveAsync(true, [this](juce::FileBasedDocument::SaveResult) {});
 				return true;
+			case CommandIDs::FileSaveProjectAs:
+				projectFileChooser = std::make_unique<juce::FileChooser>("Save Project As", document.getFile().withFileExtension(WaveProject::FileExtension), juce::String("*") + WaveProject::FileExtension);
+				projectFileChooser->launchAsync(juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles | juce::FileBrowserComponent::warnAboutOverwriting, [this](const juce::FileChooser& fc)
+				{
+					juce::File file = fc.getResult();
+					if(file != juce::File()) document.saveAsAsync(file.withFileExtension(WaveProject::FileExtension), false, false, true, [](juce::FileBasedDocument::SaveResult) {});
+				});
+				return true;
 			case CommandIDs::AppDeviceSetup:
 				if(!setupWindow) setupWindow = SetupWindow::createWindow(audioDeviceManager);
 				setupWindow->toFront(true);
 				return true;
+			case CommandIDs::AppDiagnostics:
+				if(!diagnosticsWindow) diagnosticsWindow = DiagnosticsWindow::createWindow(audioDeviceManager, player);
+				diagnosticsWindow->toFront(true);
+				return true;
+#if WAVE_TRACE
+			case CommandIDs::AppTraceRecord:
+				if(!WaveTrace::isRecording())
+				{
+					WaveTrace::start();
+				}
+				else
+				{
+					WaveTrace::stop();
+					traceFileChooser = std::make_unique<juce::FileChooser>("Save Trace", juce::File::getSpecialLocation(juce::File::userDocumentsDirectory).getChildFile("TestWaveEditTrace.json"), "*.json");
+					traceFileChooser->launchAsync(juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles | juce::FileBrowserComponent::warnAboutOverwriting, [](const juce::FileChooser& fc)
+					{
+						juce::File file = fc.getResult();
+						if(file != juce::File()) WaveTrace::writeTo(file);
+					});
+				}
+				applicationCommandManager.commandStatusChanged();
+				return true;
+#endif
+			case CommandIDs::AppStorageFloat:
+				TemporaryWaveSourceFile::setStorageFormat(TemporaryWaveSourceFile::StorageFloat);
+				applicationCommandManager.commandStatusChanged();
+				return true;
+			case CommandIDs::AppStorageNative:
+				TemporaryWaveSourceFile::setStorageFormat(TemporaryWaveSourceFile::StorageNative);
+				applicationCommandManager.commandStatusChanged();
+				return true;
+			case CommandIDs::AppStorageCompressed:
+				TemporaryWaveSourceFile::setStorageFormat(TemporaryWaveSourceFile::StorageCompressed);
+				applicationCommandManager.commandStatusChanged();
+				return true;
+			case CommandIDs::AppStorageQuota1GB:
+				TemporaryWaveSourceFile::setStorageQuota((int64_t)1 << 30);
+				applicationCommandManager.commandStatusChanged();
+				return true;
+			case CommandIDs::AppStorageQuota4GB:
+				TemporaryWaveSourceFile::setStorageQuota((int64_t)4 << 30);
+				applicationCommandManager.commandStatusChanged();
+				return true;
+			case CommandIDs::AppStorageQuota16GB:
+				TemporaryWaveSourceFile::setStorageQuota((int64_t)16 << 30);
+				applicationCommandManager.commandStatusChanged();
+				return true;
+			case CommandIDs::AppStorageQuotaUnlimited:
+				TemporaryWaveSourceFile::setStorageQuota(0);
+				applicationCommandManager.commandStatusChanged();
+				return true;
 			case CommandIDs::AppExit:
 				juce::JUCEApplication::getInstance()->systemRequestedQuit();
 				return true;
@@ -472,18 +939,85 @@ public:
 			case CommandIDs::EditMute:
 				document.mute(contentPane->mainPane.getSelectionRange64());
 				return true;
+			case CommandIDs::EditNormalizePeak:
+				// the peak index built for the view stands in for most of the reading
+				normalize(WaveNormalizer::calcGainToPeak, WaveNormalizer::DefaultPeakDb);
+				return true;
+			case CommandIDs::EditNormalizeLoudness:
+				// the loudness summaries built for the meter leave little to measure but the new renders
+				normalize(WaveNormalizer::calcGainToLoudness, WaveNormalizer::DefaultLoudness);
+				return true;
+			case CommandIDs::EditEffectDcRemoval:
+			{
+				WaveEffectChain chain;
+				chain.effects.push_back(WaveEffect::createDcRemoval());
+				applyEffect(chain);
+				return true;
+			}
+			case CommandIDs::EditEffectHighPass:
+			{
+				WaveEffectChain chain;
+				chain.effects.push_back(WaveEffect::createHighPass(DefaultHighPassFrequency));
+				applyEffect(chain);
+				return true;
+			}
+			case CommandIDs::EditEffectCompressor:
+			{
+				WaveEffectChain chain;
+				chain.effects.push_back(WaveEffect::createCompressor({}));
+				applyEffect(chain);
+				return true;
+			}
+			case CommandIDs::EditEffectChain:
+				showEffectChainWindow();
+				return true;
+			case CommandIDs::EditStripSilence:
+				stripSilence();
+				return true;
+			case CommandIDs::EditSnapOff:
+				contentPane->mainPane.setSnapMode(WaveSnap::SnapOff);
+				applicationCommandManager.commandStatusChanged();
+				return true;
+			case CommandIDs::EditSnapZeroCrossing:
+				contentPane->mainPane.setSnapMode(WaveSnap::SnapZeroCrossing);
+				applicationCommandManager.commandStatusChanged();
+				return true;
+			case CommandIDs::EditSnapTransient:
+				contentPane->mainPane.setSnapMode(WaveSnap::SnapTransient);
+				applicationCommandManager.commandStatusChanged();
+				return true;
 			case CommandIDs::TransportRun:
 				player.setRunning(!player.isRunning());
 				return true;
 			case CommandIDs::TransportLoop:
 				player.setLooping(!player.isLooping());
 				return true;
+			case CommandIDs::TransportLoopSelection:
+				player.setLoopingSelection(!player.isLoopingSelection());
+				applicationCommandManager.commandStatusChanged();
+				return true;
+			case CommandIDs::TransportLoopCrossfade:
+				player.setLoopCrossfading(!player.isLoopCrossfading());
+				applicationCommandManager.commandStatusChanged();
+				return true;
 			case CommandIDs::TransportHome:
 				player.setPosition(0);
 				return true;
 			case CommandIDs::TransportEnd:
 				player.setPosition(player.getDuration());
 				return true;
+			case CommandIDs::TransportQualityPreview:
+				player.setResamplingQuality(WaveResampler::QualityPreview);
+				applicationCommandManager.commandStatusChanged();
+				return true;
+			case CommandIDs::TransportQualityNormal:
+				player.setResamplingQuality(WaveResampler::QualityNormal);
+				applicationCommandManager.commandStatusChanged();
+				return true;
+			case CommandIDs::TransportQualityMastering:
+				player.setResamplingQuality(WaveResampler::QualityMastering);
+				applicationCommandManager.commandStatusChanged();
+				return true;
 		}
 		return false;
 	}
@@ -516,6 +1050,7 @@ private:
 	std::unique_ptr<WaveCutListDocument> document;
 	std::unique_ptr<WaveCutListPlayer> player;
 	std::unique_ptr<MainWindow> mainWindow;
+	std::unique_ptr<juce::AlertWindow> recoveryWindow;
 	juce::TooltipWindow toolTipWindow;
 public:
 	TestWaveEditApplication() {}
@@ -526,12 +1061,63 @@ public:
 	{
 		audioFormatManager.registerBasicFormats();
 		audioDeviceManager.initialiseWithDefaultDevices(0, 2);
+		// added after the platform types so that it never becomes the default, but stays selectable for testing without hardware
+		audioDeviceManager.addAudioDeviceType(NullAudioIODevice::createType(NullAudioIODevice::CadenceRealTime));
 		document.reset(WaveCutListDocument::createInstance(audioFormatManager));
 		player = WaveCutListPlayer::createInstance(audioDeviceManager, *document);
-		mainWindow.reset(new MainWindow(getApplicationName(), applicationCommandManager, audioFormatManager, audioDeviceManager, *document, *player));
+		mainWindow.reset(new MainWindow(getApplicationName(), applicationCommandManager, audioDeviceManager, *document, *player));
+		// the journals of the sessions that crashed, looked up before this one starts its own
+		juce::Array<juce::File> orphans = WaveJournal::findOrphans();
+		document->setJournalingEnabled(true);
+		juce::Array<juce::File> recoverable;
+		for(const juce::File& f : orphans) if(WaveJournal::hasUnsavedEdits(f)) recoverable.add(f);
+		if(!recoverable.isEmpty()) offerRecovery(orphans, recoverable);
+		else discardOrphans(orphans);
+	}
+	// the renders of the crashed sessions go with their journals, those recovered have been taken over by now
+	void discardOrphans(const juce::Array<juce::File>& orphans)
+	{
+		for(const juce::File& f : orphans) f.deleteFile();
+		TemporaryWaveSourceFile::sweepOrphanedFiles();
+	}
+	// one session can be recovered into the document, the user picks which if several crashed
+	void offerRecovery(const juce::Array<juce::File>& orphans, const juce::Array<juce::File>& recoverable)
+	{
+		juce::String message = (recoverable.size() == 1)
+			? "The previous session ended unexpectedly with unsaved edits. Do you want to recover them?"
+			: juce::String(recoverable.size()) + " sessions ended unexpectedly with unsaved edits. Which one do you want to recover? The edits of the others are discarded.";
+		recoveryWindow = std::make_unique<juce::AlertWindow>("Recover", message, juce::MessageBoxIconType::QuestionIcon, mainWindow.get());
+		if(1 < recoverable.size())
+		{
+			juce::StringArray items;
+			for(const juce::File& f : recoverable) items.add("ended " + f.getLastModificationTime().toString(true, true));
+			recoveryWindow->addComboBox("session", items);
+		}
+		recoveryWindow->addButton("Recover", 1, juce::KeyPress(juce::KeyPress::returnKey));
+		recoveryWindow->addButton("Discard", 0, juce::KeyPress(juce::KeyPress::escapeKey));
+		recoveryWindow->enterModalState(true, juce::ModalCallbackFunction::create([this, orphans, recoverable](int result)
+		{
+			recoveryWindow->exitModalState(result);
+			recoveryWindow->setVisible(false);
+			if(result == 1)
+			{
+				juce::ComboBox* cb = recoveryWindow->getComboBoxComponent("session");
+				juce::File file = recoverable[cb ? std::max(0, cb->getSelectedItemIndex()) : 0];
+				juce::Result r = document->recoverFromJournal(file);
+				// a journal that failed to recover is kept with its renders, to be offered again by the next launch
+				if(r.failed())
+				{
+					juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::WarningIcon, "Recover", "Failed to recover the session, it will be offered again next time: " + r.getErrorMessage());
+					return;
+				}
+			}
+			// the others are superseded, and a recovered session goes on in the journal of this one
+			discardOrphans(orphans);
+		}));
 	}
 	virtual void shutdown() override
 	{
+		recoveryWindow = nullptr;
 		mainWindow = nullptr;
 		player = nullptr;
 		document = nullptr;
@@ -7,6 +7,7 @@
 
 #include "MainPane.h"
 #include "WaveCutListView.h"
+#include "WaveLoudness.h"
 #include "CommandIDs.h"
 
 static const char SvgTransportRun[] =
@@ -21,7 +22,75 @@ static const char SvgTransportLoop[] =
 	R"(</g>)"
 	R"(</svg>)";
 
-class MainPane::Impl : public juce::Timer, public WaveCutListDocument::Listener, public juce::ChangeListener
+// horizontal bars per channel: RMS filled, peak as a falling marker, true peak above 0 dBTP flagged in red
+class LevelMeterBar : public juce::Component, public juce::Timer
+{
+public:
+	static constexpr float MinDecibels = -60;
+	static constexpr float PeakFallRate = 20; // dB per second
+	static constexpr int RefreshRate = 30;
+	WaveLevelMeter& levelMeter;
+	struct Display
+	{
+		float rms = MinDecibels;
+		float peak = MinDecibels;
+		float truePeak = MinDecibels;
+		bool over = false;
+	};
+	Display displays[WaveLevelMeter::MaxChannels];
+	int numChannels = 0;
+	LevelMeterBar(WaveLevelMeter& m) : levelMeter(m)
+	{
+		setOpaque(true);
+		startTimerHz(RefreshRate);
+	}
+	float d2x(float db, float w) const
+	{
+		return w * juce::jlimit(0.0f, 1.0f, (db - MinDecibels) / -MinDecibels);
+	}
+	virtual void timerCallback() override
+	{
+		numChannels = levelMeter.getNumChannels();
+		float fall = PeakFallRate / (float)RefreshRate;
+		for(int ich = 0; ich < numChannels; ++ich)
+		{
+			WaveLevelMeter::Levels lv = levelMeter.getLevels(ich);
+			Display& d = displays[ich];
+			d.rms = juce::Decibels::gainToDecibels(lv.rms, MinDecibels);
+			d.peak = std::max(d.peak - fall, juce::Decibels::gainToDecibels(lv.peak, MinDecibels));
+			d.truePeak = std::max(d.truePeak - fall, juce::Decibels::gainToDecibels(lv.truePeak, MinDecibels));
+			d.over = d.over || (1.0f < lv.truePeak);
+		}
+		repaint();
+	}
+	virtual void paint(juce::Graphics& g) override
+	{
+		g.fillAll(juce::Colour(0xff202020));
+		if(numChannels <= 0) return;
+		juce::Rectangle<float> rc = getLocalBounds().toFloat().reduced(1);
+		float lh = rc.getHeight() / (float)numChannels;
+		for(int ich = 0; ich < numChannels; ++ich)
+		{
+			const Display& d = displays[ich];
+			juce::Rectangle<float> rcl = rc.removeFromTop(lh).reduced(0, 1);
+			juce::Rectangle<float> rcover = rcl.removeFromRight(4);
+			g.setColour(juce::Colour(0xff20a685));
+			g.fillRect(rcl.withWidth(d2x(d.rms, rcl.getWidth())));
+			g.setColour(juce::Colours::white.withAlpha(0.8f));
+			g.fillRect(rcl.getX() + d2x(d.peak, rcl.getWidth()) - 1, rcl.getY(), 2.0f, rcl.getHeight());
+			g.setColour(d.over ? juce::Colours::red : juce::Colour(0xff404040));
+			g.fillRect(rcover);
+		}
+	}
+	virtual void mouseDown(const juce::MouseEvent&) override
+	{
+		// resets the over indicators
+		for(auto& d : displays) d.over = false;
+		repaint();
+	}
+};
+
+class MainPane::Impl : public WaveCutListDocument::Listener, public juce::ChangeListener
 {
 public:
 	std::unique_ptr<juce::Drawable> loadSvgAsDrawable(const char* svgsz, juce::Colour replacedcolour)
@@ -36,6 +105,7 @@ public:
 	WaveCutListDocument& document;
 	WaveCutListPlayer& player;
 	WaveCutListView view;
+	LevelMeterBar levelMeterBar;
 	juce::DrawableButton runButton;
 	juce::DrawableButton loopButton;
 	juce::Label posLabel;
@@ -43,13 +113,17 @@ public:
 	juce::Label selRangeLabel;
 	juce::Label selBeginEdit;
 	juce::Label selEndEdit;
-	enum { Margin = 4, Spacing = 4, BarHeight = 32, ButtonWidth = 32, EditWidth = 64, };
-	Impl(MainPane& o, juce::ApplicationCommandManager& acm, juce::AudioFormatManager& afm, WaveCutListDocument& doc, WaveCutListPlayer& play)
+	juce::Label loudnessLabel;
+	std::unique_ptr<WaveLoudnessAnalyzer> loudnessAnalyzer;
+	std::unique_ptr<juce::VBlankAttachment> vblankAttachment;
+	double lastPosEditUpdate = 0;
+	enum { Margin = 4, Spacing = 4, BarHeight = 32, ButtonWidth = 32, EditWidth = 64, MeterWidth = 160, LoudnessWidth = 240, };
+	Impl(MainPane& o, juce::ApplicationCommandManager& acm, WaveCutListDocument& doc, WaveCutListPlayer& play)
 		: owner(o)
 		, applicationCommandManager(acm)
 		, document(doc)
 		, player(play)
-		, view(afm)
+		, levelMeterBar(play.getLevelMeter())
 		, runButton("run", juce::DrawableButton::ButtonStyle::ImageOnButtonBackground)
 		, loopButton("loop", juce::DrawableButton::ButtonStyle::ImageOnButtonBackground)
 	{
@@ -61,6 +135,9 @@ public:
 		owner.addAndMakeVisible(view);
 		view.onClick = [this](double v) { onWvClick(v); };
 		view.onSelectionRangeChange = [this](const juce::Range<double>& v) { onWvSelRangeChange(v); };
+		view.onScrubBegin = [this](double v) { onWvScrubBegin(v); };
+		view.onScrub = [this](double v) { onWvScrub(v); };
+		view.onScrubEnd = [this]() { onWvScrubEnd(); };
 		// run
 		owner.addAndMakeVisible(runButton);
 		runButton.setImages(loadSvgAsDrawable(SvgTransportRun, juce::Colours::black).get(), nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
@@ -71,6 +148,12 @@ public:
 		loopButton.setImages(loadSvgAsDrawable(SvgTransportLoop, juce::Colours::black).get(), nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
 		loopButton.setColour(juce::TextButton::buttonOnColourId, juce::Colour(0xff0080ff));
 		loopButton.setCommandToTrigger(&applicationCommandManager, CommandIDs::TransportLoop, true);
+		// meter
+		owner.addAndMakeVisible(levelMeterBar);
+		// loudness
+		owner.addAndMakeVisible(loudnessLabel);
+		loudnessLabel.setTooltip("integrated loudness, loudness range and true peak of the whole document, after EBU R128");
+		loudnessAnalyzer = WaveLoudnessAnalyzer::createInstance();
 		// pos
 		owner.addAndMakeVisible(posLabel);
 		posLabel.setJustificationType(juce::Justification::centredRight);
@@ -99,9 +182,11 @@ public:
 		updateCursorPosition(false);
 		document.addListener(this);
 		player.addChangeListener(this);
+		loudnessAnalyzer->addChangeListener(this);
 	}
 	~Impl()
 	{
+		loudnessAnalyzer->removeChangeListener(this);
 		player.removeChangeListener(this);
 		document.removeListener(this);
 	}
@@ -117,6 +202,7 @@ public:
 		selBeginEdit.setText(juce::String::formatted("%.3f", sel.getStart()), juce::dontSendNotification);
 		selEndEdit.setText(juce::String::formatted("%.3f", sel.getEnd()), juce::dontSendNotification);
 		view.setSelectionRange(sel);
+		player.setLoopRange(view.getSelectionRange());
 		applicationCommandManager.commandStatusChanged();
 	}
 	void updateCursorPosition(bool ensurevisible)
@@ -127,6 +213,32 @@ public:
 		posEdit.setText(juce::String::formatted("%.3f", t), juce::dontSendNotification);
 		view.setCursorPosition(t, ensurevisible, player.isRunning());
 	}
+	void updateLoudness()
+	{
+		WaveLoudness::Result r;
+		if(!document.hasValidContent()) loudnessLabel.setText({}, juce::dontSendNotification);
+		else if(loudnessAnalyzer->hasFailed()) loudnessLabel.setText("loudness: failed to analyse", juce::dontSendNotification);
+		else if(!loudnessAnalyzer->getResult(r)) loudnessLabel.setText(juce::String::formatted("loudness: analysing %d%%", juce::roundToInt(loudnessAnalyzer->getProgress() * 100)), juce::dontSendNotification);
+		else
+		{
+			auto format = [](double v, const char* unit) { return std::isfinite(v) ? juce::String::formatted("%.1f %s", v, unit) : juce::String("-inf ") + unit; };
+			loudnessLabel.setText(format(r.integrated, "LUFS") + "  LRA " + format(r.range, "LU") + "  " + format(r.truePeak, "dBTP"), juce::dontSendNotification);
+		}
+	}
+	void onVBlank()
+	{
+		// extrapolates the playhead published by the audio callback to the current frame
+		double fs = document.getWaveFormat().sampleRate;
+		if(fs <= 0) return;
+		double now = juce::Time::getMillisecondCounterHiRes();
+		double t = player.getPlayhead().getPositionAt(now) / fs;
+		view.setCursorPosition(t, true, true);
+		if((lastPosEditUpdate + 100) <= now)
+		{
+			posEdit.setText(juce::String::formatted("%.3f", t), juce::dontSendNotification);
+			lastPosEditUpdate = now;
+		}
+	}
 	void onPosEditChange()
 	{
 		double t = posEdit.getText().getDoubleValue();
@@ -148,6 +260,23 @@ public:
 	{
 		updateSelection();
 	}
+	void onWvScrubBegin(double v)
+	{
+		player.beginScrub(v);
+		view.setCursorPosition(v, false, false);
+		posEdit.setText(juce::String::formatted("%.3f", v), juce::dontSendNotification);
+	}
+	void onWvScrub(double v)
+	{
+		player.scrub(v);
+		view.setCursorPosition(v, false, false);
+		posEdit.setText(juce::String::formatted("%.3f", v), juce::dontSendNotification);
+	}
+	void onWvScrubEnd()
+	{
+		player.endScrub();
+		updateCursorPosition(false);
+	}
 	// --------------------------------------------------------------------------------
 	// juce::Component
 	void resized()
@@ -158,6 +287,10 @@ public:
 		rcbar.removeFromLeft(Spacing);
 		loopButton.setBounds(rcbar.removeFromLeft(ButtonWidth));
 		rcbar.removeFromLeft(Spacing);
+		levelMeterBar.setBounds(rcbar.removeFromLeft(MeterWidth));
+		rcbar.removeFromLeft(Spacing);
+		loudnessLabel.setBounds(rcbar.removeFromLeft(LoudnessWidth));
+		rcbar.removeFromLeft(Spacing);
 		selEndEdit.setBounds(rcbar.removeFromRight(EditWidth));
 		rcbar.removeFromRight(Spacing);
 		selBeginEdit.setBounds(rcbar.removeFromRight(EditWidth));
@@ -172,28 +305,20 @@ public:
 		g.fillAll(owner.getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId));
 	}
 	// --------------------------------------------------------------------------------
-	// juce::Timer
-	virtual void timerCallback() override
-	{
-		updateCursorPosition(true);
-	}
-	// --------------------------------------------------------------------------------
 	// WaveCutListDocument::Listener
 	virtual void waveCutListDocumentDidInit(WaveCutListDocument*) override
 	{
-		view.setContent(document.getWaveFormat(), document.getWaveCutlist(), true);
+		view.setContent(document.getWaveFormat(), document.getWaveCutlist());
 		view.setSelectionRange({ 0, 0 });
 		view.setZoomFactor(1, 0, false);
+		loudnessAnalyzer->setWaveCutList(document.getWaveCutlist());
 		updateSelection();
 		updateCursorPosition(false);
 	}
-	virtual void waveCutListDocumentDidReplaceSourceFile(WaveCutListDocument*, WaveSourceFile::Ptr prevsrcfile, WaveSourceFile::Ptr newsrcfile) override
-	{
-		view.replaceSourceFile(prevsrcfile, newsrcfile);
-	}
 	virtual void waveCutListDocumentDidEdit(WaveCutListDocument*, int edittype, const Range64& r) override
 	{
-		view.setContent(document.getWaveFormat(), document.getWaveCutlist(), false);
+		view.setContent(document.getWaveFormat(), document.getWaveCutlist());
+		loudnessAnalyzer->setWaveCutList(document.getWaveCutlist());
 		double fs = document.getWaveFormat().sampleRate;
 		switch(edittype)
 		{
@@ -224,31 +349,38 @@ public:
 		if(source == &player)
 		{
 			bool running = player.isRunning();
-			if(running && !isTimerRunning()) startTimer(100);
-			if(!running && isTimerRunning()) stopTimer();
+			if(running && !vblankAttachment) vblankAttachment = std::make_unique<juce::VBlankAttachment>(&view, [this]() { onVBlank(); });
+			if(!running && vblankAttachment) vblankAttachment.reset();
 			if(!running) updateCursorPosition(true);
 			applicationCommandManager.commandStatusChanged();
 		}
+		else if(source == loudnessAnalyzer.get())
+		{
+			updateLoudness();
+		}
 	}
 	// --------------------------------------------------------------------------------
 	// APIs
+	// rounded, a snapped time is a whole sample and truncating it could land on the one before
 	int64_t getCursorPosition64() const
 	{
 		double fs = document.getWaveFormat().sampleRate;
 		double t = view.getCursorPosition();
-		return (int64_t)(t * fs);
+		return (int64_t)std::llround(t * fs);
 	}
 	Range64 getSelectionRange64() const
 	{
 		double fs = document.getWaveFormat().sampleRate;
 		juce::Range<double> sel = view.getSelectionRange();
-		return { (int64_t)(sel.getStart() * fs), (int64_t)(sel.getEnd() * fs) };
+		return { (int64_t)std::llround(sel.getStart() * fs), (int64_t)std::llround(sel.getEnd() * fs) };
 	}
 };
 
-MainPane::MainPane(juce::ApplicationCommandManager& acm, juce::AudioFormatManager& afm, WaveCutListDocument& doc, WaveCutListPlayer& play) { impl.reset(new Impl(*this, acm, afm, doc, play)); impl->construct(); }
+MainPane::MainPane(juce::ApplicationCommandManager& acm, WaveCutListDocument& doc, WaveCutListPlayer& play) { impl.reset(new Impl(*this, acm, doc, play)); impl->construct(); }
 MainPane::~MainPane() { impl.reset(); }
 void MainPane::resized() { impl->resized(); }
 void MainPane::paint(juce::Graphics& g) { impl->paint(g); }
 int64_t MainPane::getCursorPosition64() const { return impl->getCursorPosition64(); }
 Range64 MainPane::getSelectionRange64() const { return impl->getSelectionRange64(); }
+WaveSnap::Mode MainPane::getSnapMode() const { return impl->view.getSnapMode(); }
+void MainPane::setSnapMode(WaveSnap::Mode v) { impl->view.setSnapMode(v); }
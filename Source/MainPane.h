@@ -10,6 +10,7 @@
 #include <JuceHeader.h>
 #include "WaveCutListDocument.h"
 #include "WaveCutListPlayer.h"
+#include "WaveSnap.h"
 
 class MainPane : public juce::Component
 {
@@ -17,10 +18,12 @@ protected:
 	class Impl;
 	std::unique_ptr<Impl> impl;
 public:
-	MainPane(juce::ApplicationCommandManager& acm, juce::AudioFormatManager& afm, WaveCutListDocument& doc, WaveCutListPlayer& play);
+	MainPane(juce::ApplicationCommandManager& acm, WaveCutListDocument& doc, WaveCutListPlayer& play);
 	virtual ~MainPane();
 	virtual void resized() override;
 	virtual void paint(juce::Graphics& g) override;
 	int64_t getCursorPosition64() const;
 	Range64 getSelectionRange64() const;
+	WaveSnap::Mode getSnapMode() const;
+	void setSnapMode(WaveSnap::Mode v);
 };
@@ -0,0 +1,313 @@
+//
+//  NullAudioIODevice.cpp
+//  TestWaveEdit_App
+//
+
+#include "NullAudioIODevice.h"
+#if JUCE_LINUX || JUCE_BSD || JUCE_MAC
+#include <time.h>
+#endif
+
+namespace
+{
+	constexpr int NumOutputChannels = 2;
+	constexpr int DefaultBufferSize = 512;
+	const double SampleRates[] = { 44100, 48000, 88200, 96000, 176400, 192000 };
+	const int BufferSizes[] = { 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+
+	double getThreadCpuSeconds()
+	{
+#if JUCE_LINUX || JUCE_BSD || JUCE_MAC
+		timespec ts{};
+		if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+		return 0;
+	}
+
+	uint64_t hashSamples(uint64_t h, const float* p, int len)
+	{
+		for(int i = 0; i < len; ++i)
+		{
+			uint32_t bits;
+			std::memcpy(&bits, p + i, sizeof(bits));
+			for(int k = 0; k < 4; ++k)
+			{
+				h ^= (bits >> (k * 8)) & 0xff;
+				h *= 0x100000001b3ull;
+			}
+		}
+		return h;
+	}
+	constexpr uint64_t ChecksumSeed = 0xcbf29ce484222325ull;
+}
+
+class NullAudioIODeviceImpl : public NullAudioIODevice, public juce::Thread
+{
+public:
+	std::atomic<Cadence> cadence;
+	double sampleRate = 48000;
+	int bufferSize = DefaultBufferSize;
+	bool opened = false;
+	juce::BigInteger activeOutputs;
+	juce::AudioBuffer<float> outputBuffer;
+	juce::String lastError;
+	// guards the callback, the limit and the statistics; held across the callback as real devices do
+	juce::CriticalSection lock;
+	juce::AudioIODeviceCallback* callback = nullptr;
+	int64_t callbackLimit;
+	Statistics statistics;
+	juce::WaitableEvent limitEvent{ true };
+	NullAudioIODeviceImpl(Cadence c, int64_t limit) : NullAudioIODevice(DeviceName, TypeName), juce::Thread("NullAudioIODevice"), cadence(c), callbackLimit(limit)
+	{
+	}
+	virtual ~NullAudioIODeviceImpl()
+	{
+		close();
+	}
+	void waitUntil(double due)
+	{
+		// sleep most of the way, then yield so that the wakeup is as punctual as a device interrupt
+		for(;;)
+		{
+			double remaining = due - juce::Time::getMillisecondCounterHiRes();
+			if((remaining <= 0) || threadShouldExit()) return;
+			if(2 < remaining) wait(remaining - 1);
+			else juce::Thread::yield();
+		}
+	}
+	// returns false once there is nothing to call back
+	bool processNextCallback(double slot)
+	{
+		juce::ScopedLock sl(lock);
+		if(!callback || (callbackLimit == 0)) return false;
+		int cch = outputBuffer.getNumChannels();
+		outputBuffer.clear();
+		juce::AudioIODeviceCallbackContext context;
+		double cpu0 = getThreadCpuSeconds();
+		int64_t t0 = juce::Time::getHighResolutionTicks();
+		callback->audioDeviceIOCallbackWithContext(nullptr, 0, outputBuffer.getArrayOfWritePointers(), cch, bufferSize, context);
+		int64_t t1 = juce::Time::getHighResolutionTicks();
+		double cpu = getThreadCpuSeconds() - cpu0;
+		double elapsed = juce::Time::highResolutionTicksToSeconds(t1 - t0);
+		// the buffer is due when the one before it has played out
+		double deadline = slot + (double)bufferSize * 1000 / sampleRate;
+		++statistics.numCallbacks;
+		if(deadline < juce::Time::getMillisecondCounterHiRes()) ++statistics.deadlineMisses;
+		statistics.totalTime += elapsed;
+		statistics.maximumTime = std::max(statistics.maximumTime, elapsed);
+		statistics.totalCpuTime += cpu;
+		statistics.maximumCpuTime = std::max(statistics.maximumCpuTime, cpu);
+		for(int ich = 0; ich < cch; ++ich) statistics.checksum = hashSamples(statistics.checksum, outputBuffer.getReadPointer(ich), bufferSize);
+		if(0 < callbackLimit) --callbackLimit;
+		if(callbackLimit == 0) limitEvent.signal();
+		return true;
+	}
+	// --------------------------------------------------------------------------------
+	// juce::Thread
+	virtual void run() override
+	{
+		double period = (double)bufferSize * 1000 / sampleRate;
+		double due = juce::Time::getMillisecondCounterHiRes();
+		while(!threadShouldExit())
+		{
+			bool realtime = (cadence == CadenceRealTime);
+			if(realtime) waitUntil(due);
+			double now = juce::Time::getMillisecondCounterHiRes();
+			double slot = realtime ? due : now;
+			if(!processNextCallback(slot))
+			{
+				wait(-1);
+				due = juce::Time::getMillisecondCounterHiRes();
+				continue;
+			}
+			due += period;
+			// a device that fell behind drops the lost buffers rather than catching up with a burst
+			if(realtime && (due < juce::Time::getMillisecondCounterHiRes())) due = juce::Time::getMillisecondCounterHiRes();
+		}
+	}
+	// --------------------------------------------------------------------------------
+	// juce::AudioIODevice
+	virtual juce::StringArray getOutputChannelNames() override
+	{
+		juce::StringArray names;
+		for(int ich = 0; ich < NumOutputChannels; ++ich) names.add("Output " + juce::String(ich + 1));
+		return names;
+	}
+	virtual juce::StringArray getInputChannelNames() override
+	{
+		return {};
+	}
+	virtual juce::Array<double> getAvailableSampleRates() override
+	{
+		return juce::Array<double>(SampleRates, (int)std::size(SampleRates));
+	}
+	virtual juce::Array<int> getAvailableBufferSizes() override
+	{
+		return juce::Array<int>(BufferSizes, (int)std::size(BufferSizes));
+	}
+	virtual int getDefaultBufferSize() override
+	{
+		return DefaultBufferSize;
+	}
+	virtual juce::String open(const juce::BigInteger&, const juce::BigInteger& outputs, double fs, int lbuf) override
+	{
+		close();
+		sampleRate = (0 < fs) ? fs : 48000;
+		bufferSize = juce::jlimit(BufferSizes[0], BufferSizes[std::size(BufferSizes) - 1], (0 < lbuf) ? lbuf : DefaultBufferSize);
+		activeOutputs = outputs;
+		activeOutputs.setRange(NumOutputChannels, std::max(0, activeOutputs.getHighestBit() + 1 - NumOutputChannels), false);
+		outputBuffer.setSize(activeOutputs.countNumberOfSetBits(), bufferSize);
+		opened = true;
+		lastError.clear();
+		startThread(juce::Thread::Priority::highest);
+		return {};
+	}
+	virtual void close() override
+	{
+		if(!opened) return;
+		stop();
+		stopThread(4000);
+		opened = false;
+	}
+	virtual bool isOpen() override
+	{
+		return opened;
+	}
+	virtual void start(juce::AudioIODeviceCallback* cb) override
+	{
+		if(!opened || !cb) return;
+		stop();
+		cb->audioDeviceAboutToStart(this);
+		{
+			juce::ScopedLock sl(lock);
+			callback = cb;
+			statistics = {};
+			statistics.checksum = ChecksumSeed;
+			if(callbackLimit != 0) limitEvent.reset();
+		}
+		notify();
+	}
+	virtual void stop() override
+	{
+		juce::AudioIODeviceCallback* cb;
+		{
+			juce::ScopedLock sl(lock);
+			cb = callback;
+			callback = nullptr;
+		}
+		if(cb) cb->audioDeviceStopped();
+	}
+	virtual bool isPlaying() override
+	{
+		juce::ScopedLock sl(lock);
+		return callback != nullptr;
+	}
+	virtual juce::String getLastError() override
+	{
+		return lastError;
+	}
+	virtual int getCurrentBufferSizeSamples() override
+	{
+		return bufferSize;
+	}
+	virtual double getCurrentSampleRate() override
+	{
+		return sampleRate;
+	}
+	virtual int getCurrentBitDepth() override
+	{
+		return 32;
+	}
+	virtual juce::BigInteger getActiveOutputChannels() const override
+	{
+		return activeOutputs;
+	}
+	virtual juce::BigInteger getActiveInputChannels() const override
+	{
+		return {};
+	}
+	virtual int getOutputLatencyInSamples() override
+	{
+		return bufferSize;
+	}
+	virtual int getInputLatencyInSamples() override
+	{
+		return 0;
+	}
+	// --------------------------------------------------------------------------------
+	// NullAudioIODevice
+	virtual Cadence getCadence() const override
+	{
+		return cadence;
+	}
+	virtual void setCadence(Cadence v) override
+	{
+		cadence = v;
+		notify();
+	}
+	virtual void setCallbackLimit(int64_t n) override
+	{
+		{
+			juce::ScopedLock sl(lock);
+			callbackLimit = n;
+			if(n == 0) limitEvent.signal();
+			else limitEvent.reset();
+		}
+		notify();
+	}
+	virtual bool waitForCallbackLimit(int timeoutms) override
+	{
+		return limitEvent.wait(timeoutms);
+	}
+	virtual Statistics getStatistics() const override
+	{
+		juce::ScopedLock sl(lock);
+		return statistics;
+	}
+	virtual void resetStatistics() override
+	{
+		juce::ScopedLock sl(lock);
+		statistics = {};
+		statistics.checksum = ChecksumSeed;
+	}
+};
+
+class NullAudioIODeviceType : public juce::AudioIODeviceType
+{
+public:
+	NullAudioIODevice::Cadence cadence;
+	int64_t callbackLimit;
+	NullAudioIODeviceType(NullAudioIODevice::Cadence c, int64_t limit) : juce::AudioIODeviceType(NullAudioIODevice::TypeName), cadence(c), callbackLimit(limit)
+	{
+	}
+	virtual void scanForDevices() override
+	{
+	}
+	virtual juce::StringArray getDeviceNames(bool) const override
+	{
+		return juce::StringArray(NullAudioIODevice::DeviceName);
+	}
+	virtual int getDefaultDeviceIndex(bool) const override
+	{
+		return 0;
+	}
+	virtual int getIndexOfDevice(juce::AudioIODevice* dev, bool) const override
+	{
+		return dynamic_cast<NullAudioIODevice*>(dev) ? 0 : -1;
+	}
+	virtual bool hasSeparateInputsAndOutputs() const override
+	{
+		return false;
+	}
+	virtual juce::AudioIODevice* createDevice(const juce::String& outname, const juce::String& inname) override
+	{
+		juce::String name = outname.isNotEmpty() ? outname : inname;
+		if(name.isNotEmpty() && (name != NullAudioIODevice::DeviceName)) return nullptr;
+		return new NullAudioIODeviceImpl(cadence, callbackLimit);
+	}
+};
+
+std::unique_ptr<juce::AudioIODeviceType> NullAudioIODevice::createType(Cadence cadence, int64_t callbackLimit)
+{
+	return std::make_unique<NullAudioIODeviceType>(cadence, callbackLimit);
+}
@@ -0,0 +1,46 @@
+//
+//  NullAudioIODevice.h
+//  TestWaveEdit_App
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// an output device without hardware: a thread of its own calls back either on the cadence of a real device or as fast as it can,
+// and records what every callback costs, so that the playback path can be measured on machines without an audio interface
+class NullAudioIODevice : public juce::AudioIODevice
+{
+protected:
+	NullAudioIODevice(const juce::String& name, const juce::String& type) : juce::AudioIODevice(name, type) {}
+public:
+	static constexpr const char* TypeName = "Null";
+	static constexpr const char* DeviceName = "Null Output";
+	enum Cadence
+	{
+		CadenceRealTime,	// one callback per buffer period
+		CadenceFreeRunning,	// the next callback follows as soon as the previous one returns
+	};
+	struct Statistics
+	{
+		int64_t numCallbacks = 0;
+		int64_t deadlineMisses = 0;	// callbacks that returned after their buffer was due
+		double totalTime = 0;		// seconds of wall time inside the callback
+		double maximumTime = 0;
+		double totalCpuTime = 0;	// seconds of thread CPU time inside the callback, zero where the platform has no thread clock
+		double maximumCpuTime = 0;
+		uint64_t checksum = 0;		// FNV-1a over the bits of every output sample, in callback order
+		double getAverageTime() const { return (0 < numCallbacks) ? (totalTime / (double)numCallbacks) : 0; }
+		double getAverageCpuTime() const { return (0 < numCallbacks) ? (totalCpuTime / (double)numCallbacks) : 0; }
+	};
+	virtual Cadence getCadence() const = 0;
+	virtual void setCadence(Cadence v) = 0;
+	// the device stays open but stops calling back after n more callbacks; negative for no limit
+	virtual void setCallbackLimit(int64_t n) = 0;
+	virtual bool waitForCallbackLimit(int timeoutms) = 0;
+	// the statistics restart whenever the device starts
+	virtual Statistics getStatistics() const = 0;
+	virtual void resetStatistics() = 0;
+	// adding it to an AudioDeviceManager before its first initialise() leaves it the only device type
+	static std::unique_ptr<juce::AudioIODeviceType> createType(Cadence cadence, int64_t callbackLimit = -1);
+};
@@ -6,28 +6,309 @@
 //
 
 #include "WaveCutList.h"
+#include "WaveTrace.h"
 
 // ================================================================================
 // WaveSourceFile
 
+bool WaveSourceFile::copyTo(juce::AudioFormatWriter& writer, int64_t samplepos, int64_t len)
+{
+	// a copy may span the whole file, so it must not hold up the reads through read() meanwhile
+	Decoder decoder;
+	juce::AudioBuffer<float> buf(format.numChannels, 16384);
+	int64_t pos = 0; while(pos < len)
+	{
+		int lseg = (int)std::min(len - pos, (int64_t)buf.getNumSamples());
+		if(!readWith(decoder, buf.getArrayOfWritePointers(), format.numChannels, samplepos + pos, lseg)) return false;
+		if(!writer.writeFromAudioSampleBuffer(buf, 0, lseg)) return false;
+		pos += lseg;
+	}
+	return true;
+}
+
+// ================================================================================
+// temporary storage
+
+// the files of this process in the temporary directory, to tell the live ones from the orphans and to add up the usage
+class TemporaryStorageRegistry
+{
+public:
+	juce::CriticalSection lock;
+	std::map<juce::String, int64_t> files;
+	void add(const juce::File& path, int64_t size)
+	{
+		juce::ScopedLock sl(lock);
+		files[path.getFullPathName()] = size;
+	}
+	void remove(const juce::File& path)
+	{
+		juce::ScopedLock sl(lock);
+		files.erase(path.getFullPathName());
+	}
+	bool contains(const juce::File& path)
+	{
+		juce::ScopedLock sl(lock);
+		return files.find(path.getFullPathName()) != files.end();
+	}
+};
+
+// the lock is held while the process runs, the system releases the lock of a session that died
+class TemporaryStorageSession
+{
+public:
+	juce::String id = juce::String::toHexString(juce::Random::getSystemRandom().nextInt()).paddedLeft('0', 8);
+	juce::InterProcessLock lock{ getLockName(id) };
+	TemporaryStorageSession()
+	{
+		lock.enter(0);
+	}
+	static juce::String getLockName(const juce::String& id)
+	{
+		return "TestWaveEditSession-" + id;
+	}
+	// don't ask for the own session, the locks of a process do not exclude each other
+	static bool isRunning(const juce::String& id)
+	{
+		juce::InterProcessLock l(getLockName(id));
+		if(!l.enter(0)) return true;
+		l.exit();
+		return false;
+	}
+	static juce::String getSessionId(const juce::File& path)
+	{
+		juce::String name = path.getFileNameWithoutExtension();
+		return name.containsChar('-') ? name.upToFirstOccurrenceOf("-", false, false) : juce::String();
+	}
+	static TemporaryStorageSession& getInstance()
+	{
+		static TemporaryStorageSession session;
+		return session;
+	}
+};
+
+// ================================================================================
+// ArchivedWaveSourceFile
+
 class ArchivedWaveSourceFileImpl : public ArchivedWaveSourceFile
 {
 public:
+	// a planar 32-bit float copy of a compressed source, decoded once in the background so that any seek becomes a file offset
+	class DecodeCache : public juce::Thread
+	{
+	public:
+		static constexpr int BlockLength = 65536; // each block holds BlockLength samples of channel 0, then of channel 1, and so on
+		juce::File sourcePath;
+		juce::File cachePath;
+		int numChannels;
+		int64_t length;
+		std::atomic<int64_t> decodedLength{ 0 };
+		int64_t storageSize;
+		std::unique_ptr<juce::InputStream> inputStream;
+		juce::CriticalSection inputLock;
+		juce::SharedResourcePointer<TemporaryStorageRegistry> storageRegistry;
+		DecodeCache(const juce::File& srcpath, int cch, int64_t len) : juce::Thread("DecodeCache"), sourcePath(srcpath), numChannels(cch), length(len)
+		{
+			cachePath = TemporaryWaveSourceFile::getNextUniquePath(".pcm");
+			// counted at the full size from the start, it grows to that in the background
+			storageSize = (length + BlockLength - 1) / BlockLength * BlockLength * numChannels * (int64_t)sizeof(float);
+			storageRegistry->add(cachePath, storageSize);
+			startThread(juce::Thread::Priority::background);
+		}
+		virtual ~DecodeCache()
+		{
+			stopThread(4000);
+			inputStream = nullptr;
+			cachePath.deleteFile();
+			storageRegistry->remove(cachePath);
+		}
+		bool isComplete() const
+		{
+			return length <= decodedLength;
+		}
+		int64_t getFileOffset(int64_t samplepos, int ich) const
+		{
+			int64_t iblock = samplepos / BlockLength;
+			int64_t ioffset = samplepos % BlockLength;
+			return ((iblock * numChannels + ich) * BlockLength + ioffset) * (int64_t)sizeof(float);
+		}
+		bool isDecoded(int cch, int64_t samplepos, int len) const
+		{
+			return (cch == numChannels) && ((samplepos + len) <= decodedLength);
+		}
+		std::unique_ptr<juce::InputStream> createInputStream() const
+		{
+			std::unique_ptr<juce::FileInputStream> str = std::make_unique<juce::FileInputStream>(cachePath);
+			if(str->failedToOpen()) return nullptr;
+			return str;
+		}
+		// returns false if the range has not been decoded yet
+		bool read(float* const* pp, int cch, int64_t samplepos, int len)
+		{
+			if(!isDecoded(cch, samplepos, len)) return false;
+			juce::ScopedLock sl(inputLock);
+			if(!inputStream) inputStream = createInputStream();
+			if(!inputStream) return false;
+			return readFrom(*inputStream, pp, cch, samplepos, len);
+		}
+		// the same through a stream of the caller's
+		bool read(std::unique_ptr<juce::InputStream>& str, float* const* pp, int cch, int64_t samplepos, int len) const
+		{
+			if(!isDecoded(cch, samplepos, len)) return false;
+			if(!str) str = createInputStream();
+			if(!str) return false;
+			return readFrom(*str, pp, cch, samplepos, len);
+		}
+		bool readFrom(juce::InputStream& str, float* const* pp, int cch, int64_t samplepos, int len) const
+		{
+			int pos = 0; while(pos < len)
+			{
+				int64_t spos = samplepos + pos;
+				int lseg = (int)std::min((int64_t)(len - pos), BlockLength - (spos % BlockLength));
+				for(int ich = 0; ich < cch; ++ich)
+				{
+					int cb = lseg * (int)sizeof(float);
+					if(!str.setPosition(getFileOffset(spos, ich))) return false;
+					if(str.read(pp[ich] + pos, cb) != cb) return false;
+				}
+				pos += lseg;
+			}
+			return true;
+		}
+		virtual void run() override
+		{
+			// decode with a reader of its own, so the foreground reads never fight over the decoder position
+			juce::AudioFormatManager afm;
+			afm.registerBasicFormats();
+			std::unique_ptr<juce::AudioFormatReader> reader(afm.createReaderFor(sourcePath));
+			if(!reader || ((int)reader->numChannels != numChannels)) return;
+			std::unique_ptr<juce::FileOutputStream> ostr = std::make_unique<juce::FileOutputStream>(cachePath);
+			if(ostr->failedToOpen()) return;
+			ostr->setPosition(0);
+			ostr->truncate();
+			juce::AudioBuffer<float> buf(numChannels, BlockLength);
+			int64_t pos = 0; while(!threadShouldExit() && (pos < length))
+			{
+				int lseg = (int)std::min(length - pos, (int64_t)BlockLength);
+				if(!reader->read(buf.getArrayOfWritePointers(), numChannels, pos, lseg)) return;
+				if(lseg < BlockLength) buf.clear(lseg, BlockLength - lseg);
+				for(int ich = 0; ich < numChannels; ++ich)
+				{
+					if(!ostr->write(buf.getReadPointer(ich), BlockLength * sizeof(float))) return;
+				}
+				ostr->flush();
+				pos += lseg;
+				decodedLength = pos;
+			}
+			DBG("[DecodeCache] decoded " << sourcePath.getFileName().quoted() << " length=" << (juce::int64)decodedLength);
+		}
+	};
+	// detachFromFile() copies outside the lock, so an instance it has picked out waits in its destructor until its copy is done
+	struct Registry
+	{
+		std::mutex lock;
+		std::condition_variable detached;
+		juce::Array<ArchivedWaveSourceFileImpl*> instances;
+	};
+	static bool isRandomAccessFormat(const juce::String& formatname)
+	{
+		return (formatname == juce::WavAudioFormat().getFormatName()) || (formatname == juce::AiffAudioFormat().getFormatName());
+	}
+	juce::SharedResourcePointer<Registry> registry;
+	juce::CriticalSection readLock; // the audio thread reads concurrently with the others, which read through decoders of their own
 	std::unique_ptr<juce::AudioFormatReader> formatReader;
+	std::shared_ptr<DecodeCache> decodeCache; // shared with the readWith() in progress, which may outlive a detach
+	WaveSourceFile::Ptr detachedCopy;
+	bool detaching = false; // guarded by the registry lock
+	static std::unique_ptr<juce::AudioFormatReader> openFormatReader(const juce::File& path, int cch)
+	{
+		juce::AudioFormatManager afm;
+		afm.registerBasicFormats();
+		std::unique_ptr<juce::AudioFormatReader> reader(afm.createReaderFor(path));
+		if(reader && ((int)reader->numChannels != cch)) reader = nullptr;
+		return reader;
+	}
 	ArchivedWaveSourceFileImpl(std::unique_ptr<juce::AudioFormatReader> reader, const juce::File& path)
 	{
+		{
+			std::lock_guard<std::mutex> lg(registry->lock);
+			registry->instances.add(this);
+		}
 		formatReader.reset(reader.release());
 		if(!formatReader) return;
 		backingFile = path;
 		length = formatReader->lengthInSamples;
 		format = { formatReader->sampleRate, (int)formatReader->numChannels };
+		bitsPerSample = (int)formatReader->bitsPerSample;
+		usesFloatingPointData = formatReader->usesFloatingPointData;
+		if(!isRandomAccessFormat(formatReader->getFormatName())) decodeCache = std::make_shared<DecodeCache>(path, format.numChannels, length);
 	}
+	virtual ~ArchivedWaveSourceFileImpl()
+	{
+		std::unique_lock<std::mutex> ul(registry->lock);
+		registry->detached.wait(ul, [this]() { return !detaching; });
+		registry->instances.removeFirstMatchingValue(this);
+	}
+	juce::File getBackingFile()
+	{
+		juce::ScopedLock sl(readLock);
+		return backingFile;
+	}
+	bool detach();
 	virtual bool read(float* const* pp, int cch, int64_t samplepos, int len) override
 	{
+		juce::ScopedLock sl(readLock);
+		if(detachedCopy) return detachedCopy->read(pp, cch, samplepos, len);
 		if(!formatReader) return false;
 		if(cch != format.numChannels) return false;
+		if(decodeCache && decodeCache->read(pp, cch, samplepos, len)) return true;
 		return formatReader->read(pp, cch, samplepos, len);
 	}
+	virtual bool readWith(Decoder& decoder, float* const* pp, int cch, int64_t samplepos, int len) override
+	{
+		WaveSourceFile::Ptr copy;
+		std::shared_ptr<DecodeCache> cache;
+		juce::File path;
+		{
+			juce::ScopedLock sl(readLock);
+			if(!detachedCopy && !formatReader) return false;
+			copy = detachedCopy;
+			cache = decodeCache;
+			path = backingFile;
+		}
+		if(copy) return copy->readWith(decoder, pp, cch, samplepos, len);
+		if(cch != format.numChannels) return false;
+		if(decoder.file != path) decoder = { path };
+		if(cache && cache->read(decoder.cacheStream, pp, cch, samplepos, len)) return true;
+		if(!decoder.reader) decoder.reader = openFormatReader(path, cch);
+		if(!decoder.reader) return read(pp, cch, samplepos, len);
+		return decoder.reader->read(pp, cch, samplepos, len);
+	}
+	// through a reader of its own, the lock is only taken to see which file to read
+	virtual bool copyTo(juce::AudioFormatWriter& writer, int64_t samplepos, int64_t len) override
+	{
+		WaveSourceFile::Ptr copy;
+		bool cached = false;
+		juce::File path;
+		{
+			juce::ScopedLock sl(readLock);
+			if(!detachedCopy && !formatReader) return false;
+			copy = detachedCopy;
+			cached = decodeCache && decodeCache->isComplete();
+			path = backingFile;
+		}
+		if(copy) return copy->copyTo(writer, samplepos, len);
+		// the cache holds floats, so it only substitutes for sources that decode to floats anyway
+		if(cached && usesFloatingPointData) return WaveSourceFile::copyTo(writer, samplepos, len);
+		std::unique_ptr<juce::AudioFormatReader> reader = openFormatReader(path, format.numChannels);
+		if(!reader) return false;
+		return writer.writeFromAudioReader(*reader, samplepos, len);
+	}
+	virtual int64_t getTemporaryStorageSize() override
+	{
+		juce::ScopedLock sl(readLock);
+		if(detachedCopy) return detachedCopy->getTemporaryStorageSize();
+		return decodeCache ? decodeCache->storageSize : 0;
+	}
 };
 
 WaveSourceFile::Ptr ArchivedWaveSourceFile::createInstance(juce::AudioFormatManager& afm, const juce::File& path)
@@ -46,6 +327,15 @@ WaveSourceFile::Ptr ArchivedWaveSourceFile::createInstance(std::unique_ptr<juce:
 	return ptr;
 }
 
+// ================================================================================
+// TemporaryWaveSourceFile
+
+static std::unique_ptr<juce::AudioFormat> createStorageAudioFormat(const juce::File& path)
+{
+	if(path.hasFileExtension(".flac")) return std::make_unique<juce::FlacAudioFormat>();
+	return std::make_unique<juce::WavAudioFormat>();
+}
+
 class TemporaryWaveSourceFileImpl : public TemporaryWaveSourceFile
 {
 public:
@@ -53,93 +343,292 @@ public:
 	{
 		std::unique_ptr<juce::FileInputStream> str = std::make_unique<juce::FileInputStream>(path);
 		if(str->failedToOpen()) return nullptr;
-		juce::WavAudioFormat wavfmt;
-		std::unique_ptr<juce::AudioFormatReader> reader(wavfmt.createReaderFor(str.get(), false));
+		std::unique_ptr<juce::AudioFormat> af = createStorageAudioFormat(path);
+		std::unique_ptr<juce::AudioFormatReader> reader(af->createReaderFor(str.get(), false));
 		if(!reader) return nullptr;
 		str.release();
 		return reader;
 	}
+	// a render another session left behind, found by the recovery
+	static bool isOrphanedFile(const juce::File& path)
+	{
+		return path.isAChildOf(getTempDirectory()) && (TemporaryStorageSession::getSessionId(path) != TemporaryStorageSession::getInstance().id);
+	}
+	// is renamed into this session before the sweeps see it
+	static juce::File adoptFile(const juce::File& path)
+	{
+		juce::File adopted = getNextUniquePath(path.getFileExtension());
+		if(path.moveFileTo(adopted)) return adopted;
+		adopted.deleteFile();
+		return path;
+	}
+	juce::CriticalSection readLock; // also guards the backing file, which adopt() moves
 	std::unique_ptr<juce::AudioFormatReader> formatReader;
-	TemporaryWaveSourceFileImpl(WaveSourceFile::Ptr src)
+	bool ownsBackingFile = true;
+	bool orphaned = false; // opened in place and not owned until adopt(), so that a failed recovery leaves it to its journal
+	int64_t storageSize = 0;
+	juce::SharedResourcePointer<TemporaryStorageRegistry> storageRegistry;
+	TemporaryWaveSourceFileImpl(WaveSourceFile& src)
 	{
-		jassert(src != nullptr);
-		if(!src) return;
-		juce::File path = getNextUniquePath();
-		WaveFormat fmt = src->format;
+		int bps = getStorageBitsPerSample(src);
+		juce::File path = getNextUniquePath(getStorageFileExtension(bps));
+		bool written = false;
 		{
-			std::unique_ptr<juce::AudioFormatWriter> writer = createCompatibleAudioFromatWriter(path, src->format);
-			if(!writer) return;
-			juce::AudioBuffer<float> buf(src->format.numChannels, 16384);
-			int64_t len = src->length, pos = 0; while(pos < len)
-			{
-				int lseg = (int)std::min(len - pos, (int64_t)buf.getNumSamples());
-				if(!src->read(buf.getArrayOfWritePointers(), src->format.numChannels, pos, lseg)) return;
-				if(!writer->writeFromAudioSampleBuffer(buf, 0, lseg)) return;
-				pos += lseg;
-			}
+			std::unique_ptr<juce::AudioFormat> af = createStorageAudioFormat(path);
+			std::unique_ptr<juce::AudioFormatWriter> writer = createCompatibleAudioFromatWriter(path, src.format, bps);
+			written = writer && WaveCutListWriter::checkCapacity(*af, path, src.format, bps, src.length).wasOk() && src.copyTo(*writer, 0, src.length);
+		}
+		if(written) formatReader = createAudioFormatReader(path);
+		if(!formatReader)
+		{
+			path.deleteFile();
+			return;
 		}
-		formatReader = createAudioFormatReader(path);
-		if(!formatReader) return;
 		backingFile = path;
 		length = formatReader->lengthInSamples;
 		format = { formatReader->sampleRate, (int)formatReader->numChannels };
+		bitsPerSample = (int)formatReader->bitsPerSample;
+		usesFloatingPointData = formatReader->usesFloatingPointData;
+		storageSize = path.getSize();
+		storageRegistry->add(path, storageSize);
 	}
-	TemporaryWaveSourceFileImpl(const juce::File& wavpath)
+	TemporaryWaveSourceFileImpl(const juce::File& path, bool owns) : ownsBackingFile(owns && !isOrphanedFile(path)), orphaned(owns && isOrphanedFile(path))
 	{
-		formatReader = createAudioFormatReader(wavpath);
+		formatReader = createAudioFormatReader(path);
 		if(!formatReader) return;
-		backingFile = wavpath;
+		backingFile = path;
 		length = formatReader->lengthInSamples;
 		format = { formatReader->sampleRate, (int)formatReader->numChannels };
+		bitsPerSample = (int)formatReader->bitsPerSample;
+		usesFloatingPointData = formatReader->usesFloatingPointData;
+		if(ownsBackingFile)
+		{
+			storageSize = path.getSize();
+			storageRegistry->add(path, storageSize);
+		}
 	}
 	virtual ~TemporaryWaveSourceFileImpl()
 	{
 		formatReader = nullptr;
+		if(!ownsBackingFile) return;
 		if(backingFile.exists()) backingFile.deleteFile();
+		storageRegistry->remove(backingFile);
 	}
 	virtual bool read(float* const* pp, int cch, int64_t samplepos, int len) override
 	{
+		juce::ScopedLock sl(readLock);
 		if(!formatReader) return false;
 		if(cch != format.numChannels) return false;
+		// integer storage is widened by juce::FloatVectorOperations::convertFixedToFloat() inside the reader
 		return formatReader->read(pp, cch, samplepos, len);
 	}
+	juce::File getBackingFile()
+	{
+		juce::ScopedLock sl(readLock);
+		return formatReader ? backingFile : juce::File();
+	}
+	virtual bool readWith(Decoder& decoder, float* const* pp, int cch, int64_t samplepos, int len) override
+	{
+		juce::File path = getBackingFile();
+		if(path == juce::File()) return false;
+		if(cch != format.numChannels) return false;
+		if(decoder.file != path) decoder = { path };
+		if(!decoder.reader) decoder.reader = createAudioFormatReader(path);
+		if(!decoder.reader) return read(pp, cch, samplepos, len);
+		return decoder.reader->read(pp, cch, samplepos, len);
+	}
+	virtual bool copyTo(juce::AudioFormatWriter& writer, int64_t samplepos, int64_t len) override
+	{
+		juce::File path = getBackingFile();
+		if(path == juce::File()) return false;
+		std::unique_ptr<juce::AudioFormatReader> reader = createAudioFormatReader(path);
+		if(!reader) return false;
+		return writer.writeFromAudioReader(*reader, samplepos, len);
+	}
+	virtual void adopt() override
+	{
+		juce::ScopedLock sl(readLock);
+		if(!orphaned) return;
+		orphaned = false;
+		// the reader is closed first, an open file cannot be renamed everywhere
+		formatReader = nullptr;
+		backingFile = adoptFile(backingFile);
+		formatReader = createAudioFormatReader(backingFile);
+		ownsBackingFile = true;
+		storageSize = backingFile.getSize();
+		storageRegistry->add(backingFile, storageSize);
+	}
+	virtual int64_t getTemporaryStorageSize() override
+	{
+		return storageSize;
+	}
 };
 
+// the copy is made without the read lock, which is only taken to swap it in, so the playback goes on reading meanwhile
+bool ArchivedWaveSourceFileImpl::detach()
+{
+	{
+		juce::ScopedLock sl(readLock);
+		if(detachedCopy) return true;
+	}
+	juce::ReferenceCountedObjectPtr<TemporaryWaveSourceFileImpl> tmp = new TemporaryWaveSourceFileImpl(*this);
+	if(!tmp->formatReader) return false;
+	// the reader and the cache are released outside the lock, stopping the decoder may take a while
+	std::unique_ptr<juce::AudioFormatReader> oldreader;
+	std::shared_ptr<DecodeCache> oldcache;
+	{
+		juce::ScopedLock sl(readLock);
+		detachedCopy = tmp;
+		backingFile = tmp->backingFile;
+		oldreader = std::move(formatReader);
+		oldcache = std::move(decodeCache);
+	}
+	DBG("[ArchivedWaveSourceFile] detached to " << backingFile.getFileName().quoted());
+	return true;
+}
+
+juce::Result ArchivedWaveSourceFile::detachFromFile(const juce::File& path)
+{
+	juce::SharedResourcePointer<ArchivedWaveSourceFileImpl::Registry> registry;
+	// picked out under the registry lock and copied outside it, so that sources can come and go meanwhile
+	std::vector<ArchivedWaveSourceFileImpl*> targets;
+	{
+		std::lock_guard<std::mutex> lg(registry->lock);
+		for(ArchivedWaveSourceFileImpl* p : registry->instances)
+		{
+			if(p->getBackingFile() != path) continue;
+			p->detaching = true;
+			targets.push_back(p);
+		}
+	}
+	bool ok = true;
+	for(ArchivedWaveSourceFileImpl* p : targets) ok = p->detach() && ok;
+	{
+		std::lock_guard<std::mutex> lg(registry->lock);
+		for(ArchivedWaveSourceFileImpl* p : targets) p->detaching = false;
+	}
+	registry->detached.notify_all();
+	return ok ? juce::Result::ok() : juce::Result::fail("failed to release " + path.getFileName().quoted());
+}
+
+static std::atomic<TemporaryWaveSourceFile::StorageFormat> temporaryStorageFormat{ TemporaryWaveSourceFile::StorageNative };
+static std::atomic<int64_t> temporaryStorageQuota{ (int64_t)4 << 30 };
+
+TemporaryWaveSourceFile::StorageFormat TemporaryWaveSourceFile::getStorageFormat()
+{
+	return temporaryStorageFormat;
+}
+
+void TemporaryWaveSourceFile::setStorageFormat(StorageFormat v)
+{
+	temporaryStorageFormat = v;
+}
+
+int TemporaryWaveSourceFile::getStorageBitsPerSample(const WaveSourceFile& src)
+{
+	// the samples of integer sources up to 24 bits survive the float round trip, so they can be stored at their native depth
+	StorageFormat sf = getStorageFormat();
+	if((sf == StorageFloat) || src.usesFloatingPointData || (24 < src.bitsPerSample)) return 32;
+	if(sf == StorageCompressed) return (src.bitsPerSample <= 16) ? 16 : 24; // the depths supported by the FLAC encoder
+	return (src.bitsPerSample <= 8) ? 8 : (src.bitsPerSample <= 16) ? 16 : 24;
+}
+
+juce::String TemporaryWaveSourceFile::getStorageFileExtension(int bps)
+{
+	return ((getStorageFormat() == StorageCompressed) && (bps < 32)) ? ".flac" : ".wav";
+}
+
+TemporaryWaveSourceFile::StorageUsage TemporaryWaveSourceFile::getStorageUsage()
+{
+	juce::SharedResourcePointer<TemporaryStorageRegistry> registry;
+	juce::ScopedLock sl(registry->lock);
+	StorageUsage usage;
+	for(const auto& [path, size] : registry->files)
+	{
+		++usage.numFiles;
+		usage.numBytes += size;
+	}
+	return usage;
+}
+
+int64_t TemporaryWaveSourceFile::getStorageQuota()
+{
+	return temporaryStorageQuota;
+}
+
+void TemporaryWaveSourceFile::setStorageQuota(int64_t v)
+{
+	temporaryStorageQuota = std::max((int64_t)0, v);
+}
+
+TemporaryWaveSourceFile::StorageUsage TemporaryWaveSourceFile::sweepOrphanedFiles()
+{
+	WAVE_TRACE_SCOPE("io", "TemporaryWaveSourceFile::sweepOrphanedFiles");
+	juce::SharedResourcePointer<TemporaryStorageRegistry> registry;
+	const juce::String ownid = TemporaryStorageSession::getInstance().id;
+	std::map<juce::String, bool> running; // by session id, the files of a session share the answer
+	StorageUsage swept;
+	// the files only, the journals in the subdirectory have locks of their own
+	for(const juce::File& f : getTempDirectory().findChildFiles(juce::File::findFiles, false))
+	{
+		if(registry->contains(f)) continue;
+		// the files without an id are from before the sessions, and nobody owns them
+		juce::String id = TemporaryStorageSession::getSessionId(f);
+		if(id == ownid) continue;
+		if(id.isNotEmpty())
+		{
+			auto it = running.find(id);
+			if(it == running.end()) it = running.insert({ id, TemporaryStorageSession::isRunning(id) }).first;
+			if(it->second) continue;
+		}
+		int64_t size = f.getSize();
+		if(!f.deleteFile()) continue;
+		++swept.numFiles;
+		swept.numBytes += size;
+	}
+	DBG("[TemporaryWaveSourceFile] sweepOrphanedFiles() files=" << swept.numFiles << " bytes=" << swept.numBytes);
+	return swept;
+}
+
 juce::File TemporaryWaveSourceFile::getTempDirectory()
 {
 	return juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("{FDD934D4-57DF-415D-83ED-EFC251C75C4D}");
 }
 
-juce::File TemporaryWaveSourceFile::getNextUniquePath()
+juce::File TemporaryWaveSourceFile::getNextUniquePath(const juce::String& ext)
 {
-	juce::File path = getTempDirectory().getNonexistentChildFile(juce::String::formatted("%08u", juce::Random::getSystemRandom().nextInt()), ".wav", true);
+	// the batch editor renders on several threads at once, so picking and claiming the name must not interleave
+	static juce::CriticalSection lock;
+	juce::ScopedLock sl(lock);
+	juce::File path = getTempDirectory().getNonexistentChildFile(TemporaryStorageSession::getInstance().id + juce::String::formatted("-%08u", juce::Random::getSystemRandom().nextInt()), ext, true);
 	path.create();
 	return path;
 }
 
-std::unique_ptr<juce::AudioFormatWriter> TemporaryWaveSourceFile::createCompatibleAudioFromatWriter(const juce::File& path, const WaveFormat& fmt)
+std::unique_ptr<juce::AudioFormatWriter> TemporaryWaveSourceFile::createCompatibleAudioFromatWriter(const juce::File& path, const WaveFormat& fmt, int bps)
 {
 	std::unique_ptr<juce::FileOutputStream> str = std::make_unique<juce::FileOutputStream>(path);
 	if(str->failedToOpen()) return nullptr;
 	str->setPosition(0);
 	str->truncate();
-	juce::WavAudioFormat wavfmt;
-	std::unique_ptr<juce::AudioFormatWriter> writer(wavfmt.createWriterFor(str.get(), fmt.sampleRate, fmt.numChannels, 32, {}, 0));
+	constexpr int FlacFastestCompression = 0;
+	std::unique_ptr<juce::AudioFormat> af = createStorageAudioFormat(path);
+	std::unique_ptr<juce::AudioFormatWriter> writer(af->createWriterFor(str.get(), fmt.sampleRate, fmt.numChannels, bps, {}, FlacFastestCompression));
 	if(!writer) return nullptr;
 	str.release();
 	return writer;
 }
 
-WaveSourceFile::Ptr TemporaryWaveSourceFile::createInstanceFromSourceFile(WaveSourceFile::Ptr src)
+WaveSourceFile::Ptr TemporaryWaveSourceFile::createInstanceFromCompatiblePath(const juce::File& wavpath)
 {
-	juce::ReferenceCountedObjectPtr<TemporaryWaveSourceFileImpl> ptr = new TemporaryWaveSourceFileImpl(src);
+	juce::ReferenceCountedObjectPtr<TemporaryWaveSourceFileImpl> ptr = new TemporaryWaveSourceFileImpl(wavpath, true);
 	if(!ptr->formatReader) return nullptr;
 	return ptr;
 }
 
-WaveSourceFile::Ptr TemporaryWaveSourceFile::createInstanceFromCompatiblePath(const juce::File& wavpath)
+WaveSourceFile::Ptr TemporaryWaveSourceFile::createInstanceFromKeptPath(const juce::File& path)
 {
-	juce::ReferenceCountedObjectPtr<TemporaryWaveSourceFileImpl> ptr = new TemporaryWaveSourceFileImpl(wavpath);
+	juce::ReferenceCountedObjectPtr<TemporaryWaveSourceFileImpl> ptr = new TemporaryWaveSourceFileImpl(path, false);
 	if(!ptr->formatReader) return nullptr;
 	return ptr;
 }
@@ -149,6 +638,7 @@ WaveSourceFile::Ptr TemporaryWaveSourceFile::createInstanceFromCompatiblePath(co
 
 int64_t WaveCutList::calcTotalSize() const
 {
+	WAVE_TRACE_SCOPE("cutlist", "WaveCutList::calcTotalSize");
 	int64_t l = 0; for(const auto& wc : *this) l += wc.range.size();
 	return l;
 }
@@ -242,8 +732,52 @@ void WaveCutList::eraseRange(Range64 oprange)
 	}
 }
 
+void WaveCutList::eraseRanges(const std::vector<Range64>& opranges)
+{
+	WAVE_TRACE_SCOPE("cutlist", "WaveCutList::eraseRanges");
+	// the ranges are in the positions before any of them is erased, so the tiles are measured as they were
+	std::vector<Range64>::const_iterator ir = opranges.begin();
+	int64_t offset = 0;
+	iterator it = begin();
+	while((it != end()) && (ir != opranges.end()))
+	{
+		Range64 rtile{ offset, offset + it->range.size() };
+		offset = rtile.end;
+		int64_t srcbegin = it->range.begin;
+		// the pieces between the ranges that cross the tile stay, the last one in the tile itself
+		int64_t keep = rtile.begin;
+		for(; (ir != opranges.end()) && (ir->begin < rtile.end); ++ir)
+		{
+			if(keep < ir->begin) insert(it, WaveCut{ it->sourceFile, Range64{ srcbegin + (keep - rtile.begin), srcbegin + (ir->begin - rtile.begin) } });
+			keep = std::max(keep, ir->end);
+			if(rtile.end < ir->end) break; // continues into the next tile
+		}
+		if(rtile.end <= keep) it = erase(it);
+		else
+		{
+			it->range.begin = srcbegin + (keep - rtile.begin);
+			++it;
+		}
+	}
+}
+
+std::vector<Range64> WaveCutList::normalizeRanges(std::vector<Range64> ranges, int64_t length)
+{
+	std::sort(ranges.begin(), ranges.end(), [](const Range64& a, const Range64& b) { return a.begin < b.begin; });
+	std::vector<Range64> result;
+	for(const Range64& r : ranges)
+	{
+		Range64 rx = r.intersection(0, length);
+		if(rx.isEmpty()) continue;
+		if(!result.empty() && (rx.begin <= result.back().end)) result.back().end = std::max(result.back().end, rx.end);
+		else result.push_back(rx);
+	}
+	return result;
+}
+
 void WaveCutList::mergeAdjucentContinuousCuts()
 {
+	WAVE_TRACE_SCOPE("cutlist", "WaveCutList::mergeAdjucentContinuousCuts");
 	WaveCutList::iterator it = begin();
 	while(it != end())
 	{
@@ -257,6 +791,23 @@ void WaveCutList::mergeAdjucentContinuousCuts()
 	}
 }
 
+int64_t WaveCutList::calcMemorySize() const
+{
+	// a node of std::list carries two links besides the element
+	return (int64_t)size() * (int64_t)(sizeof(WaveCut) + 2 * sizeof(void*));
+}
+
+int64_t WaveCutList::calcTemporaryStorageSize() const
+{
+	// apportioned by the length covered, so that the pieces of a render left by later edits do not count it twice
+	double size = 0;
+	for(const WaveCut& c : *this)
+	{
+		if(0 < c.sourceFile->length) size += (double)c.sourceFile->getTemporaryStorageSize() * (double)c.range.size() / (double)c.sourceFile->length;
+	}
+	return (int64_t)size;
+}
+
 // ================================================================================
 // WaveCutListReader
 
@@ -270,10 +821,14 @@ public:
 		WaveCutList::iterator iterator;
 		int64_t offset;
 	} currentCut;
+	// start offsets of the cuts, so that seeking is a binary search rather than a walk along the list
+	std::vector<std::pair<int64_t, WaveCutList::iterator>> cutOffsets;
 	int64_t totalLength = 0;
 	int64_t position = 0;
 	std::vector<float*> ptrArray;
-	WaveCutListReaderImpl() : currentCut{ waveCutList.end(), 0 }
+	bool ownsDecoders;
+	std::map<WaveSourceFile*, WaveSourceFile::Decoder> decoders; // keyed by the sources the list holds
+	WaveCutListReaderImpl(bool owndecoders) : currentCut{ waveCutList.end(), 0 }, ownsDecoders(owndecoders)
 	{
 	}
 	virtual ~WaveCutListReaderImpl()
@@ -287,8 +842,22 @@ public:
 	{
 		waveCutList = v;
 		numChannels = waveCutList.empty() ? 0 : waveCutList.front().sourceFile->format.numChannels;
-		totalLength = waveCutList.calcTotalSize();
+		cutOffsets.clear();
+		cutOffsets.reserve(waveCutList.size());
+		int64_t offset = 0;
+		for(WaveCutList::iterator it = waveCutList.begin(); it != waveCutList.end(); ++it)
+		{
+			cutOffsets.push_back({ offset, it });
+			offset += it->range.size();
+		}
+		totalLength = offset;
 		ptrArray.resize(numChannels);
+		// the decoders of the sources the list still uses are kept, a seek of the scrubber should not reopen them
+		for(auto it = decoders.begin(); it != decoders.end(); )
+		{
+			bool used = std::any_of(waveCutList.begin(), waveCutList.end(), [&](const WaveCut& wc) { return wc.sourceFile.get() == it->first; });
+			it = used ? std::next(it) : decoders.erase(it);
+		}
 		setPosition(position);
 	}
 	virtual int64_t getTotalLength() const override
@@ -303,17 +872,10 @@ public:
 	{
 		position = std::max((int64_t)0, std::min(totalLength, v));
 		currentCut = { waveCutList.end(), 0 };
-		int64_t offset = 0;
-		for(WaveCutList::iterator it = waveCutList.begin(); it != waveCutList.end(); ++it)
-		{
-			Range64 rng{ offset, offset + it->range.size() };
-			if(rng.intersects(position))
-			{
-				currentCut = { it, offset };
-				break;
-			}
-			offset += it->range.size();
-		}
+		if(totalLength <= position) return;
+		auto it = std::upper_bound(cutOffsets.begin(), cutOffsets.end(), position, [](int64_t pos, const std::pair<int64_t, WaveCutList::iterator>& e) { return pos < e.first; });
+		--it;
+		currentCut = { it->second, it->first };
 	}
 	virtual bool read(float* const* pp, int cch, int len) override
 	{
@@ -326,7 +888,10 @@ public:
 			if(currentCut.iterator == waveCutList.end()) break;
 			const WaveCut& wc = *currentCut.iterator;
 			int lseg = (int)std::min(currentCut.offset + wc.range.size() - position, (int64_t)(len - pos));
-			wc.sourceFile->read(ptrArray.data(), cch, wc.range.begin + position - currentCut.offset, lseg);
+			// the rest of the block is left as it is, the caller has to discard all of it
+			int64_t spos = wc.range.begin + position - currentCut.offset;
+			bool ok = ownsDecoders ? wc.sourceFile->readWith(decoders[wc.sourceFile.get()], ptrArray.data(), cch, spos, lseg) : wc.sourceFile->read(ptrArray.data(), cch, spos, lseg);
+			if(!ok) return false;
 			for(int ich = 0; ich < cch; ++ich) ptrArray[ich] += lseg;
 			pos += lseg;
 			position += lseg;
@@ -340,39 +905,250 @@ public:
 	}
 };
 
-WaveCutListReader::Ptr WaveCutListReader::createInstance()
+WaveCutListReader::Ptr WaveCutListReader::createInstance(bool owndecoders)
 {
-	return new WaveCutListReaderImpl;
+	return new WaveCutListReaderImpl(owndecoders);
+}
+
+// ================================================================================
+// WaveCutListWriter
+
+int64_t WaveCutListWriter::calcDataSize(const WaveFormat& fmt, int bps, int64_t len)
+{
+	return len * (int64_t)fmt.numChannels * (int64_t)((bps + 7) / 8);
+}
+
+juce::Result WaveCutListWriter::checkCapacity(juce::AudioFormat& af, const juce::File& path, const WaveFormat& fmt, int bps, int64_t len)
+{
+	int64_t datasize = calcDataSize(fmt, bps, len);
+	// the WAV writer rewrites its header as RF64 on close once the data exceeds 4 GB, and FLAC has no such limit,
+	// but the other formats (e.g. AIFF) refuse to write beyond it
+	bool unlimited = (dynamic_cast<juce::WavAudioFormat*>(&af) != nullptr) || af.isCompressed();
+	if(!unlimited && (RiffSizeLimit < datasize)) return juce::Result::fail(af.getFormatName() + " cannot hold more than 4 GB of audio, choose WAV instead");
+	if(af.isCompressed()) return juce::Result::ok();
+	int64_t bytesfree = path.getParentDirectory().getBytesFreeOnVolume();
+	if((0 < bytesfree) && (bytesfree < datasize)) return juce::Result::fail("not enough disk space");
+	return juce::Result::ok();
+}
+
+juce::Result WaveCutListWriter::writeRange(juce::AudioFormatWriter& writer, const WaveCutList& cl, const Range64& r, const BlockProcessor& proc, const std::function<bool()>& shouldcancel)
+{
+	WAVE_TRACE_SCOPE("io", "WaveCutListWriter::writeRange");
+	if(cl.empty()) return juce::Result::fail("empty cut list");
+	WaveFormat fmt = cl.front().sourceFile->format;
+	// the pieces of a parallel render each read through decoders of their own rather than taking turns on those of the sources
+	WaveCutListReader::Ptr reader = WaveCutListReader::createInstance(true);
+	reader->setWaveCutList(cl);
+	reader->setPosition(r.begin);
+	// the writer streams its blocks and patches the header on close, so the final size need not be known here
+	juce::AudioBuffer<float> buf(fmt.numChannels, 16384);
+	int64_t pos = r.begin; while(pos < r.end)
+	{
+		int lseg = (int)std::min(r.end - pos, (int64_t)buf.getNumSamples());
+		if(shouldcancel && shouldcancel()) return juce::Result::fail("cancelled");
+		if(!reader->read(buf.getArrayOfWritePointers(), buf.getNumChannels(), lseg)) return juce::Result::fail("failed to read");
+		if(proc) proc(buf, pos, lseg);
+		if(!writer.writeFromAudioSampleBuffer(buf, 0, lseg)) return juce::Result::fail("failed to write");
+		pos += lseg;
+	}
+	return juce::Result::ok();
+}
+
+juce::Result WaveCutListWriter::writeFile(juce::AudioFormatManager& afm, const juce::File& path, const WaveCutList& cl, const WaveFormat& fmt, int bps, const juce::StringPairArray& metadata)
+{
+	WAVE_TRACE_SCOPE("io", "WaveCutListWriter::writeFile");
+	juce::Result r = juce::Result::fail("unexpected");
+	try
+	{
+		juce::AudioFormat* af = afm.findFormatForFileExtension(path.getFileExtension());
+		if(!af) throw juce::Result::fail("format not found");
+		// written beside and swapped in, so that a failure leaves the previous file intact; the sources go on reading it meanwhile
+		juce::TemporaryFile tmp(path);
+		{
+			// open
+			std::unique_ptr<juce::FileOutputStream> ostr(new juce::FileOutputStream(tmp.getFile()));
+			if(ostr->failedToOpen()) throw juce::Result::fail("failed to open");
+			std::unique_ptr<juce::AudioFormatWriter> writer(af->createWriterFor(ostr.get(), fmt.sampleRate, fmt.numChannels, bps, metadata, 0));
+			if(!writer) throw juce::Result::fail("failed to create a writer");
+			ostr.release();
+			// transfer; the writer patches the header when it is closed at the end of the scope
+			int64_t len = cl.calcTotalSize();
+			juce::Result rw = checkCapacity(*af, path, fmt, writer->getBitsPerSample(), len);
+			if(rw.wasOk()) rw = writeRange(*writer, cl, { 0, len });
+			if(rw.failed()) throw rw;
+		}
+		// the sources keep reading the file they were opened from, so move their contents away before it is replaced
+		juce::Result rd = ArchivedWaveSourceFile::detachFromFile(path);
+		if(rd.failed()) throw rd;
+		if(!tmp.overwriteTargetFileWithTemporary()) throw juce::Result::fail("failed to replace " + path.getFileName().quoted());
+		r = juce::Result::ok();
+	}
+	catch(juce::Result& e)
+	{
+		r = e;
+	}
+	return r;
 }
 
 // ================================================================================
 // WaveCutListModifier
 
+namespace
+{
+	// the range through the processor into a 32-bit float temporary file, as one cut onto it; empty if it failed
+	WaveCutList renderToTemporary(const WaveCutList& srccl, const Range64& r, const WaveCutListWriter::BlockProcessor& proc)
+	{
+		WaveFormat fmt = srccl.front().sourceFile->format;
+		juce::File path = TemporaryWaveSourceFile::getNextUniquePath();
+		juce::Result result = juce::Result::fail("failed to create a writer");
+		{
+			juce::WavAudioFormat wavfmt;
+			std::unique_ptr<juce::AudioFormatWriter> writer = TemporaryWaveSourceFile::createCompatibleAudioFromatWriter(path, fmt);
+			if(writer) result = WaveCutListWriter::checkCapacity(wavfmt, path, fmt, 32, r.size());
+			if(writer && result.wasOk()) result = WaveCutListWriter::writeRange(*writer, srccl, r, proc);
+		}
+		WaveSourceFile::Ptr tmpfile = result.wasOk() ? TemporaryWaveSourceFile::createInstanceFromCompatiblePath(path) : nullptr;
+		if(!tmpfile)
+		{
+			DBG("[WaveCutListModifier] render " << result.getErrorMessage().quoted());
+			path.deleteFile();
+			return {};
+		}
+		return { { { tmpfile, { 0, tmpfile->length } } } };
+	}
+
+	class WaveRenderPieceJob : public juce::ThreadPoolJob
+	{
+	public:
+		const WaveCutList& sourceCutList;
+		Range64 range;
+		const WaveCutListModifier::PieceProcessorFactory& processorFactory;
+		WaveCutList result;
+		WaveRenderPieceJob(const WaveCutList& srccl, const Range64& r, const WaveCutListModifier::PieceProcessorFactory& factory) : juce::ThreadPoolJob("WaveRenderPiece"), sourceCutList(srccl), range(r), processorFactory(factory)
+		{
+		}
+		virtual JobStatus runJob() override
+		{
+			WAVE_TRACE_SCOPE("render", "WaveRenderPieceJob::runJob");
+			result = renderToTemporary(sourceCutList, range, processorFactory(range));
+			return jobHasFinished;
+		}
+	};
+}
+
 WaveCutList WaveCutListModifier::processSyncWithRamp(const WaveCutList& srccl, const Range64& r, float startgain, float stopgain)
 {
+	WAVE_TRACE_SCOPE("render", "WaveCutListModifier::processSyncWithRamp");
 	if(srccl.empty()) return {};
-	WaveFormat fmt = srccl.front().sourceFile->format;
-	WaveCutListReader::Ptr reader = WaveCutListReader::createInstance();
-	if(!reader) return {};
-	reader->setWaveCutList(srccl);
-	reader->setPosition(r.begin);
-	juce::File path = TemporaryWaveSourceFileImpl::getNextUniquePath();
+	return renderToTemporary(srccl, r, [&](juce::AudioBuffer<float>& buf, int64_t pos, int lseg)
 	{
-		std::unique_ptr<juce::AudioFormatWriter> writer = TemporaryWaveSourceFile::createCompatibleAudioFromatWriter(path, fmt);
-		if(!writer) return {};
-		juce::AudioBuffer<float> buf(fmt.numChannels, 16384);
-		int64_t pos = r.begin; while(pos < r.end)
-		{
-			int lseg = (int)std::min(r.end - pos, (int64_t)buf.getNumSamples());
-			reader->read(buf.getArrayOfWritePointers(), buf.getNumChannels(), lseg);
-			float g0 = (float)(startgain + (stopgain - startgain) * (double)(pos - r.begin) / (double)r.size());
-			float g1 = (float)(startgain + (stopgain - startgain) * (double)(pos + lseg - r.begin) / (double)r.size());
-			buf.applyGainRamp(0, lseg, g0, g1);
-			writer->writeFromAudioSampleBuffer(buf, 0, lseg);
-			pos += lseg;
+		float g0 = (float)(startgain + (stopgain - startgain) * (double)(pos - r.begin) / (double)r.size());
+		float g1 = (float)(startgain + (stopgain - startgain) * (double)(pos + lseg - r.begin) / (double)r.size());
+		buf.applyGainRamp(0, lseg, g0, g1);
+	});
+}
+
+WaveCutList WaveCutListModifier::processParallelWithGain(const WaveCutList& srccl, const Range64& r, float gain)
+{
+	WAVE_TRACE_SCOPE("render", "WaveCutListModifier::processParallelWithGain");
+	return processParallel(srccl, r, [gain](const Range64&) -> WaveCutListWriter::BlockProcessor
+	{
+		return [gain](juce::AudioBuffer<float>& buf, int64_t, int lseg) { buf.applyGain(0, lseg, gain); };
+	});
+}
+
+WaveCutList WaveCutListModifier::processParallel(const WaveCutList& srccl, const Range64& r, const PieceProcessorFactory& factory, int64_t grain, int maxpieces)
+{
+	WAVE_TRACE_SCOPE("render", "WaveCutListModifier::processParallel");
+	if(srccl.empty() || r.isEmpty() || (grain <= 0)) return {};
+	if(maxpieces <= 0) maxpieces = juce::SystemStats::getNumCpus();
+	int64_t minpiece = std::max((int64_t)1, (int64_t)(MinParallelPieceSeconds * srccl.front().sourceFile->format.sampleRate));
+	int64_t numgrains = (r.size() + grain - 1) / grain;
+	int64_t mingrains = std::max((int64_t)1, minpiece / grain);
+	int numpieces = (int)juce::jlimit((int64_t)1, (int64_t)maxpieces, numgrains / mingrains);
+	if(numpieces == 1) return renderToTemporary(srccl, r, factory(r));
+	juce::ThreadPool pool(numpieces);
+	std::vector<std::unique_ptr<WaveRenderPieceJob>> jobs;
+	for(int i = 0; i < numpieces; ++i)
+	{
+		int64_t g0 = numgrains * i / numpieces, g1 = numgrains * (i + 1) / numpieces;
+		Range64 rp{ r.begin + g0 * grain, std::min(r.end, r.begin + g1 * grain) };
+		jobs.push_back(std::make_unique<WaveRenderPieceJob>(srccl, rp, factory));
+		pool.addJob(jobs.back().get(), false);
+	}
+	WaveCutList result;
+	bool failed = false;
+	for(std::unique_ptr<WaveRenderPieceJob>& job : jobs)
+	{
+		pool.waitForJobToFinish(job.get(), -1);
+		failed = failed || job->result.empty();
+		result.splice(result.end(), job->result);
+	}
+	// a piece that failed leaves a hole, so the others are dropped and their files go with them
+	if(failed) return {};
+	return result;
+}
+
+// ================================================================================
+// WaveCutListConsolidator
+
+Range64 WaveCutListConsolidator::findFragmentedSpan(const WaveCutList& cl, double fs)
+{
+	WAVE_TRACE_SCOPE("cutlist", "WaveCutListConsolidator::findFragmentedSpan");
+	if(fs <= 0) return {};
+	int64_t maxfragment = (int64_t)(MaxFragmentSeconds * fs);
+	int64_t maxspan = (int64_t)(MaxSpanSeconds * fs);
+	Range64 best;
+	double bestdensity = 0;
+	Range64 run;
+	int runcount = 0;
+	auto closeRun = [&]()
+	{
+		if((MinFragments <= runcount) && !run.isEmpty())
+		{
+			double density = (double)runcount / (double)run.size();
+			if(bestdensity < density) { best = run; bestdensity = density; }
 		}
+		runcount = 0;
+	};
+	int64_t pos = 0;
+	for(const WaveCut& wc : cl)
+	{
+		int64_t len = wc.range.size();
+		if(maxfragment <= len) closeRun();
+		else
+		{
+			if((0 < runcount) && (maxspan < (pos + len - run.begin))) closeRun();
+			if(runcount == 0) run = { pos, pos };
+			run.end = pos + len;
+			++runcount;
+		}
+		pos += len;
+	}
+	closeRun();
+	return best;
+}
+
+WaveCutList WaveCutListConsolidator::render(const WaveCutList& cl, const Range64& r, const std::function<bool()>& shouldcancel)
+{
+	WAVE_TRACE_SCOPE("render", "WaveCutListConsolidator::render");
+	if(cl.empty() || r.isEmpty()) return {};
+	WaveFormat fmt = cl.front().sourceFile->format;
+	juce::File path = TemporaryWaveSourceFile::getNextUniquePath();
+	juce::Result result = juce::Result::fail("failed to create a writer");
+	{
+		juce::WavAudioFormat wavfmt;
+		std::unique_ptr<juce::AudioFormatWriter> writer = TemporaryWaveSourceFile::createCompatibleAudioFromatWriter(path, fmt);
+		if(writer) result = WaveCutListWriter::checkCapacity(wavfmt, path, fmt, 32, r.size());
+		// it gives up as soon as the span is no longer wanted
+		if(writer && result.wasOk()) result = WaveCutListWriter::writeRange(*writer, cl, r, {}, shouldcancel);
+	}
+	WaveSourceFile::Ptr tmpfile = result.wasOk() ? TemporaryWaveSourceFile::createInstanceFromCompatiblePath(path) : nullptr;
+	if(!tmpfile)
+	{
+		DBG("[WaveCutListConsolidator] render() " << result.getErrorMessage().quoted());
+		path.deleteFile();
+		return {};
 	}
-	WaveSourceFile::Ptr tmpfile = TemporaryWaveSourceFile::createInstanceFromCompatiblePath(path);
-	if(!tmpfile) return {};
 	return { { { tmpfile, { 0, tmpfile->length } } } };
 }
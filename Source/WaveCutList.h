@@ -9,6 +9,9 @@
 
 #include <JuceHeader.h>
 
+class WavePeakIndex;
+class WaveLoudnessSummary;
+
 struct WaveFormat
 {
 	double sampleRate;
@@ -35,14 +38,46 @@ struct Range64
 	}
 };
 
+// a cache of an analysis of a source, installed by whoever schedules the first scan and shared with the scan, which may still be filling it
+// the accesses are atomic: the scans, the view and the measurements run on different threads
+template<class T> class WaveAnalysisCache
+{
+private:
+	std::shared_ptr<T> ptr;
+public:
+	std::shared_ptr<T> get() const { return std::atomic_load(&ptr); }
+	// installs v unless there is one already; true if it did, and the caller schedules its scan
+	bool install(const std::shared_ptr<T>& v) { std::shared_ptr<T> none; return std::atomic_compare_exchange_strong(&ptr, &none, v); }
+	// drops v if it is still the one installed, e.g. after its scan gave up, so that the next to ask builds another
+	void discard(const std::shared_ptr<T>& v) { std::shared_ptr<T> expected = v; std::atomic_compare_exchange_strong(&ptr, &expected, std::shared_ptr<T>()); }
+};
+
 class WaveSourceFile : public juce::ReferenceCountedObject
 {
 public:
 	using Ptr = juce::ReferenceCountedObjectPtr<WaveSourceFile>;
+	// the decoder of one worker, so that its reads through readWith() neither wait for those through read(), e.g. of the audio thread, nor hold them up
+	// it is opened by the first read and again once the source moves to another file, e.g. on detaching
+	struct Decoder
+	{
+		juce::File file;
+		std::unique_ptr<juce::AudioFormatReader> reader;
+		std::unique_ptr<juce::InputStream> cacheStream;
+	};
 	juce::File backingFile;
 	int64_t length = 0;
 	WaveFormat format = {};
+	int bitsPerSample = 32;
+	bool usesFloatingPointData = true;
+	WaveAnalysisCache<WavePeakIndex> peakIndex;
+	WaveAnalysisCache<WaveLoudnessSummary> loudnessSummary;
 	virtual bool read(float* const* pp, int cch, int64_t samplepos, int len) = 0;
+	// for the background work; a source that cannot open another decoder reads through read()
+	virtual bool readWith(Decoder& decoder, float* const* pp, int cch, int64_t samplepos, int len) { juce::ignoreUnused(decoder); return read(pp, cch, samplepos, len); }
+	// copies the samples to the writer, bit-exact if both sides are integer PCM
+	virtual bool copyTo(juce::AudioFormatWriter& writer, int64_t samplepos, int64_t len);
+	// the bytes in the temporary directory that live as long as the instance
+	virtual int64_t getTemporaryStorageSize() { return 0; }
 };
 
 class ArchivedWaveSourceFile : public WaveSourceFile
@@ -52,6 +87,8 @@ protected:
 public:
 	static Ptr createInstance(juce::AudioFormatManager& afm, const juce::File& path);
 	static Ptr createInstance(std::unique_ptr<juce::AudioFormatReader> reader, const juce::File& path);
+	// moves the contents of every live instance backed by the path into temporary storage, so that the path can be overwritten
+	static juce::Result detachFromFile(const juce::File& path);
 };
 
 class TemporaryWaveSourceFile : public WaveSourceFile
@@ -59,11 +96,38 @@ class TemporaryWaveSourceFile : public WaveSourceFile
 protected:
 	TemporaryWaveSourceFile() {}
 public:
+	enum StorageFormat
+	{
+		StorageFloat,		// everything as 32-bit float WAV
+		StorageNative,		// source bit depth where lossless, 32-bit float for processed material
+		StorageCompressed,	// like StorageNative, but integer material is stored as FLAC
+	};
+	static StorageFormat getStorageFormat();
+	static void setStorageFormat(StorageFormat v);
+	static int getStorageBitsPerSample(const WaveSourceFile& src);
+	static juce::String getStorageFileExtension(int bps);
+	struct StorageUsage
+	{
+		int numFiles = 0;
+		int64_t numBytes = 0;
+	};
+	// the live files of this process in the temporary directory
+	static StorageUsage getStorageUsage();
+	// the bytes the undo history may hold in the temporary directory before its oldest steps are dropped, 0 for no limit
+	static int64_t getStorageQuota();
+	static void setStorageQuota(int64_t v);
+	// deletes the files no running instance owns; call it once the journals of the crashed sessions are recovered or discarded
+	static StorageUsage sweepOrphanedFiles();
 	static juce::File getTempDirectory();
-	static juce::File getNextUniquePath();
-	static std::unique_ptr<juce::AudioFormatWriter> createCompatibleAudioFromatWriter(const juce::File& path, const WaveFormat& fmt);
-	static Ptr createInstanceFromSourceFile(WaveSourceFile::Ptr src);
+	// the names carry the id of the session, whose lock tells the sweep of another instance that the file is in use
+	static juce::File getNextUniquePath(const juce::String& ext = ".wav");
+	static std::unique_ptr<juce::AudioFormatWriter> createCompatibleAudioFromatWriter(const juce::File& path, const WaveFormat& fmt, int bps = 32);
+	// a render another session left behind is opened in place and owned only once adopt() renames it into this session
 	static Ptr createInstanceFromCompatiblePath(const juce::File& wavpath);
+	// opens a render kept outside the temporary directory, e.g. with a project; the file is left in place when the instance dies
+	static Ptr createInstanceFromKeptPath(const juce::File& path);
+	// takes over a render of another session, see createInstanceFromCompatiblePath(); does nothing to the others
+	virtual void adopt() = 0;
 };
 
 struct WaveCut
@@ -79,7 +143,15 @@ public:
 	WaveCutList intersectRange(Range64 oprange) const;
 	bool insertList(const WaveCutList& clinsert, int64_t inspoint);
 	void eraseRange(Range64 oprange);
+	// erases all the ranges in one pass; they must be sorted and disjoint, as normalizeRanges() returns them
+	void eraseRanges(const std::vector<Range64>& opranges);
+	// sorted, clipped to [0, length) and joined where they overlap or touch
+	static std::vector<Range64> normalizeRanges(std::vector<Range64> ranges, int64_t length);
 	void mergeAdjucentContinuousCuts();
+	// the heap bytes of the list nodes
+	int64_t calcMemorySize() const;
+	// the share of the temporary storage of the sources that the cuts cover
+	int64_t calcTemporaryStorageSize() const;
 };
 
 class WaveCutListReader : public juce::ReferenceCountedObject
@@ -95,7 +167,23 @@ public:
 	virtual int64_t getPosition() const = 0;
 	virtual void setPosition(int64_t v) = 0;
 	virtual bool read(float* const* pp, int cch, int len) = 0;
-	static Ptr createInstance();
+	// a reader for the background work reads through decoders of its own, see WaveSourceFile::readWith(); the playback reads through the shared ones
+	static Ptr createInstance(bool owndecoders = false);
+};
+
+class WaveCutListWriter
+{
+protected:
+	WaveCutListWriter() {}
+public:
+	using BlockProcessor = std::function<void(juce::AudioBuffer<float>& buf, int64_t pos, int len)>;
+	static constexpr int64_t RiffSizeLimit = 0xffffffffLL;
+	static int64_t calcDataSize(const WaveFormat& fmt, int bps, int64_t len);
+	static juce::Result checkCapacity(juce::AudioFormat& af, const juce::File& path, const WaveFormat& fmt, int bps, int64_t len);
+	// fails with "cancelled" as soon as shouldcancel returns true between blocks
+	static juce::Result writeRange(juce::AudioFormatWriter& writer, const WaveCutList& cl, const Range64& r, const BlockProcessor& proc = {}, const std::function<bool()>& shouldcancel = {});
+	// writes the whole cut list to the path in the format its extension names, detaching the sources that read from the path first
+	static juce::Result writeFile(juce::AudioFormatManager& afm, const juce::File& path, const WaveCutList& cl, const WaveFormat& fmt, int bps, const juce::StringPairArray& metadata);
 };
 
 // TODO: asynchronous processing, applying arbitrary gain envelope, etc.
@@ -104,5 +192,28 @@ class WaveCutListModifier
 protected:
 	WaveCutListModifier() {}
 public:
+	static constexpr double MinParallelPieceSeconds = 10;	// shorter ranges are not worth splitting
 	static WaveCutList processSyncWithRamp(const WaveCutList& srccl, const Range64& r, float startgain, float stopgain);
+	// the range split into a piece per CPU, rendered on a worker pool into a temporary file each; the result has a cut per piece
+	static WaveCutList processParallelWithGain(const WaveCutList& srccl, const Range64& r, float gain);
+	// makes the processor of a piece on the worker that renders it, so that a processor with state sees a single piece in order
+	using PieceProcessorFactory = std::function<WaveCutListWriter::BlockProcessor(const Range64& rpiece)>;
+	// the same with a processor of the caller's; the pieces start on multiples of grain from the start of the range, and there are at most maxpieces of them, 0 for a piece per CPU
+	static WaveCutList processParallel(const WaveCutList& srccl, const Range64& r, const PieceProcessorFactory& factory, int64_t grain = 1, int maxpieces = 0);
+};
+
+// the spans where the cuts are so short that a sequential read keeps crossing boundaries and seeking between files,
+// rendered into one contiguous source so that reading them costs what reading an unedited file does
+class WaveCutListConsolidator
+{
+protected:
+	WaveCutListConsolidator() {}
+public:
+	static constexpr double MaxFragmentSeconds = 0.5;	// shorter cuts count as fragments
+	static constexpr int MinFragments = 32;			// fewer in a row are not worth a render
+	static constexpr double MaxSpanSeconds = 60;		// longer runs are consolidated a piece at a time
+	// the run of fragments with the most cuts per second, empty if none qualifies
+	static Range64 findFragmentedSpan(const WaveCutList& cl, double fs);
+	// the span as one cut onto a 32-bit float render, which holds exactly the samples the cuts read as; empty if it failed or was cancelled
+	static WaveCutList render(const WaveCutList& cl, const Range64& r, const std::function<bool()>& shouldcancel = {});
 };
@@ -6,6 +6,9 @@
 //
 
 #include "WaveCutListDocument.h"
+#include "WaveJournal.h"
+#include "WaveProject.h"
+#include "WaveTrace.h"
 
 class WaveCutListClipboard
 {
@@ -22,7 +25,35 @@ public:
 	}
 };
 
-class WaveInsertUndoAction : public juce::UndoableAction
+// the undo manager counts the actions in KiB of what they pin: the nodes of their cut lists and their share of the temporary storage
+// it adds the size up when an action is stored and subtracts it again when it drops the oldest, so each action takes its cost once
+class WaveCostedUndoAction : public juce::UndoableAction
+{
+public:
+	int costUnits = -1;
+	// shared by the actions of a transaction; the document drops its record of the step once the undo manager has deleted them all
+	std::shared_ptr<void> stepToken;
+	virtual int64_t calcCost() const = 0;
+	// what the action does to the list, as the saved history holds it
+	virtual void appendChanges(std::vector<WaveProject::Change>& changes) const = 0;
+	static int64_t calcCutListCost(const WaveCutList& cl)
+	{
+		return cl.calcMemorySize() + cl.calcTemporaryStorageSize();
+	}
+	// taken after the first perform, every action counts at least one so that the steps without renders are dropped with the others
+	virtual int getSizeInUnits() override
+	{
+		if(costUnits < 0) costUnits = (int)std::min((int64_t)std::numeric_limits<int>::max(), 1 + (calcCost() >> 10));
+		return costUnits;
+	}
+	static int getMaxUnits()
+	{
+		int64_t quota = TemporaryWaveSourceFile::getStorageQuota();
+		return (quota == 0) ? std::numeric_limits<int>::max() : (int)juce::jlimit((int64_t)1, (int64_t)std::numeric_limits<int>::max(), quota >> 10);
+	}
+};
+
+class WaveInsertUndoAction : public WaveCostedUndoAction
 {
 public:
 	WaveCutList& targetCutList;
@@ -33,17 +64,27 @@ public:
 	}
 	virtual bool perform() override
 	{
+		WAVE_TRACE_SCOPE("edit", "WaveInsertUndoAction::perform");
 		targetCutList.insertList(insertCutList, insertionRange.begin);
 		return true;
 	}
 	virtual bool undo() override
 	{
+		WAVE_TRACE_SCOPE("edit", "WaveInsertUndoAction::undo");
 		targetCutList.eraseRange(insertionRange);
 		return true;
 	}
+	virtual int64_t calcCost() const override
+	{
+		return calcCutListCost(insertCutList);
+	}
+	virtual void appendChanges(std::vector<WaveProject::Change>& changes) const override
+	{
+		changes.push_back({ { insertionRange.begin, insertionRange.begin }, insertCutList });
+	}
 };
 
-class WaveEraseUndoAction : public juce::UndoableAction
+class WaveEraseUndoAction : public WaveCostedUndoAction
 {
 public:
 	WaveCutList& taregtCutList;
@@ -54,28 +95,137 @@ public:
 	}
 	virtual bool perform() override
 	{
+		WAVE_TRACE_SCOPE("edit", "WaveEraseUndoAction::perform");
 		eraseCutList = taregtCutList.intersectRange(eraseRange);
 		taregtCutList.eraseRange(eraseRange);
 		return true;
 	}
 	virtual bool undo() override
 	{
+		WAVE_TRACE_SCOPE("edit", "WaveEraseUndoAction::undo");
 		taregtCutList.insertList(eraseCutList, eraseRange.begin);
 		return true;
 	}
+	virtual int64_t calcCost() const override
+	{
+		return calcCutListCost(eraseCutList);
+	}
+	virtual void appendChanges(std::vector<WaveProject::Change>& changes) const override
+	{
+		changes.push_back({ eraseRange, {} });
+	}
+};
+
+// erases many ranges in one pass; inserting them back one by one would walk the list for each, so the undo restores the whole list instead
+class WaveEraseRangesUndoAction : public WaveCostedUndoAction
+{
+public:
+	WaveCutList& targetCutList;
+	std::vector<Range64> eraseRanges;
+	WaveCutList previousCutList;
+	int64_t erasedStorageSize = 0;
+	WaveEraseRangesUndoAction(WaveCutList& target, const std::vector<Range64>& ranges) : targetCutList(target), eraseRanges(ranges)
+	{
+	}
+	virtual bool perform() override
+	{
+		WAVE_TRACE_SCOPE("edit", "WaveEraseRangesUndoAction::perform");
+		previousCutList = targetCutList;
+		targetCutList.eraseRanges(eraseRanges);
+		erasedStorageSize = std::max((int64_t)0, previousCutList.calcTemporaryStorageSize() - targetCutList.calcTemporaryStorageSize());
+		return true;
+	}
+	virtual bool undo() override
+	{
+		WAVE_TRACE_SCOPE("edit", "WaveEraseRangesUndoAction::undo");
+		targetCutList = previousCutList;
+		return true;
+	}
+	// the whole previous list is held, but only the renders of the erased pieces are pinned by it alone
+	virtual int64_t calcCost() const override
+	{
+		return previousCutList.calcMemorySize() + erasedStorageSize;
+	}
+	// the last first, so that each range is still where it was
+	virtual void appendChanges(std::vector<WaveProject::Change>& changes) const override
+	{
+		for(auto it = eraseRanges.rbegin(); it != eraseRanges.rend(); ++it) changes.push_back({ *it, {} });
+	}
 };
 
-class WaveCutListDocumentImpl : public WaveCutListDocument
+// the undo step of a reopened project, which has the changes of each step rather than the actions that made them
+class WaveChangesUndoAction : public WaveCostedUndoAction
+{
+public:
+	WaveCutList& targetCutList;
+	std::vector<WaveProject::Change> changes;
+	std::vector<WaveCutList> replacedCutLists;
+	WaveChangesUndoAction(WaveCutList& target, const std::vector<WaveProject::Change>& c) : targetCutList(target), changes(c)
+	{
+	}
+	virtual bool perform() override
+	{
+		replacedCutLists.clear();
+		for(const WaveProject::Change& c : changes)
+		{
+			replacedCutLists.push_back(c.range.isEmpty() ? WaveCutList() : targetCutList.intersectRange(c.range));
+			WaveProject::applyChange(targetCutList, c);
+		}
+		return true;
+	}
+	virtual bool undo() override
+	{
+		for(size_t i = changes.size(); 0 < i--; )
+		{
+			const WaveProject::Change& c = changes[i];
+			WaveProject::applyChange(targetCutList, { { c.range.begin, c.range.begin + c.cutList.calcTotalSize() }, replacedCutLists[i] });
+		}
+		return true;
+	}
+	virtual int64_t calcCost() const override
+	{
+		int64_t cost = 0;
+		for(const WaveProject::Change& c : changes) cost += calcCutListCost(c.cutList);
+		for(const WaveCutList& cl : replacedCutLists) cost += calcCutListCost(cl);
+		return cost;
+	}
+	virtual void appendChanges(std::vector<WaveProject::Change>& v) const override
+	{
+		v.insert(v.end(), changes.begin(), changes.end());
+	}
+};
+
+// renders a fragmented span off the message thread, from a copy of its cuts
+class WaveConsolidationJob : public juce::ThreadPoolJob
+{
+public:
+	Range64 span;
+	WaveCutList spanCutList;
+	WaveCutList consolidatedCutList;
+	WaveConsolidationJob(const Range64& r, const WaveCutList& cl) : juce::ThreadPoolJob("WaveConsolidation"), span(r), spanCutList(cl)
+	{
+	}
+	virtual JobStatus runJob() override
+	{
+		consolidatedCutList = WaveCutListConsolidator::render(spanCutList, { 0, span.size() }, [this]() { return shouldExit(); });
+		return jobHasFinished;
+	}
+};
+
+class WaveCutListDocumentImpl : public WaveCutListDocument, private juce::Timer
 {
 public:
 	struct ScopedUndoTransaction
 	{
-		juce::UndoManager& undoManager;
-		ScopedUndoTransaction(juce::UndoManager& um, const juce::String& n) : undoManager(um) { undoManager.beginNewTransaction(n); }
-		~ScopedUndoTransaction() { undoManager.beginNewTransaction(); }
+		WaveCutListDocumentImpl& document;
+		ScopedUndoTransaction(WaveCutListDocumentImpl& doc, const juce::String& n) : document(doc)
+		{
+			document.beginUndoTransaction(n);
+		}
+		~ScopedUndoTransaction() { document.endUndoTransaction(); }
 	};
 	juce::AudioFormatManager& audioFormatManager;
-	juce::UndoManager undoManager;
+	juce::UndoManager undoManager{ WaveCostedUndoAction::getMaxUnits(), 1 };
 	juce::ListenerList<Listener> listenrList;
 	juce::File lastFile;
 	WaveFormat waveFormat = {};
@@ -83,29 +233,45 @@ public:
 	juce::StringPairArray sourceMetaData;
 	WaveCutList waveCutList;
 	int64_t totalLength = 0;
-	juce::SharedResourcePointer<WaveCutListClipboard> clipboard;
-	WaveCutListDocumentImpl(juce::AudioFormatManager& afm) : WaveCutListDocument(".wav", "*.wav", "Choose a file to open", "Choose a file to save as"), audioFormatManager(afm)
+	// the undo history as the changes of each step, kept beside the undo manager, which does not expose its actions, so that saving it is a copy
+	struct HistoryStep
 	{
+		WaveProject::Step step;
+		std::weak_ptr<void> token; // expires once the undo manager has dropped the step
+	};
+	WaveCutList historyBase;
+	std::deque<HistoryStep> historySteps;
+	int historyStepsDone = 0;
+	HistoryStep pendingStep;
+	std::shared_ptr<void> pendingStepToken;
+	juce::SharedResourcePointer<WaveCutListClipboard> clipboard;
+	static constexpr float MinGainChangeDb = 0.01f;
+	// the records after a checkpoint are replayed on recovery, so the checkpoints keep it short
+	static constexpr int JournalCheckpointInterval = 1000;
+	std::unique_ptr<WaveJournal> journal;
+	// the fragmented spans are consolidated one at a time once the edits pause
+	static constexpr int ConsolidationCheckInterval = 1000; // ms
+	static constexpr juce::uint32 ConsolidationIdleTime = 3000; // ms since the last edit
+	juce::ThreadPool consolidationPool{ 1 };
+	std::unique_ptr<WaveConsolidationJob> consolidationJob;
+	juce::uint32 lastEditTime = 0;
+	bool consolidationSettled = false; // nothing left to consolidate until the next edit
+	WaveCutListDocumentImpl(juce::AudioFormatManager& afm) : WaveCutListDocument(".wav", juce::String("*.wav;*") + WaveProject::FileExtension, "Choose a file to open", "Choose a file to save as"), audioFormatManager(afm)
+	{
+		startTimer(ConsolidationCheckInterval);
 	}
 	virtual ~WaveCutListDocumentImpl()
 	{
-	}
-	bool isArchiveBasedCutList() const
-	{
-		return (waveCutList.size() == 1) && (dynamic_cast<ArchivedWaveSourceFile*>(waveCutList.front().sourceFile.get()) != nullptr);
-	}
-	void switchToTempBasedCutList()
-	{
-		if(!isArchiveBasedCutList()) return;
-		WaveSourceFile::Ptr tmpsrcfile = TemporaryWaveSourceFile::createInstanceFromSourceFile(waveCutList.front().sourceFile);
-		if(!tmpsrcfile) return;
-		WaveSourceFile::Ptr arcsrcfile = waveCutList.front().sourceFile;
-		waveCutList.front().sourceFile = tmpsrcfile;
-		listenrList.call(&Listener::waveCutListDocumentDidReplaceSourceFile, this, arcsrcfile, tmpsrcfile);
+		stopTimer();
+		consolidationPool.removeAllJobs(true, 4000);
 	}
 	void clearContents()
 	{
+		consolidationSettled = false;
 		undoManager.clearUndoHistory();
+		historyBase.clear();
+		historySteps.clear();
+		historyStepsDone = 0;
 		waveFormat = {};
 		sourceBitsPerSample = 0;
 		sourceMetaData.clear();
@@ -118,6 +284,8 @@ public:
 	}
 	virtual juce::Result loadDocument(const juce::File& path) override
 	{
+		WAVE_TRACE_SCOPE("io", "WaveCutListDocument::loadDocument");
+		if(path.hasFileExtension(WaveProject::FileExtension)) return loadProject(path);
 		juce::Result r = juce::Result::fail("unexpected");
 		try
 		{
@@ -130,6 +298,7 @@ public:
 			if(!srcfile) throw juce::Result::fail("failed to open");
 			waveFormat = srcfile->format;
 			waveCutList.push_back({ srcfile, { 0, srcfile->length } });
+			historyBase = waveCutList;
 			totalLength = waveCutList.calcTotalSize();
 			DBG("[WaveCutListDocument] loadDocument() totalLength=" << totalLength);
 			r = juce::Result::ok();
@@ -140,53 +309,175 @@ public:
 			clearContents();
 			DBG("[WaveCutListDocument] loadDocument() " << e.getErrorMessage().quoted());
 		}
+		// the document file is set by the caller after returning
+		writeJournalCheckpoint(r.wasOk() ? path : juce::File(), false);
 		listenrList.call(&Listener::waveCutListDocumentDidInit, this);
 		sendChangeMessage();
 		return r;
 	}
 	virtual juce::Result saveDocument(const juce::File& path) override
 	{
+		WAVE_TRACE_SCOPE("io", "WaveCutListDocument::saveDocument");
+		if(path.hasFileExtension(WaveProject::FileExtension)) return saveProject(path);
 		// TODO: asynchronous processing
-		juce::Result r = juce::Result::fail("unexpected");
-		try
+		juce::Result r = WaveCutListWriter::writeFile(audioFormatManager, path, waveCutList, waveFormat, sourceBitsPerSample, sourceMetaData);
+		if(r.failed()) DBG("[WaveCutListDocument] saveDocument() " << r.getErrorMessage().quoted());
+		// overwriting the source moves the cuts onto renders, which the journal has to refer to instead
+		else writeJournalCheckpoint(path, false);
+		return r;
+	}
+	juce::Result loadProject(const juce::File& path)
+	{
+		clearContents();
+		WaveProject::Content content;
+		juce::Result r = WaveProject::read(audioFormatManager, path, content);
+		if(r.wasOk())
 		{
-			if(isArchiveBasedCutList() && (waveCutList.front().sourceFile->backingFile == path))
-			{
-				switchToTempBasedCutList();
-			}
-			// open
-			juce::AudioFormat* af = audioFormatManager.findFormatForFileExtension(path.getFileExtension());
-			if(!af) throw juce::Result::fail("format not found");
-			if(path.exists()) path.deleteFile();
-			std::unique_ptr<juce::FileOutputStream> ostr(new juce::FileOutputStream(path));
-			if(ostr->failedToOpen()) throw juce::Result::fail("failed to open");
-			ostr->setPosition(0);
-			ostr->truncate();
-			std::unique_ptr<juce::AudioFormatWriter> writer(af->createWriterFor(ostr.get(), waveFormat.sampleRate, waveFormat.numChannels, sourceBitsPerSample, sourceMetaData, 0));
-			if(!writer) throw juce::Result::fail("failed to create a writer");
-			ostr.release();
-			// transfer
-			juce::AudioSampleBuffer buffer(waveFormat.numChannels, 16384);
-			WaveCutListReader::Ptr reader = WaveCutListReader::createInstance();
-			reader->setWaveCutList(waveCutList);
-			reader->setPosition(0);
-			int64_t len = totalLength, pos = 0;
-			while(pos < len)
-			{
-				int lseg = (int)std::min((int64_t)buffer.getNumSamples(), len - pos);
-				reader->read(buffer.getArrayOfWritePointers(), waveFormat.numChannels, lseg);
-				writer->writeFromAudioSampleBuffer(buffer, 0, lseg);
-				pos += lseg;
-			}
-			r = juce::Result::ok();
+			restoreContent(content);
+			DBG("[WaveCutListDocument] loadProject() totalLength=" << totalLength << " history=" << (int)content.history.size());
 		}
-		catch(juce::Result& e)
+		else
 		{
-			r = e;
-			DBG("[WaveCutListDocument] saveDocument() " << e.getErrorMessage().quoted());
+			clearContents();
+			DBG("[WaveCutListDocument] loadProject() " << r.getErrorMessage().quoted());
 		}
+		writeJournalCheckpoint(r.wasOk() ? path : juce::File(), false);
+		listenrList.call(&Listener::waveCutListDocumentDidInit, this);
+		sendChangeMessage();
+		return r;
+	}
+	juce::Result saveProject(const juce::File& path)
+	{
+		juce::Result r = WaveProject::write(path, collectContent());
+		if(r.wasOk()) writeJournalCheckpoint(path, false);
 		return r;
 	}
+	WaveProject::Content collectContent()
+	{
+		WaveProject::Content content;
+		content.format = waveFormat;
+		content.bitsPerSample = sourceBitsPerSample;
+		content.metadata = sourceMetaData;
+		content.base = historyBase;
+		for(const HistoryStep& hs : historySteps) content.history.push_back(hs.step);
+		content.current = historyStepsDone;
+		return content;
+	}
+	void restoreContent(const WaveProject::Content& content)
+	{
+		waveFormat = content.format;
+		sourceBitsPerSample = content.bitsPerSample;
+		sourceMetaData = content.metadata;
+		// the steps are performed again from the base, then undone back to where it was saved
+		historyBase = content.base;
+		waveCutList = content.base;
+		for(const WaveProject::Step& st : content.history)
+		{
+			ScopedUndoTransaction sut(*this, st.name);
+			performUndoAction(new WaveChangesUndoAction(waveCutList, st.changes));
+		}
+		while((content.current < historyStepsDone) && undoStep()) {}
+		waveCutList.mergeAdjucentContinuousCuts();
+		totalLength = waveCutList.calcTotalSize();
+	}
+	// --------------------------------------------------------------------------------
+	void beginUndoTransaction(const juce::String& name)
+	{
+		// the quota may have changed since the last edit, the oldest steps beyond it are dropped when this one is performed
+		undoManager.setMaxNumberOfStoredUnits(WaveCostedUndoAction::getMaxUnits(), 1);
+		undoManager.beginNewTransaction(name);
+		pendingStep = { { name, {} }, {} };
+		pendingStepToken = std::make_shared<int>(0);
+	}
+	bool performUndoAction(WaveCostedUndoAction* action)
+	{
+		std::vector<WaveProject::Change> changes;
+		action->appendChanges(changes);
+		action->stepToken = pendingStepToken;
+		if(!undoManager.perform(action)) return false;
+		pendingStep.step.changes.insert(pendingStep.step.changes.end(), changes.begin(), changes.end());
+		return true;
+	}
+	void endUndoTransaction()
+	{
+		undoManager.beginNewTransaction();
+		bool performed = !pendingStep.step.changes.empty();
+		pendingStep.token = pendingStepToken;
+		pendingStepToken = nullptr;
+		if(!performed) return;
+		// a new step discards the ones that could be redone, as the undo manager does
+		historySteps.resize((size_t)historyStepsDone);
+		historySteps.push_back(std::move(pendingStep));
+		++historyStepsDone;
+		// and the oldest ones beyond the quota become part of the base
+		if(!historySteps.front().token.expired()) return;
+		while(!historySteps.empty() && historySteps.front().token.expired())
+		{
+			for(const WaveProject::Change& c : historySteps.front().step.changes) WaveProject::applyChange(historyBase, c);
+			historySteps.pop_front();
+			--historyStepsDone;
+		}
+		historyBase.mergeAdjucentContinuousCuts();
+	}
+	bool undoStep()
+	{
+		if(!undoManager.undo()) return false;
+		--historyStepsDone;
+		return true;
+	}
+	bool redoStep()
+	{
+		if(!undoManager.redo()) return false;
+		++historyStepsDone;
+		return true;
+	}
+	// --------------------------------------------------------------------------------
+	void writeJournalCheckpoint(const juce::File& docfile, bool changedsincesaved)
+	{
+		if(journal) journal->writeCheckpoint(collectContent(), docfile, changedsincesaved);
+	}
+	// called after the edit is done, so a checkpoint in its place includes it
+	void writeJournalEdit(const WaveJournal::Edit& e)
+	{
+		if(!journal) return;
+		if(JournalCheckpointInterval <= journal->getNumRecordsSinceCheckpoint()) writeJournalCheckpoint(getFile(), hasChangedSinceSaved());
+		else journal->writeEdit(e);
+	}
+	void writeJournalEdit(WaveJournal::Edit::Type type, const juce::String& name = {}, const Range64& r = {}, const WaveCutList& cl = {})
+	{
+		writeJournalEdit({ type, name, r, cl });
+	}
+	// the same undo transactions as the edit methods, without the renders, which the journal holds already
+	bool replayJournalEdit(const WaveJournal::Edit& e)
+	{
+		switch(e.type)
+		{
+			case WaveJournal::Edit::Undo:
+				if(!undoStep()) return false;
+				waveCutList.mergeAdjucentContinuousCuts();
+				return true;
+			case WaveJournal::Edit::Redo:
+				if(!redoStep()) return false;
+				waveCutList.mergeAdjucentContinuousCuts();
+				return true;
+			case WaveJournal::Edit::EraseRanges:
+			{
+				if(e.ranges.empty() || (e.ranges.front().begin < 0) || (waveCutList.calcTotalSize() < e.ranges.back().end)) return false;
+				ScopedUndoTransaction sut(*this, e.name);
+				if(!performUndoAction(new WaveEraseRangesUndoAction(waveCutList, e.ranges))) return false;
+				waveCutList.mergeAdjucentContinuousCuts();
+				return true;
+			}
+			default:
+				break;
+		}
+		if((e.range.begin < 0) || (waveCutList.calcTotalSize() < e.range.end)) return false;
+		ScopedUndoTransaction sut(*this, e.name);
+		if((e.type != WaveJournal::Edit::Insert) && !performUndoAction(new WaveEraseUndoAction(waveCutList, e.range))) return false;
+		if((e.type != WaveJournal::Edit::Erase) && !performUndoAction(new WaveInsertUndoAction(waveCutList, e.cutList, e.range.begin))) return false;
+		if(e.type != WaveJournal::Edit::Replace) waveCutList.mergeAdjucentContinuousCuts();
+		return true;
+	}
 	virtual juce::File getLastDocumentOpened() override
 	{
 		return lastFile;
@@ -195,6 +486,55 @@ public:
 	{
 		lastFile = file;
 	}
+	void didEdit(int edittype, const Range64& r)
+	{
+		lastEditTime = juce::Time::getMillisecondCounter();
+		consolidationSettled = false;
+		listenrList.call(&Listener::waveCutListDocumentDidEdit, this, edittype, r);
+	}
+	// --------------------------------------------------------------------------------
+	// juce::Timer
+	virtual void timerCallback() override
+	{
+		if(consolidationJob)
+		{
+			if(consolidationPool.contains(consolidationJob.get())) return;
+			std::unique_ptr<WaveConsolidationJob> job = std::move(consolidationJob);
+			applyConsolidation(*job);
+			return;
+		}
+		if(consolidationSettled || !hasValidContent() || ((juce::Time::getMillisecondCounter() - lastEditTime) < ConsolidationIdleTime)) return;
+		Range64 span = WaveCutListConsolidator::findFragmentedSpan(waveCutList, waveFormat.sampleRate);
+		if(span.isEmpty())
+		{
+			consolidationSettled = true;
+			return;
+		}
+		consolidationJob = std::make_unique<WaveConsolidationJob>(span, waveCutList.intersectRange(span));
+		consolidationPool.addJob(consolidationJob.get(), false);
+	}
+	// the samples stay the same, so the undo history and the changed flag are left alone; a span edited meanwhile is dropped
+	void applyConsolidation(const WaveConsolidationJob& job)
+	{
+		WAVE_TRACE_SCOPE("edit", "WaveCutListDocument::applyConsolidation");
+		if(job.consolidatedCutList.empty())
+		{
+			consolidationSettled = true;
+			return;
+		}
+		if(totalLength < job.span.end) return;
+		WaveCutList clnow = waveCutList.intersectRange(job.span);
+		bool unchanged = std::equal(clnow.begin(), clnow.end(), job.spanCutList.begin(), job.spanCutList.end(), [](const WaveCut& a, const WaveCut& b)
+		{
+			return (a.sourceFile == b.sourceFile) && (a.range.begin == b.range.begin) && (a.range.end == b.range.end);
+		});
+		if(!unchanged) return;
+		waveCutList.eraseRange(job.span);
+		waveCutList.insertList(job.consolidatedCutList, job.span.begin);
+		jassert(totalLength == waveCutList.calcTotalSize());
+		listenrList.call(&Listener::waveCutListDocumentDidEdit, this, EditConsolidate, job.span);
+		DBG("[WaveCutListDocument] consolidated: cuts=" << (int)job.spanCutList.size() << " span=" << job.span.begin << "-" << job.span.end << " cutlistsize=" << (int)waveCutList.size());
+	}
 	// --------------------------------------------------------------------------------
 	virtual void addListener(Listener* v) override
 	{
@@ -220,6 +560,10 @@ public:
 	{
 		return totalLength;
 	}
+	virtual int64_t getUndoHistoryCost() const override
+	{
+		return (int64_t)undoManager.getNumberOfUnitsTakenUpByStoredCommands() << 10;
+	}
 	virtual bool canUndo() const override
 	{
 		return hasValidContent() && undoManager.canUndo();
@@ -232,6 +576,10 @@ public:
 	{
 		return hasValidContent() && !r.isEmpty() && r.intersects({ 0, totalLength });
 	}
+	virtual bool canEraseRanges(const std::vector<Range64>& ranges) const override
+	{
+		return hasValidContent() && !WaveCutList::normalizeRanges(ranges, totalLength).empty();
+	}
 	virtual bool canCut(const Range64& r) const override
 	{
 		return hasValidContent() && !r.isEmpty() && r.intersects({ 0, totalLength });
@@ -256,121 +604,243 @@ public:
 	{
 		return hasValidContent() && !r.isEmpty() && r.intersects({ 0, totalLength });
 	}
+	virtual bool canNormalize(const Range64& r) const override
+	{
+		return hasValidContent() && !r.isEmpty() && r.intersects({ 0, totalLength });
+	}
+	virtual bool canApplyEffect(const Range64& r) const override
+	{
+		return hasValidContent() && !r.isEmpty() && r.intersects({ 0, totalLength });
+	}
 	// --------------------------------------------------------------------------------
 	virtual bool undo() override
 	{
+		WAVE_TRACE_SCOPE("edit", "WaveCutListDocument::undo");
 		if(!canUndo()) return false;
-		switchToTempBasedCutList();
-		if(!undoManager.undo()) return false;
+		if(!undoStep()) return false;
 		waveCutList.mergeAdjucentContinuousCuts();
 		totalLength = waveCutList.calcTotalSize();
-		listenrList.call(&Listener::waveCutListDocumentDidEdit, this, EditUnknown, Range64{ 0, totalLength });
+		didEdit(EditUnknown, Range64{ 0, totalLength });
 		changed();
 		DBG("[WaveCutListDocument] edit-undo: cutlistsize=" << (int)waveCutList.size() << " totallength=" << totalLength);
+		writeJournalEdit(WaveJournal::Edit::Undo);
 		return true;
 	}
 	virtual bool redo() override
 	{
+		WAVE_TRACE_SCOPE("edit", "WaveCutListDocument::redo");
 		if(!canRedo()) return false;
-		switchToTempBasedCutList();
-		if(!undoManager.redo()) return false;
+		if(!redoStep()) return false;
 		waveCutList.mergeAdjucentContinuousCuts();
 		totalLength = waveCutList.calcTotalSize();
-		listenrList.call(&Listener::waveCutListDocumentDidEdit, this, EditUnknown, Range64{ 0, totalLength });
+		didEdit(EditUnknown, Range64{ 0, totalLength });
 		changed();
 		DBG("[WaveCutListDocument] edit-redo: cutlistsize=" << (int)waveCutList.size() << " totallength=" << totalLength);
+		writeJournalEdit(WaveJournal::Edit::Redo);
 		return true;
 	}
 	virtual bool erase(const Range64& r) override
 	{
+		WAVE_TRACE_SCOPE("edit", "WaveCutListDocument::erase");
 		if(!canErase(r)) return false;
-		switchToTempBasedCutList();
-		ScopedUndoTransaction sut(undoManager, "erase");
-		if(!undoManager.perform(new WaveEraseUndoAction(waveCutList, r))) return false;
+		ScopedUndoTransaction sut(*this, "erase");
+		if(!performUndoAction(new WaveEraseUndoAction(waveCutList, r))) return false;
 		waveCutList.mergeAdjucentContinuousCuts();
 		totalLength = waveCutList.calcTotalSize();
-		listenrList.call(&Listener::waveCutListDocumentDidEdit, this, EditErase, r);
+		didEdit(EditErase, r);
 		changed();
 		DBG("[WaveCutListDocument] edit-erase: cutlistsize=" << (int)waveCutList.size() << " totallength=" << totalLength);
+		writeJournalEdit(WaveJournal::Edit::Erase, "erase", r);
+		return true;
+	}
+	virtual bool eraseRanges(const std::vector<Range64>& ranges) override
+	{
+		WAVE_TRACE_SCOPE("edit", "WaveCutListDocument::eraseRanges");
+		if(!hasValidContent()) return false;
+		std::vector<Range64> rs = WaveCutList::normalizeRanges(ranges, totalLength);
+		if(rs.empty()) return false;
+		// one pass, one merge, one undo step and one notification, however many ranges
+		ScopedUndoTransaction sut(*this, "erase");
+		if(!performUndoAction(new WaveEraseRangesUndoAction(waveCutList, rs))) return false;
+		waveCutList.mergeAdjucentContinuousCuts();
+		totalLength = waveCutList.calcTotalSize();
+		didEdit(EditErase, Range64{ rs.front().begin, rs.front().begin });
+		changed();
+		DBG("[WaveCutListDocument] edit-eraseranges: numranges=" << (int)rs.size() << " cutlistsize=" << (int)waveCutList.size() << " totallength=" << totalLength);
+		WaveJournal::Edit e{ WaveJournal::Edit::EraseRanges, "erase" };
+		e.ranges = std::move(rs);
+		writeJournalEdit(e);
 		return true;
 	}
 	virtual bool cut(const Range64& r) override
 	{
+		WAVE_TRACE_SCOPE("edit", "WaveCutListDocument::cut");
 		if(!canCut(r)) return false;
-		switchToTempBasedCutList();
 		clipboard->setCutList(waveCutList.intersectRange(r));
-		ScopedUndoTransaction sut(undoManager, "cut");
-		if(!undoManager.perform(new WaveEraseUndoAction(waveCutList, r))) return false;
+		ScopedUndoTransaction sut(*this, "cut");
+		if(!performUndoAction(new WaveEraseUndoAction(waveCutList, r))) return false;
 		waveCutList.mergeAdjucentContinuousCuts();
 		totalLength = waveCutList.calcTotalSize();
-		listenrList.call(&Listener::waveCutListDocumentDidEdit, this, EditErase, r);
+		didEdit(EditErase, r);
 		changed();
 		DBG("[WaveCutListDocument] edit-cut: cutlistsize=" << (int)waveCutList.size() << " totallength=" << totalLength);
+		writeJournalEdit(WaveJournal::Edit::Erase, "cut", r);
 		return true;
 	}
 	virtual bool copy(const Range64& r) override
 	{
+		WAVE_TRACE_SCOPE("edit", "WaveCutListDocument::copy");
 		if(!canCopy(r)) return false;
-		switchToTempBasedCutList();
 		clipboard->setCutList(waveCutList.intersectRange(r));
 		return true;
 	}
 	virtual bool paste(int64_t t) override
 	{
+		WAVE_TRACE_SCOPE("edit", "WaveCutListDocument::paste");
 		if(!canPaste(t)) return false;
-		switchToTempBasedCutList();
-		ScopedUndoTransaction sut(undoManager, "paste");
+		ScopedUndoTransaction sut(*this, "paste");
 		const WaveCutList& clins = clipboard->getCutList();
-		if(!undoManager.perform(new WaveInsertUndoAction(waveCutList, clins, t))) return false;
+		if(!performUndoAction(new WaveInsertUndoAction(waveCutList, clins, t))) return false;
 		waveCutList.mergeAdjucentContinuousCuts();
 		totalLength = waveCutList.calcTotalSize();
-		listenrList.call(&Listener::waveCutListDocumentDidEdit, this, EditInsert, Range64{ t, t + clins.calcTotalSize() });
+		didEdit(EditInsert, Range64{ t, t + clins.calcTotalSize() });
 		changed();
 		DBG("[WaveCutListDocument] edit-paste: cutlistsize=" << (int)waveCutList.size() << " totallength=" << totalLength);
+		writeJournalEdit(WaveJournal::Edit::Insert, "paste", { t, t }, clins);
 		return true;
 	}
 	virtual bool fadein(const Range64& r) override
 	{
+		WAVE_TRACE_SCOPE("edit", "WaveCutListDocument::fadein");
 		if(!canFadein(r)) return false;
-		switchToTempBasedCutList();
 		WaveCutList clramp = WaveCutListModifier::processSyncWithRamp(waveCutList, r, 0, 1);
-		ScopedUndoTransaction sut(undoManager, "fadein");
-		if(!undoManager.perform(new WaveEraseUndoAction(waveCutList, r))) return false;
-		if(!undoManager.perform(new WaveInsertUndoAction(waveCutList, clramp, r.begin))) return false;
+		if(clramp.empty()) return false;
+		ScopedUndoTransaction sut(*this, "fadein");
+		if(!performUndoAction(new WaveEraseUndoAction(waveCutList, r))) return false;
+		if(!performUndoAction(new WaveInsertUndoAction(waveCutList, clramp, r.begin))) return false;
 		jassert(totalLength == waveCutList.calcTotalSize());
-		listenrList.call(&Listener::waveCutListDocumentDidEdit, this, EditReplace, r);
+		didEdit(EditReplace, r);
 		changed();
 		DBG("[WaveCutListDocument] edit-fadein: cutlistsize=" << (int)waveCutList.size() << " totallength=" << totalLength);
+		writeJournalEdit(WaveJournal::Edit::Replace, "fadein", r, clramp);
 		return false;
 	}
 	virtual bool fadeout(const Range64& r) override
 	{
+		WAVE_TRACE_SCOPE("edit", "WaveCutListDocument::fadeout");
 		if(!canFadeout(r)) return false;
-		switchToTempBasedCutList();
 		WaveCutList clramp = WaveCutListModifier::processSyncWithRamp(waveCutList, r, 1, 0);
-		ScopedUndoTransaction sut(undoManager, "fadeout");
-		if(!undoManager.perform(new WaveEraseUndoAction(waveCutList, r))) return false;
-		if(!undoManager.perform(new WaveInsertUndoAction(waveCutList, clramp, r.begin))) return false;
+		if(clramp.empty()) return false;
+		ScopedUndoTransaction sut(*this, "fadeout");
+		if(!performUndoAction(new WaveEraseUndoAction(waveCutList, r))) return false;
+		if(!performUndoAction(new WaveInsertUndoAction(waveCutList, clramp, r.begin))) return false;
 		jassert(totalLength == waveCutList.calcTotalSize());
-		listenrList.call(&Listener::waveCutListDocumentDidEdit, this, EditReplace, r);
+		didEdit(EditReplace, r);
 		changed();
 		DBG("[WaveCutListDocument] edit-fadeout: cutlistsize=" << (int)waveCutList.size() << " totallength=" << totalLength);
+		writeJournalEdit(WaveJournal::Edit::Replace, "fadeout", r, clramp);
 		return false;
 	}
 	virtual bool mute(const Range64& r) override
 	{
+		WAVE_TRACE_SCOPE("edit", "WaveCutListDocument::mute");
 		if(!canFadeout(r)) return false;
-		switchToTempBasedCutList();
 		WaveCutList clramp = WaveCutListModifier::processSyncWithRamp(waveCutList, r, 0, 0);
-		ScopedUndoTransaction sut(undoManager, "mute");
-		if(!undoManager.perform(new WaveEraseUndoAction(waveCutList, r))) return false;
-		if(!undoManager.perform(new WaveInsertUndoAction(waveCutList, clramp, r.begin))) return false;
+		if(clramp.empty()) return false;
+		ScopedUndoTransaction sut(*this, "mute");
+		if(!performUndoAction(new WaveEraseUndoAction(waveCutList, r))) return false;
+		if(!performUndoAction(new WaveInsertUndoAction(waveCutList, clramp, r.begin))) return false;
 		jassert(totalLength == waveCutList.calcTotalSize());
-		listenrList.call(&Listener::waveCutListDocumentDidEdit, this, EditReplace, r);
+		didEdit(EditReplace, r);
 		changed();
 		DBG("[WaveCutListDocument] edit-mute: cutlistsize=" << (int)waveCutList.size() << " totallength=" << totalLength);
+		writeJournalEdit(WaveJournal::Edit::Replace, "mute", r, clramp);
 		return false;
 	}
+	virtual bool normalize(const Range64& r, float gain) override
+	{
+		WAVE_TRACE_SCOPE("edit", "WaveCutListDocument::normalize");
+		if(!canNormalize(r)) return false;
+		return applyGain(r.intersection(0, totalLength), gain, "normalize");
+	}
+	virtual bool applyEffect(const Range64& r, const WaveEffectChain& chain) override
+	{
+		WAVE_TRACE_SCOPE("edit", "WaveCutListDocument::applyEffect");
+		if(!canApplyEffect(r) || chain.isEmpty()) return false;
+		Range64 rx = r.intersection(0, totalLength);
+		return replaceRange(rx, chain.render(waveCutList, rx), "effect");
+	}
+	bool applyGain(const Range64& r, float gain, const juce::String& name)
+	{
+		// within a hundredth of a dB the render would only add a generation of rounding
+		if(std::abs(juce::Decibels::gainToDecibels(gain)) < MinGainChangeDb) return false;
+		DBG("[WaveCutListDocument] applyGain() gain=" << juce::Decibels::gainToDecibels(gain) << "dB");
+		return replaceRange(r, WaveCutListModifier::processParallelWithGain(waveCutList, r, gain), name);
+	}
+	// the range by its render of the same length, as one undo step
+	bool replaceRange(const Range64& r, const WaveCutList& clnew, const juce::String& name)
+	{
+		if(clnew.empty()) return false;
+		ScopedUndoTransaction sut(*this, name);
+		if(!performUndoAction(new WaveEraseUndoAction(waveCutList, r))) return false;
+		if(!performUndoAction(new WaveInsertUndoAction(waveCutList, clnew, r.begin))) return false;
+		jassert(totalLength == waveCutList.calcTotalSize());
+		didEdit(EditReplace, r);
+		changed();
+		DBG("[WaveCutListDocument] edit-" << name << ": cutlistsize=" << (int)waveCutList.size() << " totallength=" << totalLength);
+		writeJournalEdit(WaveJournal::Edit::Replace, name, r, clnew);
+		return true;
+	}
+	// --------------------------------------------------------------------------------
+	virtual void setJournalingEnabled(bool e) override
+	{
+		if(e == (journal != nullptr)) return;
+		if(!e)
+		{
+			journal = nullptr;
+			return;
+		}
+		journal = WaveJournal::createInstance();
+		writeJournalCheckpoint(getFile(), hasChangedSinceSaved());
+	}
+	virtual juce::Result recoverFromJournal(const juce::File& file) override
+	{
+		WAVE_TRACE_SCOPE("io", "WaveCutListDocument::recoverFromJournal");
+		clearContents();
+		WaveJournal::Recovery recovery;
+		juce::Result r = WaveJournal::read(audioFormatManager, file, recovery);
+		if(r.wasOk())
+		{
+			restoreContent(recovery.checkpoint);
+			for(const WaveJournal::Edit& e : recovery.edits)
+			{
+				if(replayJournalEdit(e)) continue;
+				r = juce::Result::fail("failed to replay " + e.name.quoted());
+				break;
+			}
+		}
+		if(r.wasOk())
+		{
+			// the renders of the crashed session become this one's only now, before the checkpoint refers to them by their new names
+			for(const WaveSourceFile::Ptr& src : recovery.sources)
+			{
+				if(TemporaryWaveSourceFile* tmp = dynamic_cast<TemporaryWaveSourceFile*>(src.get())) tmp->adopt();
+			}
+			totalLength = waveCutList.calcTotalSize();
+			setFile(recovery.documentFile);
+			setChangedFlag(recovery.changed);
+			DBG("[WaveCutListDocument] recoverFromJournal() totalLength=" << totalLength << " edits=" << (int)recovery.edits.size());
+			writeJournalCheckpoint(recovery.documentFile, recovery.changed);
+		}
+		else
+		{
+			clearContents();
+			DBG("[WaveCutListDocument] recoverFromJournal() " << r.getErrorMessage().quoted());
+		}
+		listenrList.call(&Listener::waveCutListDocumentDidInit, this);
+		sendChangeMessage();
+		return r;
+	}
 };
 
 WaveCutListDocument* WaveCutListDocument::createInstance(juce::AudioFormatManager& afm)
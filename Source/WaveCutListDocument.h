@@ -9,6 +9,7 @@
 
 #include <JuceHeader.h>
 #include "WaveCutList.h"
+#include "WaveEffect.h"
 
 class WaveCutListDocument : public juce::FileBasedDocument
 {
@@ -21,12 +22,12 @@ public:
 		EditInsert,
 		EditErase,
 		EditReplace,
+		EditConsolidate,	// the same samples in fewer cuts
 	};
 	struct Listener
 	{
 		virtual ~Listener() {}
 		virtual void waveCutListDocumentDidInit(WaveCutListDocument*) = 0;
-		virtual void waveCutListDocumentDidReplaceSourceFile(WaveCutListDocument*, WaveSourceFile::Ptr prevsrcfile, WaveSourceFile::Ptr newsrcfile) = 0;
 		virtual void waveCutListDocumentDidEdit(WaveCutListDocument*, int edittype, const Range64& r) = 0;
 	};
 	virtual void addListener(Listener*) = 0;
@@ -35,23 +36,38 @@ public:
 	virtual WaveFormat getWaveFormat() const = 0;
 	virtual const WaveCutList& getWaveCutlist() const = 0;
 	virtual int64_t getTotalLength() const = 0;
+	// the bytes of memory and temporary storage the undo history pins, capped by TemporaryWaveSourceFile::getStorageQuota()
+	virtual int64_t getUndoHistoryCost() const = 0;
 	virtual bool canUndo() const = 0;
 	virtual bool canRedo() const = 0;
 	virtual bool canErase(const Range64& r) const = 0;
+	virtual bool canEraseRanges(const std::vector<Range64>& ranges) const = 0;
 	virtual bool canCut(const Range64& r) const = 0;
 	virtual bool canCopy(const Range64& r) const = 0;
 	virtual bool canPaste(int64_t t) const = 0;
 	virtual bool canFadein(const Range64& r) const = 0;
 	virtual bool canFadeout(const Range64& r) const = 0;
 	virtual bool canMute(const Range64& r) const = 0;
+	virtual bool canNormalize(const Range64& r) const = 0;
+	virtual bool canApplyEffect(const Range64& r) const = 0;
 	virtual bool undo() = 0;
 	virtual bool redo() = 0;
 	virtual bool erase(const Range64& r) = 0;
+	// erases the ranges, given in the positions before the edit and in any order, as a single undo step with a single notification
+	virtual bool eraseRanges(const std::vector<Range64>& ranges) = 0;
 	virtual bool cut(const Range64& r) = 0;
 	virtual bool copy(const Range64& r) = 0;
 	virtual bool paste(int64_t t) = 0;
 	virtual bool fadein(const Range64& r) = 0;
 	virtual bool fadeout(const Range64& r) = 0;
 	virtual bool mute(const Range64& r) = 0;
+	// renders the range at a gain measured by WaveNormalizer, whose measurement blocks and so is left to the caller; false if the gain is close to unity
+	virtual bool normalize(const Range64& r, float gain) = 0;
+	// renders the range through the chain, in parallel chunks
+	virtual bool applyEffect(const Range64& r, const WaveEffectChain& chain) = 0;
+	// records the edits in a journal in the temporary directory, which outlives a crash and is deleted with the document
+	virtual void setJournalingEnabled(bool e) = 0;
+	// rebuilds the content, the undo history and the unsaved edits of the session that left the journal
+	virtual juce::Result recoverFromJournal(const juce::File& file) = 0;
 	static WaveCutListDocument* createInstance(juce::AudioFormatManager& afm);
 };
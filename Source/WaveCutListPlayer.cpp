@@ -6,14 +6,109 @@
 //
 
 #include "WaveCutListPlayer.h"
+#include "WaveScrubber.h"
+
+// the samples around the loop seam, read ahead off the audio thread so that wrapping costs neither a seek nor a disk read
+struct WaveLoopImage
+{
+	static constexpr int HeadLength = 65536;		// samples after the loop start held in memory
+	static constexpr int CrossfadeLength = 512;
+	Range64 range{};
+	// [range.begin, range.begin + headLength) is served from head
+	juce::AudioSampleBuffer head;
+	int headLength = 0;
+	// [range.end - seamLength, range.end) is served from seam, already crossfaded into the audio before range.begin
+	juce::AudioSampleBuffer seam;
+	int seamLength = 0;
+	// after a wrap, [range.begin, range.begin + entryLength) is served from entry, the audio after range.end already crossfaded into the head
+	// it stands in for the seam where there is less audio before the loop start than after the loop end, e.g. for a loop from the very start
+	juce::AudioSampleBuffer entry;
+	int entryLength = 0;
+	// equal-power fade from a into b, written to a
+	static void applyCrossfade(juce::AudioSampleBuffer& a, const juce::AudioSampleBuffer& b, int cch, int lx)
+	{
+		for(int i = 0; i < lx; ++i)
+		{
+			double w = juce::MathConstants<double>::halfPi * ((double)i + 0.5) / (double)lx;
+			float gout = (float)std::cos(w), gin = (float)std::sin(w);
+			for(int ich = 0; ich < cch; ++ich) a.setSample(ich, i, a.getSample(ich, i) * gout + b.getSample(ich, i) * gin);
+		}
+	}
+	static std::unique_ptr<WaveLoopImage> createInstance(const WaveCutList& cl, const Range64& r, bool crossfade)
+	{
+		if(cl.empty() || r.isEmpty()) return nullptr;
+		int cch = cl.front().sourceFile->format.numChannels;
+		WaveCutListReader::Ptr reader = WaveCutListReader::createInstance(true);
+		reader->setWaveCutList(cl);
+		std::unique_ptr<WaveLoopImage> img = std::make_unique<WaveLoopImage>();
+		img->range = r;
+		int64_t lfade = crossfade ? std::min((int64_t)CrossfadeLength, r.size() / 4) : 0;
+		int lpre = (int)std::min(lfade, r.begin);
+		int lpost = (int)std::min(lfade, reader->getTotalLength() - r.end);
+		if(lpre < lpost) img->entryLength = lpost;
+		else img->seamLength = lpre;
+		img->headLength = (int)std::min((int64_t)HeadLength, r.size() - img->seamLength);
+		img->head.setSize(cch, std::max(1, img->headLength));
+		reader->setPosition(r.begin);
+		if(!reader->read(img->head.getArrayOfWritePointers(), cch, img->headLength)) return nullptr;
+		if(0 < img->seamLength)
+		{
+			int lx = img->seamLength;
+			juce::AudioSampleBuffer lead(cch, lx);
+			img->seam.setSize(cch, lx);
+			reader->setPosition(r.end - lx);
+			if(!reader->read(img->seam.getArrayOfWritePointers(), cch, lx)) return nullptr;
+			reader->setPosition(r.begin - lx);
+			if(!reader->read(lead.getArrayOfWritePointers(), cch, lx)) return nullptr;
+			// from the loop end into the audio leading to the loop start
+			applyCrossfade(img->seam, lead, cch, lx);
+		}
+		if(0 < img->entryLength)
+		{
+			int lx = img->entryLength;
+			img->entry.setSize(cch, lx);
+			reader->setPosition(r.end);
+			if(!reader->read(img->entry.getArrayOfWritePointers(), cch, lx)) return nullptr;
+			// from the audio following the loop end into the loop start
+			applyCrossfade(img->entry, img->head, cch, lx);
+		}
+		return img;
+	}
+};
+
+// builds a loop image off the message thread, from a copy of the cuts
+class WaveLoopImageJob : public juce::ThreadPoolJob
+{
+public:
+	WaveCutList cutList;
+	Range64 range;
+	bool crossfade;
+	uint32_t generation;
+	std::unique_ptr<WaveLoopImage> image;
+	WaveLoopImageJob(const WaveCutList& cl, const Range64& r, bool xf, uint32_t gen) : juce::ThreadPoolJob("WaveLoopImage"), cutList(cl), range(r), crossfade(xf), generation(gen)
+	{
+	}
+	virtual JobStatus runJob() override
+	{
+		image = WaveLoopImage::createInstance(cutList, range, crossfade);
+		return jobHasFinished;
+	}
+};
 
 class WaveCutListAudioSource : public juce::AudioSource
 {
 public:
 	WaveCutListReader::Ptr cutListReader;
 	juce::AudioSampleBuffer readBuffer;
+	std::unique_ptr<WaveLoopImage> loopImage;
+	Range64 loopRange{}; // empty for the whole list
 	int maxBufferSize = 0;
 	bool looping = true;
+	int64_t position = 0;
+	bool wrapped = false; // the position came to the loop start from the loop end, the entry of the image applies
+	// accumulated by the reads from the source files, the audio callback takes them after each block
+	double readTime = 0;
+	int64_t readFailures = 0;
 	WaveCutListAudioSource()
 	{
 		cutListReader = WaveCutListReader::createInstance();
@@ -24,6 +119,62 @@ public:
 		int cch = !cl.empty() ? cl.front().sourceFile->format.numChannels : 0;
 		readBuffer.setSize(cch, maxBufferSize);
 	}
+	Range64 getLoopRange() const
+	{
+		int64_t len = cutListReader->getTotalLength();
+		return (loopRange.isEmpty() || (len < loopRange.end)) ? Range64{ 0, len } : loopRange;
+	}
+	// the loop wraps without the image until one of its range is swapped in
+	const WaveLoopImage* getLoopImage() const
+	{
+		Range64 lr = getLoopRange();
+		return (looping && loopImage && (loopImage->range.begin == lr.begin) && (loopImage->range.end == lr.end)) ? loopImage.get() : nullptr;
+	}
+	// reads [position, position + len) where the range does not cross a boundary of the loop image
+	void readSegment(int cch, int len)
+	{
+		Range64 lr = getLoopRange();
+		const WaveLoopImage* img = getLoopImage();
+		if(img && wrapped && (lr.begin <= position) && (position < lr.begin + img->entryLength))
+		{
+			for(int ich = 0; ich < cch; ++ich) readBuffer.copyFrom(ich, 0, img->entry, ich, (int)(position - lr.begin), len);
+		}
+		else if(img && (lr.begin <= position) && (position < lr.begin + img->headLength))
+		{
+			for(int ich = 0; ich < cch; ++ich) readBuffer.copyFrom(ich, 0, img->head, ich, (int)(position - lr.begin), len);
+		}
+		else if(img && (lr.end - img->seamLength <= position) && (position < lr.end))
+		{
+			for(int ich = 0; ich < cch; ++ich) readBuffer.copyFrom(ich, 0, img->seam, ich, (int)(position - (lr.end - img->seamLength)), len);
+		}
+		else
+		{
+			// the seek is a binary search over the cuts, the data after the head was read ahead by the OS when the head was loaded
+			if(cutListReader->getPosition() != position) cutListReader->setPosition(position);
+			int64_t t0 = juce::Time::getHighResolutionTicks();
+			if(!cutListReader->read(readBuffer.getArrayOfWritePointers(), cch, len))
+			{
+				// the reader stops at the source that failed, the rest of the block is stale; the next block seeks again
+				readBuffer.clear(0, len);
+				++readFailures;
+			}
+			readTime += juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - t0);
+		}
+	}
+	int calcSegmentLength(int64_t limit) const
+	{
+		// the next boundary: the end of the entry, the end of the head, the start of the seam or the limit
+		Range64 lr = getLoopRange();
+		int64_t end = limit;
+		if(const WaveLoopImage* img = getLoopImage())
+		{
+			int64_t entryend = lr.begin + img->entryLength, headend = lr.begin + img->headLength, seambegin = lr.end - img->seamLength;
+			if(wrapped && (lr.begin <= position) && (position < entryend)) end = std::min(end, entryend);
+			if((lr.begin <= position) && (position < headend)) end = std::min(end, headend);
+			if(position < seambegin) end = std::min(end, seambegin);
+		}
+		return (int)std::min(end - position, (int64_t)readBuffer.getNumSamples());
+	}
 	// juce::AudioSource
 	virtual void prepareToPlay(int lbuf, double) override
 	{
@@ -41,39 +192,58 @@ public:
 		int ccho = asci.buffer->getNumChannels();
 		int pos = 0; while(pos < asci.numSamples)
 		{
-			int64_t slen = cutListReader->getTotalLength(), spos = cutListReader->getPosition();
+			int64_t slen = cutListReader->getTotalLength();
 			if(slen <= 0) break;
-			int lseg = (int)std::min(slen - spos, (int64_t)std::min(asci.numSamples - pos, readBuffer.getNumSamples()));
-			cutListReader->read(readBuffer.getArrayOfWritePointers(), cchb, lseg);
-			for(int cch = std::min(cchb, ccho), ich = 0; ich < cch; ++ich)
+			Range64 lr = getLoopRange();
+			if(looping && (lr.end <= position))
 			{
-				asci.buffer->copyFrom(ich, asci.startSample + pos, readBuffer, ich, 0, lseg);
+				position = lr.begin;
+				wrapped = true;
 			}
-			if(slen <= (spos + lseg))
+			if(!looping && (slen <= position)) break;
+			int64_t limit = looping ? lr.end : slen;
+			int lseg = std::min(asci.numSamples - pos, calcSegmentLength(limit));
+			if(lseg <= 0) break;
+			readSegment(cchb, lseg);
+			for(int cch = std::min(cchb, ccho), ich = 0; ich < cch; ++ich)
 			{
-				if(looping) cutListReader->setPosition(0);
-				else break;
+				asci.buffer->copyFrom(ich, asci.startSample + pos, readBuffer, ich, 0, lseg);
 			}
+			position += lseg;
 			pos += lseg;
+			const WaveLoopImage* img = getLoopImage();
+			if(!img || (lr.begin + img->entryLength <= position)) wrapped = false;
 		}
 	}
 	// APIs
 	void setWaveCutList(const WaveCutList& v)
 	{
 		cutListReader->setWaveCutList(v);
+		position = std::min(position, cutListReader->getTotalLength());
 		prepareReadBuffer();
 	}
+	void setLoopRange(const Range64& v)
+	{
+		loopRange = v;
+	}
+	// swaps the image in, so that the caller releases the previous one outside the callback lock
+	void swapLoopImage(std::unique_ptr<WaveLoopImage>& img)
+	{
+		std::swap(loopImage, img);
+		wrapped = false;
+	}
 	int64_t getLength() const
 	{
 		return cutListReader->getTotalLength();
 	}
 	int64_t getPosition() const
 	{
-		return cutListReader->getPosition();
+		return position;
 	}
 	void setPosition(int64_t v)
 	{
-		cutListReader->setPosition(v);
+		position = std::max((int64_t)0, std::min(cutListReader->getTotalLength(), v));
+		wrapped = false;
 	}
 	bool isLooping() const
 	{
@@ -85,42 +255,199 @@ public:
 	}
 };
 
-class WaveCutListPlayerImpl : public WaveCutListPlayer, public juce::AsyncUpdater, public WaveCutListDocument::Listener, public juce::AudioIODeviceCallback
+// a seqlock: writers are serialized by the audio callback lock, readers retry while a write is in progress
+class PlayheadPublisher
+{
+public:
+	std::atomic<uint32_t> sequence{ 0 };
+	std::atomic<int64_t> position{ 0 };
+	std::atomic<double> timestamp{ 0 };
+	std::atomic<double> sampleRate{ 0 };
+	std::atomic<int64_t> length{ 0 };
+	std::atomic<int64_t> loopBegin{ 0 };
+	std::atomic<int64_t> loopEnd{ 0 };
+	std::atomic<bool> looping{ false };
+	void publish(const WaveCutListPlayer::Playhead& v)
+	{
+		uint32_t seq = sequence.load(std::memory_order_relaxed);
+		sequence.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		position.store(v.position, std::memory_order_relaxed);
+		timestamp.store(v.timestamp, std::memory_order_relaxed);
+		sampleRate.store(v.sampleRate, std::memory_order_relaxed);
+		length.store(v.length, std::memory_order_relaxed);
+		loopBegin.store(v.loopRange.begin, std::memory_order_relaxed);
+		loopEnd.store(v.loopRange.end, std::memory_order_relaxed);
+		looping.store(v.looping, std::memory_order_relaxed);
+		sequence.store(seq + 2, std::memory_order_release);
+	}
+	WaveCutListPlayer::Playhead read() const
+	{
+		WaveCutListPlayer::Playhead v;
+		for(;;)
+		{
+			uint32_t seq = sequence.load(std::memory_order_acquire);
+			if(seq & 1) continue;
+			v.position = position.load(std::memory_order_relaxed);
+			v.timestamp = timestamp.load(std::memory_order_relaxed);
+			v.sampleRate = sampleRate.load(std::memory_order_relaxed);
+			v.length = length.load(std::memory_order_relaxed);
+			v.loopRange = { loopBegin.load(std::memory_order_relaxed), loopEnd.load(std::memory_order_relaxed) };
+			v.looping = looping.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(sequence.load(std::memory_order_relaxed) == seq) return v;
+		}
+	}
+};
+
+class WaveCutListPlayerImpl : public WaveCutListPlayer, public juce::AsyncUpdater, public WaveCutListDocument::Listener, public juce::AudioIODeviceCallback, private juce::Timer
 {
 public:
+	static constexpr int LoopImagePollInterval = 20; // ms
 	juce::AudioDeviceManager& audioDeviceManager;
 	WaveCutListDocument& document;
 	std::unique_ptr<WaveCutListAudioSource> cutListAudioSource;
-	std::unique_ptr<juce::ResamplingAudioSource> resamplingAudioSource;
+	std::unique_ptr<WaveResampler> resampler;
+	std::unique_ptr<WaveScrubber> scrubber;
+	std::unique_ptr<WaveLevelMeter> levelMeter;
+	bool scrubbing = false;
+	Range64 loopRange{};	// empty loops the whole list
+	bool loopingSelection = false;
+	bool loopCrossfading = true;
+	// the images for the loop range are built one at a time on a worker; the requests made meanwhile collapse into one for the latest range
+	juce::ThreadPool loopImagePool{ 1 };
+	std::unique_ptr<WaveLoopImageJob> loopImageJob;
+	bool loopImagePending = false;
+	uint32_t loopImageGeneration = 0; // advanced by the edits, which discard the images of the previous cuts, those in flight included
+	double deviceSampleRate = 0;
+	WaveResampler::Quality resamplingQuality = WaveResampler::QualityNormal;
 	WaveFormat waveFormat = {};
 	bool running = false;
+	PlayheadPublisher playheadPublisher;
+	WavePlaybackDiagnostics diagnostics;
+	double outputLatency = 0; // ms
 	WaveCutListPlayerImpl(juce::AudioDeviceManager& adm, WaveCutListDocument& doc) : audioDeviceManager(adm), document(doc)
 	{
 		cutListAudioSource = std::make_unique<WaveCutListAudioSource>();
+		scrubber = WaveScrubber::createInstance();
+		levelMeter = WaveLevelMeter::createInstance();
 		updateContent();
 		document.addListener(this);
 		audioDeviceManager.addAudioCallback(this);
 	}
 	virtual ~WaveCutListPlayerImpl()
 	{
+		stopTimer();
+		loopImagePool.removeAllJobs(true, 4000);
 		audioDeviceManager.removeAudioCallback(this);
 		document.removeListener(this);
 	}
+	static double calcResamplingRatio(double fssrc, double fsdev)
+	{
+		return ((0 < fsdev) && (0 < fssrc)) ? (fssrc / fsdev) : 1;
+	}
+	// built before the callback lock is taken, so that the audio thread only waits for the swap; nullptr if the resampler has it already
+	std::unique_ptr<WaveResampler::Kernel> createResamplerKernel(WaveResampler::Quality q, double fssrc) const
+	{
+		if(!resampler) return nullptr;
+		juce::AudioIODevice* dev = audioDeviceManager.getCurrentAudioDevice();
+		double ratio = calcResamplingRatio(fssrc, dev ? dev->getCurrentSampleRate() : 0);
+		if((resampler->getQuality() == q) && (resampler->getResamplingRatio() == ratio)) return nullptr;
+		return WaveResampler::createKernel(q, ratio);
+	}
+	// the image of the previous cuts is dropped with them, the new one follows from the pool while the loop wraps without one
 	void updateContent()
 	{
-		juce::ScopedLock sl(audioDeviceManager.getAudioCallbackLock());
-		waveFormat = document.getWaveFormat();
-		cutListAudioSource->setWaveCutList(document.getWaveCutlist());
-		if(resamplingAudioSource)
+		++loopImageGeneration;
+		std::unique_ptr<WaveLoopImage> img;
+		std::unique_ptr<WaveResampler::Kernel> kernel = createResamplerKernel(resamplingQuality, document.getWaveFormat().sampleRate);
 		{
-			juce::AudioIODevice* dev = audioDeviceManager.getCurrentAudioDevice();
-			double fsdev = dev ? dev->getCurrentSampleRate() : 0;
-			double fssrc = waveFormat.sampleRate;
-			double fsratio = ((0 < fsdev) && (0 < fssrc)) ? (fssrc / fsdev) : 1;
-			resamplingAudioSource->setResamplingRatio(fsratio);
-			resamplingAudioSource->flushBuffers();
+			juce::ScopedLock sl(audioDeviceManager.getAudioCallbackLock());
+			waveFormat = document.getWaveFormat();
+			cutListAudioSource->setWaveCutList(document.getWaveCutlist());
+			cutListAudioSource->setLoopRange(calcImageLoopRange());
+			cutListAudioSource->swapLoopImage(img);
+			scrubber->setWaveCutList(document.getWaveCutlist());
+			// the resampler keeps its history across edits so that playback continues without a discontinuity
+			if(resampler) resampler->swapKernel(kernel);
+			if(running && (cutListAudioSource->getLength() <= 0)) setRunning(false);
+			publishPlayhead();
 		}
-		if(running && (cutListAudioSource->getLength() <= 0)) setRunning(false);
+		updateLoopImage();
+	}
+	Range64 calcImageLoopRange() const
+	{
+		int64_t len = document.getTotalLength();
+		Range64 r = loopingSelection ? loopRange : Range64{};
+		if(r.isEmpty() || (len < r.end)) r = { 0, len };
+		return r;
+	}
+	// the range applies at once, its image follows
+	void updateLoopRange()
+	{
+		{
+			juce::ScopedLock sl(audioDeviceManager.getAudioCallbackLock());
+			cutListAudioSource->setLoopRange(calcImageLoopRange());
+			publishPlayhead();
+		}
+		updateLoopImage();
+	}
+	// called as often as the selection is dragged, so it only asks for an image; none is built while the playback does not loop
+	void updateLoopImage()
+	{
+		if(!cutListAudioSource->isLooping()) return;
+		loopImagePending = true;
+		startTimer(LoopImagePollInterval);
+		if(!loopImageJob) timerCallback();
+	}
+	// --------------------------------------------------------------------------------
+	// juce::Timer
+	virtual void timerCallback() override
+	{
+		if(loopImageJob)
+		{
+			if(loopImagePool.contains(loopImageJob.get())) return;
+			std::unique_ptr<WaveLoopImageJob> job = std::move(loopImageJob);
+			if(job->generation == loopImageGeneration)
+			{
+				{
+					juce::ScopedLock sl(audioDeviceManager.getAudioCallbackLock());
+					cutListAudioSource->swapLoopImage(job->image);
+					publishPlayhead();
+				}
+				sendChangeMessage();
+			}
+		}
+		if(!loopImagePending)
+		{
+			stopTimer();
+			return;
+		}
+		loopImagePending = false;
+		loopImageJob = std::make_unique<WaveLoopImageJob>(document.getWaveCutlist(), calcImageLoopRange(), loopCrossfading, loopImageGeneration);
+		loopImagePool.addJob(loopImageJob.get(), false);
+	}
+	// call it from the audio callback or with the callback lock held
+	void publishPlayhead()
+	{
+		Playhead ph;
+		ph.position = cutListAudioSource->getPosition();
+		ph.length = cutListAudioSource->getLength();
+		ph.loopRange = cutListAudioSource->getLoopRange();
+		ph.looping = cutListAudioSource->isLooping();
+		ph.timestamp = juce::Time::getMillisecondCounterHiRes();
+		if(scrubbing) ph.position = scrubber->getPosition();
+		else if(running && resampler)
+		{
+			// the resampler has read ahead of what reaches the device, and the device delays it further
+			int64_t pos = ph.position - (int64_t)std::ceil(resampler->getLookahead());
+			// the lookahead may reach back across the loop seam
+			if(ph.looping && (ph.loopRange.begin <= ph.position) && (pos < ph.loopRange.begin)) pos += ph.loopRange.size();
+			ph.position = std::max((int64_t)0, pos);
+			ph.timestamp += outputLatency;
+			ph.sampleRate = waveFormat.sampleRate;
+		}
+		playheadPublisher.publish(ph);
 	}
 	// --------------------------------------------------------------------------------
 	// WavePlayback
@@ -134,18 +461,26 @@ public:
 	}
 	virtual void setLooping(bool v) override
 	{
-		cutListAudioSource->setLooping(v);
+		{
+			juce::ScopedLock sl(audioDeviceManager.getAudioCallbackLock());
+			cutListAudioSource->setLooping(v);
+			publishPlayhead();
+		}
+		updateLoopImage();
 		sendChangeMessage();
 	}
 	virtual double getPosition() const override
 	{
-		return (0 < waveFormat.sampleRate) ? ((double)cutListAudioSource->getPosition() / waveFormat.sampleRate) : 0;
+		if(waveFormat.sampleRate <= 0) return 0;
+		return getPlayhead().getPositionAt(juce::Time::getMillisecondCounterHiRes()) / waveFormat.sampleRate;
 	}
 	virtual void setPosition(double v) override
 	{
 		juce::ScopedLock sl(audioDeviceManager.getAudioCallbackLock());
 		int64_t spos = (int64_t)(v * waveFormat.sampleRate);
 		cutListAudioSource->setPosition(spos);
+		if(resampler) resampler->flushBuffers();
+		publishPlayhead();
 		sendChangeMessage();
 	}
 	virtual bool isRunning() const override
@@ -155,10 +490,98 @@ public:
 	virtual void setRunning(bool v) override
 	{
 		juce::ScopedLock sl(audioDeviceManager.getAudioCallbackLock());
-		bool run = document.hasValidContent() ? v : false;
+		bool run = (document.hasValidContent() && !scrubbing) ? v : false;
 		if(run && (cutListAudioSource->getLength() <= cutListAudioSource->getPosition())) setPosition(0);
 		running = run;
-		if(!running && resamplingAudioSource) resamplingAudioSource->flushBuffers();
+		if(!running && resampler) resampler->flushBuffers();
+		publishPlayhead();
+		sendChangeMessage();
+	}
+	virtual Playhead getPlayhead() const override
+	{
+		return playheadPublisher.read();
+	}
+	virtual juce::Range<double> getLoopRange() const override
+	{
+		if(waveFormat.sampleRate <= 0) return {};
+		return { (double)loopRange.begin / waveFormat.sampleRate, (double)loopRange.end / waveFormat.sampleRate };
+	}
+	virtual void setLoopRange(const juce::Range<double>& v) override
+	{
+		Range64 r{ (int64_t)(v.getStart() * waveFormat.sampleRate), (int64_t)(v.getEnd() * waveFormat.sampleRate) };
+		if(r.isEmpty()) r = {};
+		if((r.begin == loopRange.begin) && (r.end == loopRange.end)) return;
+		loopRange = r;
+		if(loopingSelection) updateLoopRange();
+	}
+	virtual bool isLoopingSelection() const override
+	{
+		return loopingSelection;
+	}
+	virtual void setLoopingSelection(bool v) override
+	{
+		if(loopingSelection == v) return;
+		loopingSelection = v;
+		updateLoopRange();
+	}
+	virtual bool isLoopCrossfading() const override
+	{
+		return loopCrossfading;
+	}
+	virtual void setLoopCrossfading(bool v) override
+	{
+		if(loopCrossfading == v) return;
+		loopCrossfading = v;
+		updateLoopImage();
+	}
+	virtual WaveLevelMeter& getLevelMeter() override
+	{
+		return *levelMeter;
+	}
+	virtual WavePlaybackDiagnostics& getDiagnostics() override
+	{
+		return diagnostics;
+	}
+	virtual bool isScrubbing() const override
+	{
+		return scrubbing;
+	}
+	virtual void beginScrub(double t) override
+	{
+		juce::ScopedLock sl(audioDeviceManager.getAudioCallbackLock());
+		if(!document.hasValidContent()) return;
+		running = false;
+		if(resampler) resampler->flushBuffers();
+		scrubber->start((int64_t)(t * waveFormat.sampleRate));
+		scrubbing = true;
+		publishPlayhead();
+		sendChangeMessage();
+	}
+	virtual void scrub(double t) override
+	{
+		// lock-free, the audio callback picks the target up on its next block
+		if(scrubbing) scrubber->setTarget((int64_t)(t * waveFormat.sampleRate));
+	}
+	virtual void endScrub() override
+	{
+		juce::ScopedLock sl(audioDeviceManager.getAudioCallbackLock());
+		if(!scrubbing) return;
+		scrubbing = false;
+		scrubber->stop();
+		cutListAudioSource->setPosition(scrubber->getPosition());
+		publishPlayhead();
+		sendChangeMessage();
+	}
+	virtual WaveResampler::Quality getResamplingQuality() const override
+	{
+		return resamplingQuality;
+	}
+	virtual void setResamplingQuality(WaveResampler::Quality v) override
+	{
+		std::unique_ptr<WaveResampler::Kernel> kernel = createResamplerKernel(v, waveFormat.sampleRate);
+		juce::ScopedLock sl(audioDeviceManager.getAudioCallbackLock());
+		resamplingQuality = v;
+		if(resampler) resampler->swapKernel(kernel);
 		sendChangeMessage();
 	}
 	// --------------------------------------------------------------------------------
@@ -174,9 +597,6 @@ public:
 		updateContent();
 		setPosition(0);
 	}
-	virtual void waveCutListDocumentDidReplaceSourceFile(WaveCutListDocument*, WaveSourceFile::Ptr, WaveSourceFile::Ptr) override
-	{
-	}
 	virtual void waveCutListDocumentDidEdit(WaveCutListDocument*, int, const Range64&) override
 	{
 		updateContent();
@@ -185,28 +605,48 @@ public:
 	// juce::AudioIODeviceCallback
 	virtual void audioDeviceIOCallbackWithContext(const float* const*, int, float* const* ppo, int ccho, int len, const juce::AudioIODeviceCallbackContext&) override
 	{
+		int64_t t0 = juce::Time::getHighResolutionTicks();
+		diagnostics.resetIfRequested();
 		juce::AudioSampleBuffer outbuffer(ppo, ccho, len);
 		outbuffer.clear();
-		if(running)
+		if(scrubbing)
+		{
+			scrubber->render(ppo, ccho, len, deviceSampleRate);
+			publishPlayhead();
+			int64_t headroom = scrubber->getHeadroom();
+			diagnostics.scrubHeadroom.add((double)headroom);
+			if(headroom <= 0) diagnostics.scrubUnderruns.fetch_add(1, std::memory_order_relaxed);
+		}
+		else if(running)
 		{
-			resamplingAudioSource->getNextAudioBlock(juce::AudioSourceChannelInfo(outbuffer));
+			publishPlayhead();
+			cutListAudioSource->readTime = 0;
+			cutListAudioSource->readFailures = 0;
+			resampler->getNextAudioBlock(juce::AudioSourceChannelInfo(outbuffer));
+			diagnostics.readTime.add(cutListAudioSource->readTime * 1e6);
+			if(0 < cutListAudioSource->readFailures) diagnostics.readFailures.fetch_add(cutListAudioSource->readFailures, std::memory_order_relaxed);
 			if(!cutListAudioSource->isLooping() && (cutListAudioSource->getLength() <= cutListAudioSource->getPosition())) triggerAsyncUpdate();
 		}
+		// metered while stopped as well, so that the meters fall back
+		levelMeter->process(ppo, ccho, len);
+		double seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - t0);
+		diagnostics.addCallback(seconds, (0 < deviceSampleRate) ? ((double)len / deviceSampleRate) : 0);
 	}
 	virtual void audioDeviceAboutToStart(juce::AudioIODevice* dev) override
 	{
 		int cchdev = dev->getActiveOutputChannels().countNumberOfSetBits();
-		resamplingAudioSource = std::make_unique<juce::ResamplingAudioSource>(cutListAudioSource.get(), false, cchdev);
-		resamplingAudioSource->prepareToPlay(dev->getCurrentBufferSizeSamples(), dev->getCurrentSampleRate());
+		if(!resampler || (resampler->getNumChannels() != cchdev)) resampler = WaveResampler::createInstance(cutListAudioSource.get(), std::max(1, cchdev), resamplingQuality);
+		resampler->setQuality(resamplingQuality);
+		resampler->setResamplingRatio(calcResamplingRatio(waveFormat.sampleRate, dev->getCurrentSampleRate()));
+		resampler->prepareToPlay(dev->getCurrentBufferSizeSamples(), dev->getCurrentSampleRate());
 		double fsdev = dev->getCurrentSampleRate();
-		double fssrc = waveFormat.sampleRate;
-		double fsratio = ((0 < fsdev) && (0 < fssrc)) ? (fssrc / fsdev) : 1;
-		resamplingAudioSource->setResamplingRatio(fsratio);
+		deviceSampleRate = fsdev;
+		levelMeter->prepare(fsdev);
+		outputLatency = (0 < fsdev) ? ((double)dev->getOutputLatencyInSamples() * 1000 / fsdev) : 0;
 	}
 	virtual void audioDeviceStopped() override
 	{
-		if(resamplingAudioSource) resamplingAudioSource->releaseResources();
-		resamplingAudioSource = nullptr;
+		if(resampler) resampler->releaseResources();
 	}
 };
 
@@ -8,16 +8,57 @@
 #pragma once
 
 #include "WaveCutListDocument.h"
+#include "WaveResampler.h"
+#include "WaveLevelMeter.h"
+#include "WavePlaybackDiagnostics.h"
 
 class WaveCutListPlayer : public juce::ChangeBroadcaster
 {
 public:
+	// the audible position as last published by the audio callback
+	struct Playhead
+	{
+		int64_t position = 0;	// the sample audible at timestamp
+		double timestamp = 0;	// juce::Time::getMillisecondCounterHiRes()
+		double sampleRate = 0;	// advance per second, zero while stopped
+		int64_t length = 0;
+		Range64 loopRange{};
+		bool looping = false;
+		double getPositionAt(double t) const
+		{
+			double pos = (double)position + std::max(0.0, t - timestamp) * 0.001 * sampleRate;
+			if(looping && !loopRange.isEmpty() && (position < loopRange.end) && ((double)loopRange.end <= pos)) pos = (double)loopRange.begin + std::fmod(pos - (double)loopRange.begin, (double)loopRange.size());
+			if((double)length <= pos) pos = (double)length;
+			return pos;
+		}
+	};
 	virtual double getDuration() const = 0;
 	virtual bool isLooping() const = 0;
 	virtual void setLooping(bool v) = 0;
+	// an empty range loops the whole list
+	virtual juce::Range<double> getLoopRange() const = 0;
+	virtual void setLoopRange(const juce::Range<double>& v) = 0;
+	// off by default, the whole list is looped whatever the loop range
+	virtual bool isLoopingSelection() const = 0;
+	virtual void setLoopingSelection(bool v) = 0;
+	virtual bool isLoopCrossfading() const = 0;
+	virtual void setLoopCrossfading(bool v) = 0;
 	virtual double getPosition() const = 0;
 	virtual void setPosition(double v) = 0;
 	virtual bool isRunning() const = 0;
 	virtual void setRunning(bool v) = 0;
+	// lock-free, callable from any thread
+	virtual Playhead getPlayhead() const = 0;
+	// measures the device output
+	virtual WaveLevelMeter& getLevelMeter() = 0;
+	// filled by the audio callback, lock-free to read from any thread
+	virtual WavePlaybackDiagnostics& getDiagnostics() = 0;
+	// scrubbing stops playback and lets the pointer drive the speed and direction
+	virtual bool isScrubbing() const = 0;
+	virtual void beginScrub(double t) = 0;
+	virtual void scrub(double t) = 0;
+	virtual void endScrub() = 0;
+	virtual WaveResampler::Quality getResamplingQuality() const = 0;
+	virtual void setResamplingQuality(WaveResampler::Quality v) = 0;
 	static std::unique_ptr<WaveCutListPlayer> createInstance(juce::AudioDeviceManager& adm, WaveCutListDocument& doc);
 };
@@ -6,20 +6,16 @@
 //
 
 #include "WaveCutListView.h"
+#include "WavePeakIndex.h"
+#include "WaveTrace.h"
 
-class WaveCutListView::PlotPane : public juce::Component, public juce::ChangeListener
+class WaveCutListView::PlotPane : public juce::Component, public juce::Timer
 {
 public:
 	const juce::Colour CursorColor{ 0xffff7f0e }; // TAB10:orange
 	const juce::Colour WaveformColor{ 0xff20a685 };
+	const juce::Colour OverviewColor{ 0x8020a685 };
 	const juce::Colour BackgroundColor{ 0xff202020 };
-	juce::AudioFormatManager& audioFormatManager;
-	juce::AudioThumbnailCache audioThumbnailCache;
-	struct WaveSourceFileComparator
-	{
-		bool operator()(const WaveSourceFile::Ptr& a, const WaveSourceFile::Ptr& b) const { return a.get() < b.get(); }
-	};
-	std::map<WaveSourceFile::Ptr, std::unique_ptr<juce::AudioThumbnail>, WaveSourceFileComparator> thumbnailMap;
 	WaveFormat waveFormat = {};
 	WaveCutList waveCutList;
 	int64_t totallength = 0;
@@ -27,6 +23,7 @@ public:
 	juce::Range<double> selectionRange = {};
 	double cursorPosition = 0;
 	double zoomFactor = 1;
+	WaveSnap::Mode snapMode = WaveSnap::SnapOff;
 	class Cursor : public juce::Component
 	{
 	public:
@@ -39,9 +36,14 @@ public:
 	{
 		int xstart;
 		bool dragged;
+		bool scrubbing;
 	} dragCtx = {};
+	juce::AudioBuffer<float> directBuffer;
+	std::map<WaveSourceFile*, WaveSourceFile::Decoder> decoders; // of its own, so that painting and snapping neither wait for the playback nor hold it up; keyed by the sources the list holds
+	juce::ThreadPool peakIndexPool{ 1 };
 	static constexpr int XMargin = 8;
-	PlotPane(juce::AudioFormatManager& afm) : audioFormatManager(afm), audioThumbnailCache(16)
+	static constexpr int SnapPixels = 8;
+	PlotPane()
 	{
 		setOpaque(true);
 		addAndMakeVisible(cursor);
@@ -49,7 +51,7 @@ public:
 	}
 	~PlotPane()
 	{
-		for(auto&& ent : thumbnailMap) ent.second->removeChangeListener(this);
+		peakIndexPool.removeAllJobs(true, 4000);
 	}
 	WaveCutListView* getParentView() const
 	{
@@ -69,11 +71,25 @@ public:
 	{
 		return XMargin + juce::roundToInt((getWidth() - (XMargin * 2)) * (double)i / (double)totallength);
 	}
+	int64_t x2s(int x)
+	{
+		if(getWidth() <= (XMargin * 2)) return 0;
+		return (int64_t)std::floor((double)totallength * (double)(x - XMargin) / (double)(getWidth() - (XMargin * 2)));
+	}
+	// never further than a few pixels, so that the edge stays under the mouse however far it is zoomed in
+	double snapTime(double t)
+	{
+		if((snapMode == WaveSnap::SnapOff) || (waveFormat.sampleRate <= 0) || (getWidth() <= (XMargin * 2))) return t;
+		double fs = waveFormat.sampleRate;
+		int64_t maxdist = std::min(WaveSnap::getMaxDistance(snapMode, fs), (int64_t)((double)totallength * SnapPixels / (double)(getWidth() - (XMargin * 2))));
+		int64_t s = WaveSnap::snap(waveCutList, std::llround(std::max(0.0, std::min(duration, t)) * fs), snapMode, maxdist, decoders);
+		return (double)s / fs;
+	}
 	void updateSelectionRange(int xa, int xb)
 	{
 		selectionRange = {};
-		double ta = x2t(xa);
-		double tb = x2t(xb);
+		double ta = snapTime(x2t(xa));
+		double tb = snapTime(x2t(xb));
 		double begin = std::max(0.0, std::min(ta, tb));
 		double end = std::min(duration, std::max(ta, tb));
 		selectionRange = { begin, end };
@@ -86,13 +102,14 @@ public:
 	}
 	void updateCursorPosition()
 	{
-		cursor.setBounds(calcCursorPosition(cursorPosition));
+		juce::Rectangle<int> rc = calcCursorPosition(cursorPosition);
+		if(rc != cursor.getBounds()) cursor.setBounds(rc);
 	}
 	void fireClick(int x)
 	{
 		WaveCutListView* parentvp = getParentView();
 		if(!parentvp) return;
-		if(parentvp->onClick) parentvp->onClick(std::max(0.0, std::min(duration, x2t(x))));
+		if(parentvp->onClick) parentvp->onClick(std::max(0.0, std::min(duration, snapTime(x2t(x)))));
 	}
 	void resizeAccordingToZoomFactor()
 	{
@@ -111,6 +128,80 @@ public:
 		if(rcv.getRight() <= xfocus) parentvp->setViewPosition(xfocus - rcv.getWidth() - XMargin, vpos.y);
 		else if(xfocus < rcv.getX()) parentvp->setViewPosition(xfocus - XMargin, vpos.y);
 	}
+	bool getScanProgress(double& progress) const
+	{
+		int64_t scanned = 0, total = 0;
+		std::set<WavePeakIndex*> visited;
+		for(const auto& wc : waveCutList)
+		{
+			std::shared_ptr<WavePeakIndex> index = wc.sourceFile->peakIndex.get();
+			if(!index || !visited.insert(index.get()).second) continue;
+			scanned += index->getScannedLength();
+			total += index->getLength();
+		}
+		if(total <= scanned) return false;
+		progress = (double)scanned / (double)total;
+		return true;
+	}
+	void paintCut(juce::Graphics& g, const WaveCut& wc, int64_t spos, const juce::Rectangle<int>& rc, int xbegin, int xend)
+	{
+		int cch = waveFormat.numChannels;
+		if((cch <= 0) || (xend <= xbegin)) return;
+		int64_t lcut = wc.range.size();
+		auto getColumnRange = [&](int x) -> Range64
+		{
+			int64_t b = std::max((int64_t)0, x2s(x) - spos);
+			int64_t e = std::min(lcut, std::max(x2s(x + 1), x2s(x) + 1) - spos);
+			return { wc.range.begin + b, wc.range.begin + e };
+		};
+		// beyond the resolution of the index the visible samples are read directly
+		double spp = (double)totallength / (double)std::max(1, getWidth() - (XMargin * 2));
+		bool direct = spp < (double)WavePeakIndex::BlockLength;
+		Range64 rdirect{ getColumnRange(xbegin).begin, getColumnRange(xend - 1).end };
+		if(direct)
+		{
+			if(rdirect.isEmpty()) return;
+			directBuffer.setSize(cch, (int)rdirect.size(), false, false, true);
+			if(!wc.sourceFile->readWith(decoders[wc.sourceFile.get()], directBuffer.getArrayOfWritePointers(), cch, rdirect.begin, (int)rdirect.size())) return;
+		}
+		std::shared_ptr<WavePeakIndex> index = wc.sourceFile->peakIndex.get();
+		if(!direct && !index) return;
+		float lh = (float)rc.getHeight() / (float)cch;
+		for(int ich = 0; ich < cch; ++ich)
+		{
+			float yc = (float)rc.getY() + lh * ((float)ich + 0.5f);
+			float hh = lh * 0.5f;
+			for(int x = xbegin; x < xend; ++x)
+			{
+				Range64 r = getColumnRange(x);
+				if(r.isEmpty()) continue;
+				WavePeakIndex::Peak pk;
+				WavePeakIndex::Precision prec = WavePeakIndex::PrecisionExact;
+				if(direct)
+				{
+					juce::Range<float> mm = juce::FloatVectorOperations::findMinAndMax(directBuffer.getReadPointer(ich, (int)(r.begin - rdirect.begin)), (int)r.size());
+					pk = { mm.getStart(), mm.getEnd() };
+				}
+				else prec = index->getPeak(ich, r.begin, r.end, pk);
+				if(prec == WavePeakIndex::PrecisionNone) continue;
+				g.setColour((prec == WavePeakIndex::PrecisionExact) ? WaveformColor : OverviewColor);
+				float ytop = yc - juce::jlimit(-1.0f, 1.0f, pk.max) * hh;
+				float ybottom = std::max(ytop + 1, yc - juce::jlimit(-1.0f, 1.0f, pk.min) * hh);
+				g.drawVerticalLine(x, ytop, ybottom);
+			}
+		}
+	}
+	void paintScanProgress(juce::Graphics& g, double progress)
+	{
+		WaveCutListView* parentvp = getParentView();
+		if(!parentvp) return;
+		juce::Rectangle<int> rcv = parentvp->getViewArea().reduced(XMargin, 0);
+		juce::Rectangle<int> rcbar = rcv.removeFromBottom(2);
+		g.setColour(CursorColor.withAlpha(0.5f));
+		g.fillRect(rcbar.withWidth(juce::roundToInt(rcbar.getWidth() * progress)));
+		g.setColour(juce::Colours::white.withAlpha(0.6f));
+		g.drawText(juce::String::formatted("scanning %d%%", (int)(progress * 100)), rcv.removeFromTop(20), juce::Justification::centredLeft);
+	}
 	void ensureTimeVisibleByPlayback(double tfocus)
 	{
 		WaveCutListView* parentvp = getParentView();
@@ -141,34 +232,25 @@ public:
 	}
 	virtual void paint(juce::Graphics& g) override
 	{
+		WAVE_TRACE_SCOPE("ui", "PlotPane::paint");
 		juce::Rectangle<int> rc = getLocalBounds();
 		juce::Rectangle<int> rcclip = g.getClipBounds();
 		g.setColour(BackgroundColor);
 		g.fillRect(rcclip);
 		if(duration <= 0) return;
-		double fs = waveFormat.sampleRate;
 		if(!waveCutList.empty())
 		{
-			g.setColour(WaveformColor);
 			int64_t spos = 0;
 			for(const auto& wc : waveCutList)
 			{
 				int xl = s2x(spos);
 				int xr = s2x(spos + wc.range.size());
 				juce::Rectangle<int> rcseg(xl, rc.getY(), xr - xl, rc.getHeight());
-				if(rcseg.intersects(rcclip))
-				{
-					auto it = thumbnailMap.find(wc.sourceFile);
-					if(it != thumbnailMap.end())
-					{
-						juce::AudioThumbnail* th = it->second.get();
-						double tl = (double)wc.range.begin / fs;
-						double tr = (double)wc.range.end / fs;
-						th->drawChannels(g, rcseg, tl, tr, 1);
-					}
-				}
+				if(rcseg.intersects(rcclip)) paintCut(g, wc, spos, rc, std::max(xl, rcclip.getX()), std::min(xr, rcclip.getRight()));
 				spos += wc.range.size();
 			}
+			double progress = 0;
+			if(getScanProgress(progress)) paintScanProgress(g, progress);
 		}
 		if(!selectionRange.isEmpty())
 		{
@@ -180,12 +262,27 @@ public:
 	}
 	virtual void mouseDown(const juce::MouseEvent& me) override
 	{
-		dragCtx = { me.x, false };
+		// alt+drag scrubs instead of selecting
+		WaveCutListView* parentvp = getParentView();
+		dragCtx = { me.x, false, me.mods.isAltDown() && parentvp && parentvp->onScrubBegin };
+		if(dragCtx.scrubbing)
+		{
+			parentvp->onScrubBegin(std::max(0.0, std::min(duration, x2t(me.x))));
+			return;
+		}
 		fireClick(me.x);
 		updateSelectionRange(dragCtx.xstart, me.x);
 	}
 	virtual void mouseDrag(const juce::MouseEvent& me) override
 	{
+		if(dragCtx.scrubbing)
+		{
+			WaveCutListView* parentvp = getParentView();
+			double t = std::max(0.0, std::min(duration, x2t(me.x)));
+			if(parentvp->onScrub) parentvp->onScrub(t);
+			ensureTimeVisibleByDrag(t);
+			return;
+		}
 		if(3 <= std::abs(me.x - dragCtx.xstart)) dragCtx.dragged = true;
 		if(dragCtx.dragged)
 		{
@@ -195,58 +292,44 @@ public:
 	}
 	virtual void mouseUp(const juce::MouseEvent& me) override
 	{
+		if(dragCtx.scrubbing)
+		{
+			WaveCutListView* parentvp = getParentView();
+			if(parentvp->onScrubEnd) parentvp->onScrubEnd();
+			return;
+		}
 		if(dragCtx.dragged) fireClick(std::min(dragCtx.xstart, me.x));
 	}
 	// --------------------------------------------------------------------------------
-	// juce::ChangeListener
-	virtual void changeListenerCallback(juce::ChangeBroadcaster* source) override
+	// juce::Timer
+	virtual void timerCallback() override
 	{
-		if(dynamic_cast<juce::AudioThumbnail*>(source)) repaint();
+		double progress = 0;
+		if(!getScanProgress(progress)) stopTimer();
+		repaint();
 	}
 	// --------------------------------------------------------------------------------
 	// APIs
-	void replaceSourceFile(WaveSourceFile::Ptr prevsrcfile, WaveSourceFile::Ptr newsrcfile)
-	{
-		auto itfrom = thumbnailMap.find(prevsrcfile);
-		if(itfrom == thumbnailMap.end()) return;
-		juce::MemoryBlock mb;
-		{
-			juce::MemoryOutputStream ostr;
-			itfrom->second->saveTo(ostr);
-			mb = ostr.getMemoryBlock();
-		}
-		std::unique_ptr<juce::AudioThumbnail> th = std::make_unique<juce::AudioThumbnail>(128, audioFormatManager, audioThumbnailCache);
-		{
-			juce::MemoryInputStream istr(std::move(mb));
-			th->loadFrom(istr);
-		}
-		// th->setSource(new juce::FileInputSource(newsrcfile->backingFile)); // is this necessary?
-		th->addChangeListener(this);
-		thumbnailMap[newsrcfile].reset(th.release());
-		thumbnailMap.erase(itfrom);
-	}
-	void setContent(const WaveFormat& fmt, const WaveCutList& cl, bool init)
+	void setContent(const WaveFormat& fmt, const WaveCutList& cl)
 	{
-		if(init)
-		{
-			for(auto&& ent : thumbnailMap) ent.second->removeChangeListener(this);
-			thumbnailMap.clear();
-		}
 		waveFormat = fmt;
 		waveCutList = cl;
+		// the decoders of the sources the list no longer uses would keep their files open
+		for(auto it = decoders.begin(); it != decoders.end(); )
+		{
+			bool used = std::any_of(waveCutList.begin(), waveCutList.end(), [&](const WaveCut& wc) { return wc.sourceFile.get() == it->first; });
+			it = used ? std::next(it) : decoders.erase(it);
+		}
 		totallength = cl.calcTotalSize();
 		duration = (0 < waveFormat.sampleRate) ? ((double)totallength / waveFormat.sampleRate) : 0;
 		for(const auto& wc : waveCutList)
 		{
-			auto it = thumbnailMap.find(wc.sourceFile);
-			if(it == thumbnailMap.end())
-			{
-				std::unique_ptr<juce::AudioThumbnail> th = std::make_unique<juce::AudioThumbnail>(128, audioFormatManager, audioThumbnailCache);
-				th->setSource(new juce::FileInputSource(wc.sourceFile->backingFile));
-				th->addChangeListener(this);
-				thumbnailMap[wc.sourceFile].reset(th.release());
-			}
+			if(wc.sourceFile->peakIndex.get()) continue;
+			WavePeakIndex::Ptr index = WavePeakIndex::createInstance(wc.sourceFile->format.numChannels, wc.sourceFile->length);
+			if(index && wc.sourceFile->peakIndex.install(index)) peakIndexPool.addJob(WavePeakIndex::createBuilderJob(wc.sourceFile, index), true);
 		}
+		if(!isTimerRunning()) startTimer(100);
+		repaint();
 	}
 	const juce::Range<double> getSelectionRange() const
 	{
@@ -269,16 +352,9 @@ public:
 	{
 		cursorPosition = std::max(0.0, std::min(duration, v));
 		updateCursorPosition();
-		juce::ComponentAnimator& anim = juce::Desktop::getInstance().getAnimator();
-		anim.cancelAnimation(&cursor, false);
-		if(running)
-		{
-			if(ensurevisible) ensureTimeVisibleByPlayback(cursorPosition);
-			juce::Rectangle<int> rce = calcCursorPosition(duration);
-			int tms = juce::roundToInt((duration - cursorPosition) * 1000);
-			anim.animateComponent(&cursor, rce, 1, tms, false, 1, 1);
-		}
-		else if(ensurevisible) ensureTimeVisibleByDrag(cursorPosition);
+		if(!ensurevisible) return;
+		if(running) ensureTimeVisibleByPlayback(cursorPosition);
+		else ensureTimeVisibleByDrag(cursorPosition);
 	}
 	double getZoomFactor() const
 	{
@@ -301,12 +377,20 @@ public:
 			getParentView()->setViewPosition(xoff, -getY());
 		}
 	}
+	WaveSnap::Mode getSnapMode() const
+	{
+		return snapMode;
+	}
+	void setSnapMode(WaveSnap::Mode v)
+	{
+		snapMode = v;
+	}
 };
 
-WaveCutListView::WaveCutListView(juce::AudioFormatManager& afm)
+WaveCutListView::WaveCutListView()
 {
 	setScrollBarsShown(false, true);
-	PlotPane* pane = new PlotPane(afm);
+	PlotPane* pane = new PlotPane();
 	setViewedComponent(pane, true);
 }
 
@@ -325,11 +409,12 @@ void WaveCutListView::resized()
 	getPlotPane()->resizeAccordingToZoomFactor();
 }
 
-void WaveCutListView::setContent(const WaveFormat& fmt, const WaveCutList& cl, bool reset) { getPlotPane()->setContent(fmt, cl, reset); }
+void WaveCutListView::setContent(const WaveFormat& fmt, const WaveCutList& cl) { getPlotPane()->setContent(fmt, cl); }
 const juce::Range<double> WaveCutListView::getSelectionRange() const { return getPlotPane()->getSelectionRange(); }
-void WaveCutListView::replaceSourceFile(WaveSourceFile::Ptr prevsrcfile, WaveSourceFile::Ptr newsrcfile) { getPlotPane()->replaceSourceFile(prevsrcfile, newsrcfile); }
 const void WaveCutListView::setSelectionRange(const juce::Range<double>& v) { getPlotPane()->setSelectionRange(v); }
 double WaveCutListView::getCursorPosition() const { return getPlotPane()->getCursorPosition(); }
 void WaveCutListView::setCursorPosition(double v, bool ensurevisible, bool running) { getPlotPane()->setCursorPosition(v, ensurevisible, running); }
 double WaveCutListView::getZoomFactor() const { return getPlotPane()->getZoomFactor(); }
 void WaveCutListView::setZoomFactor(double zfact, double tanchor, bool anchorcentric) { getPlotPane()->setZoomFactor(zfact, tanchor, anchorcentric); }
+WaveSnap::Mode WaveCutListView::getSnapMode() const { return getPlotPane()->getSnapMode(); }
+void WaveCutListView::setSnapMode(WaveSnap::Mode v) { getPlotPane()->setSnapMode(v); }
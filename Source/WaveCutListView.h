@@ -8,6 +8,7 @@
 #pragma once
 
 #include "WaveCutList.h"
+#include "WaveSnap.h"
 
 class WaveCutListView : public juce::Viewport
 {
@@ -18,15 +19,20 @@ protected:
 public:
 	std::function<void(double)> onClick;
 	std::function<void(const juce::Range<double>&)> onSelectionRangeChange;
-	WaveCutListView(juce::AudioFormatManager& afm);
+	std::function<void(double)> onScrubBegin;
+	std::function<void(double)> onScrub;
+	std::function<void()> onScrubEnd;
+	WaveCutListView();
 	virtual ~WaveCutListView();
 	virtual void resized() override;
-	void replaceSourceFile(WaveSourceFile::Ptr prevsrcfile, WaveSourceFile::Ptr newsrcfile);
-	void setContent(const WaveFormat& fmt, const WaveCutList& cl, bool init);
+	void setContent(const WaveFormat& fmt, const WaveCutList& cl);
 	const juce::Range<double> getSelectionRange() const;
 	const void setSelectionRange(const juce::Range<double>& v);
 	double getCursorPosition() const;
 	void setCursorPosition(double v, bool ensurevisible, bool running);
 	double getZoomFactor() const;
 	void setZoomFactor(double zfact, double tanchor, bool anchorcentric);
+	// applies to the clicks and the selection edges the mouse sets
+	WaveSnap::Mode getSnapMode() const;
+	void setSnapMode(WaveSnap::Mode v);
 };
@@ -0,0 +1,144 @@
+//
+//  WaveEditScript.cpp
+//  TestWaveEdit_App
+//
+
+#include "WaveEditScript.h"
+#include "WaveSilenceDetector.h"
+#include "WaveTrace.h"
+
+namespace
+{
+	const char* const OperationNames[] = { "erase", "cut", "copy", "paste", "fadein", "fadeout", "mute", "stripsilence", "effect" };
+
+	bool parsePosition(juce::String t, WaveEditScript::Position& p)
+	{
+		p = {};
+		if(t.startsWithIgnoreCase("end"))
+		{
+			p.fromEnd = true;
+			t = t.substring(3);
+			if(t.isEmpty()) return true;
+			if(!t.startsWithChar('-')) return false;
+		}
+		else if(t.startsWithChar('-')) p.fromEnd = true;
+		if(t.endsWithIgnoreCase("s"))
+		{
+			p.seconds = true;
+			t = t.dropLastCharacters(1);
+		}
+		if(!t.containsOnly("0123456789.-") || !t.containsAnyOf("0123456789")) return false;
+		p.value = t.getDoubleValue();
+		return true;
+	}
+}
+
+int64_t WaveEditScript::Position::resolve(double fs, int64_t len) const
+{
+	int64_t v = seconds ? (int64_t)std::llround(value * fs) : (int64_t)value;
+	return fromEnd ? (len + v) : v;
+}
+
+juce::Result WaveEditScript::parse(const juce::String& text, WaveEditScript& script)
+{
+	script.steps.clear();
+	juce::StringArray lines = juce::StringArray::fromLines(text);
+	for(int i = 0; i < lines.size(); ++i)
+	{
+		juce::StringArray tokens = juce::StringArray::fromTokens(lines[i].upToFirstOccurrenceOf("#", false, false), false);
+		tokens.removeEmptyStrings();
+		if(tokens.isEmpty()) continue;
+		auto fail = [&](const juce::String& msg) { return juce::Result::fail("line " + juce::String(i + 1) + ": " + msg); };
+		int op = (int)(std::find_if(std::begin(OperationNames), std::end(OperationNames), [&](const char* n) { return tokens[0].equalsIgnoreCase(n); }) - std::begin(OperationNames));
+		if(op == (int)std::size(OperationNames)) return fail("unknown operation " + tokens[0].quoted());
+		int nargs = (op == OpPaste) ? 1 : 2;
+		if(op == OpEffect)
+		{
+			if(tokens.size() < 4) return fail("effect takes 2 positions and at least one effect");
+		}
+		else if(tokens.size() != (1 + nargs)) return fail(tokens[0] + " takes " + juce::String(nargs) + ((nargs == 1) ? " position" : " positions"));
+		Step s;
+		s.operation = (Operation)op;
+		s.line = i + 1;
+		if(op == OpEffect)
+		{
+			juce::Result r = WaveEffectChain::parse(tokens.joinIntoString(" ", 3), s.chain);
+			if(r.failed()) return fail(r.getErrorMessage());
+		}
+		if(op == OpStripSilence)
+		{
+			if(!tokens[1].containsOnly("0123456789.-") || !tokens[1].containsAnyOf("0123456789")) return fail("invalid threshold " + tokens[1].quoted());
+			s.thresholdDb = tokens[1].getFloatValue();
+			if(!parsePosition(tokens[2], s.end) || s.end.fromEnd || (s.end.value <= 0)) return fail("invalid length " + tokens[2].quoted());
+			script.steps.push_back(s);
+			continue;
+		}
+		if(!parsePosition(tokens[1], s.begin)) return fail("invalid position " + tokens[1].quoted());
+		if(nargs == 1) s.end = s.begin;
+		else if(!parsePosition(tokens[2], s.end)) return fail("invalid position " + tokens[2].quoted());
+		script.steps.push_back(s);
+	}
+	return juce::Result::ok();
+}
+
+juce::Result WaveEditScript::apply(WaveCutList& cl, int maxthreads) const
+{
+	WAVE_TRACE_SCOPE("edit", "WaveEditScript::apply");
+	if(cl.empty()) return juce::Result::fail("empty cut list");
+	double fs = cl.front().sourceFile->format.sampleRate;
+	WaveCutList clipboard;
+	for(const Step& s : steps)
+	{
+		auto fail = [&](const juce::String& msg) { return juce::Result::fail("line " + juce::String(s.line) + ": " + msg); };
+		int64_t len = cl.calcTotalSize();
+		Range64 r{ s.begin.resolve(fs, len), s.end.resolve(fs, len) };
+		if(s.operation == OpPaste)
+		{
+			if(clipboard.empty()) return fail("nothing to paste");
+			if((r.begin < 0) || (len < r.begin) || !cl.insertList(clipboard, r.begin)) return fail("position out of range");
+		}
+		else if(s.operation == OpStripSilence)
+		{
+			cl.eraseRanges(WaveSilenceDetector::findSilences(cl, juce::Decibels::decibelsToGain(s.thresholdDb), s.end.resolve(fs, 0), {}, maxthreads));
+		}
+		else
+		{
+			// the same checks as the document's canErase() and friends
+			if(r.isEmpty() || !r.intersects({ 0, len })) return fail("range out of range");
+			r = r.intersection(0, len);
+			switch(s.operation)
+			{
+				case OpErase:
+					cl.eraseRange(r);
+					break;
+				case OpCut:
+					clipboard = cl.intersectRange(r);
+					cl.eraseRange(r);
+					break;
+				case OpCopy:
+					clipboard = cl.intersectRange(r);
+					break;
+				case OpEffect:
+				{
+					WaveCutList clfx = s.chain.render(cl, r, maxthreads);
+					if(clfx.empty()) return fail("failed to render");
+					cl.eraseRange(r);
+					cl.insertList(clfx, r.begin);
+					break;
+				}
+				default:
+				{
+					float g0 = (s.operation == OpFadeout) ? 1.0f : 0.0f;
+					float g1 = (s.operation == OpFadein) ? 1.0f : 0.0f;
+					WaveCutList clramp = WaveCutListModifier::processSyncWithRamp(cl, r, g0, g1);
+					if(clramp.empty()) return fail("failed to render");
+					cl.eraseRange(r);
+					cl.insertList(clramp, r.begin);
+					break;
+				}
+			}
+		}
+		cl.mergeAdjucentContinuousCuts();
+	}
+	return juce::Result::ok();
+}
@@ -0,0 +1,56 @@
+//
+//  WaveEditScript.h
+//  TestWaveEdit_App
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "WaveCutList.h"
+#include "WaveEffect.h"
+
+// the edits of the document, applied to a cut list without the GUI; one step per line:
+//   erase|cut|copy|fadein|fadeout|mute <begin> <end>
+//   paste <position>
+//   stripsilence <threshold dB> <minimum length>
+//   effect <begin> <end> <effect>...	the effects as WaveEffectChain::parse() takes them, e.g. "effect 0 end highpass:80 compress:-20,4"
+// a position is in samples, or in seconds with an "s" suffix; "end" is the current length, "end-2s" and "-2s" count back from it
+// "#" starts a comment
+class WaveEditScript
+{
+public:
+	enum Operation
+	{
+		OpErase,
+		OpCut,
+		OpCopy,
+		OpPaste,
+		OpFadein,
+		OpFadeout,
+		OpMute,
+		OpStripSilence,
+		OpEffect,
+	};
+	struct Position
+	{
+		double value = 0;
+		bool seconds = false;
+		bool fromEnd = false;
+		int64_t resolve(double fs, int64_t len) const;
+	};
+	struct Step
+	{
+		Operation operation = OpErase;
+		Position begin;
+		Position end;	// same as begin for paste, the minimum length for stripsilence
+		float thresholdDb = 0;
+		WaveEffectChain chain;
+		int line = 0;
+	};
+	std::vector<Step> steps;
+	static juce::Result parse(const juce::String& text, WaveEditScript& script);
+	// applies the steps in order with a clipboard of its own, and stops at the first one that fails
+	// the cut list is owned by the caller, so any number of scripts may run on separate lists at once
+	// the silence scans and the effect renders use at most maxthreads workers, 0 for one per CPU; 1 keeps them on the calling thread
+	juce::Result apply(WaveCutList& cl, int maxthreads = 0) const;
+};
@@ -0,0 +1,455 @@
+//
+//  WaveEffect.cpp
+//  TestWaveEdit_App
+//
+
+#include "WaveEffect.h"
+#include "WaveTrace.h"
+
+namespace
+{
+	// the samples a state decaying by exp(-rate) per sample takes to fall by 120 dB
+	int64_t calcDecayLength(double rate)
+	{
+		static const double Decay = std::log(1e6);
+		return (0 < rate) ? (int64_t)std::ceil(Decay / rate) : 0;
+	}
+
+	// the frequency the filters are designed at, kept below Nyquist whatever the sample rate of the document
+	double limitFrequency(double f, double fs)
+	{
+		return juce::jlimit(1.0, 0.49 * fs, f);
+	}
+
+	class WaveGainEffect : public WaveEffect
+	{
+	public:
+		float gainDb;
+		float gain;
+		WaveGainEffect(float db) : gainDb(db), gain(juce::Decibels::decibelsToGain(db))
+		{
+		}
+		virtual juce::String getDescription() const override
+		{
+			return "gain:" + juce::String(gainDb);
+		}
+		virtual int64_t getWarmUpLength(double) const override
+		{
+			return 0;
+		}
+		virtual std::unique_ptr<WaveEffect> clone() const override
+		{
+			return std::make_unique<WaveGainEffect>(gainDb);
+		}
+		virtual void prepare(double, int) override
+		{
+		}
+		virtual void process(float* const* pp, int cch, int len) override
+		{
+			for(int ich = 0; ich < cch; ++ich) juce::FloatVectorOperations::multiply(pp[ich], gain, len);
+		}
+	};
+
+	// y[n] = x[n] - x[n-1] + R * y[n-1], a zero at DC and a pole just inside it
+	class WaveDcRemovalEffect : public WaveEffect
+	{
+	public:
+		struct State
+		{
+			double x1 = 0;
+			double y1 = 0;
+		};
+		double pole = 0;
+		std::vector<State> states;
+		virtual juce::String getDescription() const override
+		{
+			return "dc";
+		}
+		virtual int64_t getWarmUpLength(double fs) const override
+		{
+			return calcDecayLength(2 * juce::MathConstants<double>::pi * DcCutoff / fs);
+		}
+		virtual std::unique_ptr<WaveEffect> clone() const override
+		{
+			return std::make_unique<WaveDcRemovalEffect>();
+		}
+		virtual void prepare(double fs, int cch) override
+		{
+			pole = std::exp(-2 * juce::MathConstants<double>::pi * DcCutoff / fs);
+			states.assign((size_t)cch, State());
+		}
+		virtual void process(float* const* pp, int cch, int len) override
+		{
+			for(int ich = 0; ich < cch; ++ich)
+			{
+				State& st = states[(size_t)ich];
+				float* p = pp[ich];
+				for(int i = 0; i < len; ++i)
+				{
+					double x = p[i];
+					st.y1 = x - st.x1 + pole * st.y1;
+					st.x1 = x;
+					p[i] = (float)st.y1;
+				}
+			}
+		}
+	};
+
+	// biquads in series, one per channel and stage
+	class WaveBiquadEffect : public WaveEffect
+	{
+	public:
+		// a stage is the design of a high-pass or of a band; the damping is that of its poles, 1 / 2Q
+		struct Stage
+		{
+			std::function<juce::IIRCoefficients(double fs)> design;
+			double frequency;
+			double damping;
+			juce::String description;
+		};
+		std::vector<Stage> stages;
+		std::vector<juce::IIRFilter> filters; // stage-major
+		int numChannels = 0;
+		WaveBiquadEffect(const std::vector<Stage>& s) : stages(s)
+		{
+		}
+		virtual juce::String getDescription() const override
+		{
+			juce::StringArray sa;
+			for(const Stage& st : stages) sa.add(st.description);
+			return sa.joinIntoString(" ");
+		}
+		virtual int64_t getWarmUpLength(double fs) const override
+		{
+			int64_t len = 0;
+			for(const Stage& st : stages) len += calcDecayLength(2 * juce::MathConstants<double>::pi * limitFrequency(st.frequency, fs) * st.damping / fs);
+			return len;
+		}
+		virtual std::unique_ptr<WaveEffect> clone() const override
+		{
+			return std::make_unique<WaveBiquadEffect>(stages);
+		}
+		virtual void prepare(double fs, int cch) override
+		{
+			numChannels = cch;
+			filters.assign(stages.size() * (size_t)cch, juce::IIRFilter());
+			for(size_t ist = 0; ist < stages.size(); ++ist)
+			{
+				juce::IIRCoefficients coefs = stages[ist].design(fs);
+				for(int ich = 0; ich < cch; ++ich) filters[ist * (size_t)cch + (size_t)ich].setCoefficients(coefs);
+			}
+		}
+		virtual void process(float* const* pp, int cch, int len) override
+		{
+			jassert(cch == numChannels);
+			for(size_t ist = 0; ist < stages.size(); ++ist)
+			{
+				for(int ich = 0; ich < cch; ++ich) filters[ist * (size_t)cch + (size_t)ich].processSamples(pp[ich], len);
+			}
+		}
+	};
+
+	class WaveCompressorEffect : public WaveEffect
+	{
+	public:
+		CompressorParameters params;
+		double attack = 0;
+		double release = 0;
+		double envelope = 0;
+		WaveCompressorEffect(const CompressorParameters& p) : params(p)
+		{
+		}
+		static double calcCoefficient(double ms, double fs)
+		{
+			return std::exp(-1 / (std::max(0.01, ms) * 0.001 * fs));
+		}
+		virtual juce::String getDescription() const override
+		{
+			return "compress:" + juce::String(params.thresholdDb) + "," + juce::String(params.ratio) + "," + juce::String(params.attackMs) + "," + juce::String(params.releaseMs) + "," + juce::String(params.makeupDb);
+		}
+		// two envelopes apart come closer by the slower of the two coefficients every sample, whichever way they move
+		virtual int64_t getWarmUpLength(double fs) const override
+		{
+			return calcDecayLength(-std::log(std::max(calcCoefficient(params.attackMs, fs), calcCoefficient(params.releaseMs, fs))));
+		}
+		virtual std::unique_ptr<WaveEffect> clone() const override
+		{
+			return std::make_unique<WaveCompressorEffect>(params);
+		}
+		virtual void prepare(double fs, int) override
+		{
+			attack = calcCoefficient(params.attackMs, fs);
+			release = calcCoefficient(params.releaseMs, fs);
+			envelope = 0;
+		}
+		virtual void process(float* const* pp, int cch, int len) override
+		{
+			double slope = 1 - 1 / (double)std::max(1.0f, params.ratio);
+			for(int i = 0; i < len; ++i)
+			{
+				double peak = 0;
+				for(int ich = 0; ich < cch; ++ich) peak = std::max(peak, (double)std::abs(pp[ich][i]));
+				double k = (envelope < peak) ? attack : release;
+				envelope = k * envelope + (1 - k) * peak;
+				double over = juce::Decibels::gainToDecibels(envelope, -200.0) - params.thresholdDb;
+				float gain = (float)juce::Decibels::decibelsToGain(params.makeupDb - ((0 < over) ? (over * slope) : 0));
+				for(int ich = 0; ich < cch; ++ich) pp[ich][i] *= gain;
+			}
+		}
+	};
+
+	// the chain over the chunks of one piece: fresh instances at every chunk boundary, warmed up on the samples before it
+	class WaveEffectChunkRenderer
+	{
+	public:
+		static constexpr int WarmUpBlockLength = 16384;
+		const WaveEffectChain& chain;
+		Range64 range;			// the whole range being rendered, the warm-up never reaches before it
+		double sampleRate;
+		int numChannels;
+		int64_t chunkLength;	// 0 if the chain has no state across blocks
+		int64_t warmUpLength;
+		int64_t nextChunk;
+		std::vector<std::unique_ptr<WaveEffect>> effects;
+		WaveCutListReader::Ptr reader;
+		juce::AudioBuffer<float> warmUpBuffer;
+		std::vector<float*> ptrArray;
+		WaveEffectChunkRenderer(const WaveEffectChain& c, const WaveCutList& srccl, const Range64& r, const Range64& rpiece, int64_t lchunk, int64_t lwarmup) : chain(c), range(r), chunkLength(lchunk), warmUpLength(lwarmup), nextChunk(rpiece.begin)
+		{
+			const WaveFormat& fmt = srccl.front().sourceFile->format;
+			sampleRate = fmt.sampleRate;
+			numChannels = fmt.numChannels;
+			ptrArray.resize((size_t)numChannels);
+			if(0 < warmUpLength)
+			{
+				reader = WaveCutListReader::createInstance(true);
+				reader->setWaveCutList(srccl);
+				warmUpBuffer.setSize(numChannels, WarmUpBlockLength);
+			}
+		}
+		void startChunk(int64_t cb)
+		{
+			effects.clear();
+			for(const std::unique_ptr<WaveEffect>& fx : chain.effects)
+			{
+				effects.push_back(fx->clone());
+				effects.back()->prepare(sampleRate, numChannels);
+			}
+			if(!reader) return;
+			Range64 rwarm{ std::max(range.begin, cb - warmUpLength), cb };
+			reader->setPosition(rwarm.begin);
+			for(int64_t pos = rwarm.begin; pos < rwarm.end; )
+			{
+				int len = (int)std::min(rwarm.end - pos, (int64_t)WarmUpBlockLength);
+				// a source that cannot be read here cannot be rendered either, the piece fails on it
+				if(!reader->read(warmUpBuffer.getArrayOfWritePointers(), numChannels, len)) break;
+				for(std::unique_ptr<WaveEffect>& fx : effects) fx->process(warmUpBuffer.getArrayOfWritePointers(), numChannels, len);
+				pos += len;
+			}
+		}
+		void process(juce::AudioBuffer<float>& buf, int64_t pos, int len)
+		{
+			for(int off = 0; off < len; )
+			{
+				if((pos + off) == nextChunk)
+				{
+					startChunk(nextChunk);
+					nextChunk = (0 < chunkLength) ? (nextChunk + chunkLength) : std::numeric_limits<int64_t>::max();
+				}
+				int n = (int)std::min((int64_t)(len - off), nextChunk - (pos + off));
+				for(int ich = 0; ich < numChannels; ++ich) ptrArray[(size_t)ich] = buf.getWritePointer(ich, off);
+				for(std::unique_ptr<WaveEffect>& fx : effects) fx->process(ptrArray.data(), numChannels, n);
+				off += n;
+			}
+		}
+	};
+
+	bool parseNumbers(const juce::String& text, std::vector<double>& values)
+	{
+		values.clear();
+		if(text.isEmpty()) return true;
+		for(const juce::String& t : juce::StringArray::fromTokens(text, ",", ""))
+		{
+			juce::String v = t.trim();
+			if(!v.containsOnly("0123456789.-") || !v.containsAnyOf("0123456789")) return false;
+			values.push_back(v.getDoubleValue());
+		}
+		return true;
+	}
+
+	WaveBiquadEffect::Stage makeBandStage(const WaveEffect::Band& b)
+	{
+		// the poles of a boosting band are damped by its Q times the square root of its gain, those of a cut one by less
+		double a = juce::Decibels::decibelsToGain(std::abs(b.gainDb) * 0.5);
+		WaveBiquadEffect::Stage st;
+		st.frequency = b.frequency;
+		st.damping = 1 / (2 * b.q * a);
+		float g = juce::Decibels::decibelsToGain(b.gainDb);
+		switch(b.shape)
+		{
+			case WaveEffect::BandLowShelf:
+				st.design = [b, g](double fs) { return juce::IIRCoefficients::makeLowShelf(fs, limitFrequency(b.frequency, fs), b.q, g); };
+				st.description = "lowshelf:" + juce::String(b.frequency) + "," + juce::String(b.gainDb);
+				break;
+			case WaveEffect::BandHighShelf:
+				st.design = [b, g](double fs) { return juce::IIRCoefficients::makeHighShelf(fs, limitFrequency(b.frequency, fs), b.q, g); };
+				st.description = "highshelf:" + juce::String(b.frequency) + "," + juce::String(b.gainDb);
+				break;
+			default:
+				st.design = [b, g](double fs) { return juce::IIRCoefficients::makePeakFilter(fs, limitFrequency(b.frequency, fs), b.q, g); };
+				st.description = "peak:" + juce::String(b.frequency) + "," + juce::String(b.gainDb) + "," + juce::String(b.q);
+				break;
+		}
+		return st;
+	}
+}
+
+// ================================================================================
+// WaveEffect
+
+std::unique_ptr<WaveEffect> WaveEffect::createGain(float gaindb)
+{
+	return std::make_unique<WaveGainEffect>(gaindb);
+}
+
+std::unique_ptr<WaveEffect> WaveEffect::createDcRemoval()
+{
+	return std::make_unique<WaveDcRemovalEffect>();
+}
+
+std::unique_ptr<WaveEffect> WaveEffect::createHighPass(double frequency)
+{
+	WaveBiquadEffect::Stage st;
+	st.design = [frequency](double fs) { return juce::IIRCoefficients::makeHighPass(fs, limitFrequency(frequency, fs)); };
+	st.frequency = frequency;
+	st.damping = juce::MathConstants<double>::sqrt2 * 0.5;
+	st.description = "highpass:" + juce::String(frequency);
+	return std::make_unique<WaveBiquadEffect>(std::vector<WaveBiquadEffect::Stage>{ st });
+}
+
+std::unique_ptr<WaveEffect> WaveEffect::createEqualizer(const std::vector<Band>& bands)
+{
+	std::vector<WaveBiquadEffect::Stage> stages;
+	for(const Band& b : bands) stages.push_back(makeBandStage(b));
+	return std::make_unique<WaveBiquadEffect>(stages);
+}
+
+std::unique_ptr<WaveEffect> WaveEffect::createCompressor(const CompressorParameters& params)
+{
+	return std::make_unique<WaveCompressorEffect>(params);
+}
+
+// ================================================================================
+// WaveEffectChain
+
+WaveEffectChain& WaveEffectChain::operator=(const WaveEffectChain& that)
+{
+	if(this == &that) return *this;
+	effects.clear();
+	for(const std::unique_ptr<WaveEffect>& fx : that.effects) effects.push_back(fx->clone());
+	return *this;
+}
+
+juce::String WaveEffectChain::getDescription() const
+{
+	juce::StringArray sa;
+	for(const std::unique_ptr<WaveEffect>& fx : effects) sa.add(fx->getDescription());
+	return sa.joinIntoString(" ");
+}
+
+int64_t WaveEffectChain::getWarmUpLength(double fs) const
+{
+	int64_t len = 0;
+	for(const std::unique_ptr<WaveEffect>& fx : effects) len += fx->getWarmUpLength(fs);
+	return len;
+}
+
+int64_t WaveEffectChain::getChunkLength(double fs) const
+{
+	int64_t lwarmup = getWarmUpLength(fs);
+	if(lwarmup <= 0) return 0;
+	return std::max((int64_t)(MinChunkSeconds * fs), lwarmup * MinChunkWarmUpRatio);
+}
+
+juce::Result WaveEffectChain::parse(const juce::String& text, WaveEffectChain& chain)
+{
+	chain.effects.clear();
+	juce::StringArray tokens = juce::StringArray::fromTokens(text, false);
+	tokens.removeEmptyStrings();
+	std::vector<WaveEffect::Band> bands;
+	auto flushBands = [&]()
+	{
+		if(bands.empty()) return;
+		chain.effects.push_back(WaveEffect::createEqualizer(bands));
+		bands.clear();
+	};
+	for(const juce::String& t : tokens)
+	{
+		juce::String name = t.upToFirstOccurrenceOf(":", false, false).toLowerCase();
+		std::vector<double> v;
+		if(!parseNumbers(t.fromFirstOccurrenceOf(":", false, false), v)) return juce::Result::fail("invalid parameters " + t.quoted());
+		auto fail = [&](const juce::String& usage) { return juce::Result::fail("invalid effect " + t.quoted() + ", expected " + usage); };
+		if((name == "lowshelf") || (name == "peak") || (name == "highshelf"))
+		{
+			bool peak = name == "peak";
+			if((v.size() != (peak ? 3u : 2u)) || (v[0] <= 0) || (peak && (v[2] <= 0))) return fail(peak ? "peak:<Hz>,<dB>,<Q>" : (name + ":<Hz>,<dB>"));
+			WaveEffect::Band b;
+			b.shape = peak ? WaveEffect::BandPeak : ((name == "lowshelf") ? WaveEffect::BandLowShelf : WaveEffect::BandHighShelf);
+			b.frequency = v[0];
+			b.gainDb = (float)v[1];
+			if(peak) b.q = v[2];
+			bands.push_back(b);
+			continue;
+		}
+		// the bands next to each other make up one equalizer
+		flushBands();
+		if(name == "gain")
+		{
+			if(v.size() != 1) return fail("gain:<dB>");
+			chain.effects.push_back(WaveEffect::createGain((float)v[0]));
+		}
+		else if(name == "dc")
+		{
+			if(!v.empty()) return fail("dc");
+			chain.effects.push_back(WaveEffect::createDcRemoval());
+		}
+		else if(name == "highpass")
+		{
+			if((v.size() != 1) || (v[0] <= 0)) return fail("highpass:<Hz>");
+			chain.effects.push_back(WaveEffect::createHighPass(v[0]));
+		}
+		else if(name == "compress")
+		{
+			if(((v.size() != 2) && (v.size() != 4) && (v.size() != 5)) || (v[1] < 1) || ((4 <= v.size()) && ((v[2] <= 0) || (v[3] <= 0)))) return fail("compress:<threshold dB>,<ratio>[,<attack ms>,<release ms>[,<makeup dB>]]");
+			WaveEffect::CompressorParameters p;
+			p.thresholdDb = (float)v[0];
+			p.ratio = (float)v[1];
+			if(4 <= v.size())
+			{
+				p.attackMs = v[2];
+				p.releaseMs = v[3];
+			}
+			if(5 <= v.size()) p.makeupDb = (float)v[4];
+			chain.effects.push_back(WaveEffect::createCompressor(p));
+		}
+		else return juce::Result::fail("unknown effect " + name.quoted());
+	}
+	flushBands();
+	if(chain.effects.empty()) return juce::Result::fail("no effect");
+	return juce::Result::ok();
+}
+
+WaveCutList WaveEffectChain::render(const WaveCutList& srccl, const Range64& r, int maxpieces) const
+{
+	WAVE_TRACE_SCOPE("render", "WaveEffectChain::render");
+	if(srccl.empty() || r.isEmpty() || effects.empty()) return {};
+	double fs = srccl.front().sourceFile->format.sampleRate;
+	int64_t lchunk = getChunkLength(fs);
+	int64_t lwarmup = getWarmUpLength(fs);
+	DBG("[WaveEffectChain] render() " << getDescription().quoted() << " length=" << r.size() << " chunk=" << lchunk << " warmup=" << lwarmup);
+	return WaveCutListModifier::processParallel(srccl, r, [&](const Range64& rpiece) -> WaveCutListWriter::BlockProcessor
+	{
+		std::shared_ptr<WaveEffectChunkRenderer> renderer = std::make_shared<WaveEffectChunkRenderer>(*this, srccl, r, rpiece, lchunk, lwarmup);
+		return [renderer](juce::AudioBuffer<float>& buf, int64_t pos, int len) { renderer->process(buf, pos, len); };
+	}, std::max((int64_t)1, lchunk), maxpieces);
+}
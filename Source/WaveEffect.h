@@ -0,0 +1,80 @@
+//
+//  WaveEffect.h
+//  TestWaveEdit_App
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "WaveCutList.h"
+
+// an offline process of the built-in effects; the chain makes a fresh instance for every chunk it renders
+class WaveEffect
+{
+protected:
+	WaveEffect() {}
+public:
+	enum BandShape
+	{
+		BandLowShelf,
+		BandPeak,
+		BandHighShelf,
+	};
+	struct Band
+	{
+		BandShape shape = BandPeak;
+		double frequency = 1000;	// Hz
+		float gainDb = 0;
+		double q = 0.7071;
+	};
+	struct CompressorParameters
+	{
+		float thresholdDb = -20;
+		float ratio = 4;
+		double attackMs = 5;
+		double releaseMs = 100;
+		float makeupDb = 0;
+	};
+	static constexpr double DcCutoff = 5; // Hz
+	virtual ~WaveEffect() {}
+	virtual juce::String getDescription() const = 0;
+	// the samples an instance fresh from prepare() must run before its output is within -120 dB of one that ran from the start; 0 for an effect without state across blocks
+	virtual int64_t getWarmUpLength(double fs) const = 0;
+	virtual std::unique_ptr<WaveEffect> clone() const = 0;
+	// clears the state
+	virtual void prepare(double fs, int cch) = 0;
+	virtual void process(float* const* pp, int cch, int len) = 0;
+	static std::unique_ptr<WaveEffect> createGain(float gaindb);
+	static std::unique_ptr<WaveEffect> createDcRemoval();
+	// 2nd order Butterworth
+	static std::unique_ptr<WaveEffect> createHighPass(double frequency);
+	// the bands in series
+	static std::unique_ptr<WaveEffect> createEqualizer(const std::vector<Band>& bands);
+	// feed-forward, the level of the loudest channel drives the gain of all of them
+	static std::unique_ptr<WaveEffect> createCompressor(const CompressorParameters& params);
+};
+
+// the effects in series, rendered through WaveCutListModifier::processParallel
+// the range is rendered in chunks on a fixed grid from its start, each by fresh instances warmed up on the samples before it, so that
+// the result does not depend on how many workers share the chunks; a chain without state across blocks needs neither and renders block-parallel
+// one effect per token, the parameters separated by commas:
+//   gain:<dB>  dc  highpass:<Hz>  lowshelf:<Hz>,<dB>  peak:<Hz>,<dB>,<Q>  highshelf:<Hz>,<dB>
+//   compress:<threshold dB>,<ratio>[,<attack ms>,<release ms>[,<makeup dB>]]
+class WaveEffectChain
+{
+public:
+	static constexpr double MinChunkSeconds = 5;
+	static constexpr int MinChunkWarmUpRatio = 8;	// a chunk is at least this many warm-ups long, so that they add an eighth at most
+	std::vector<std::unique_ptr<WaveEffect>> effects;
+	WaveEffectChain() {}
+	WaveEffectChain(const WaveEffectChain& that) { *this = that; }
+	WaveEffectChain& operator=(const WaveEffectChain& that);
+	bool isEmpty() const { return effects.empty(); }
+	juce::String getDescription() const;
+	// the sum over the effects, as each settles only once the one before it has
+	int64_t getWarmUpLength(double fs) const;
+	int64_t getChunkLength(double fs) const;
+	static juce::Result parse(const juce::String& text, WaveEffectChain& chain);
+	// empty if it failed; at most maxpieces workers, 0 for one per CPU, which gives the same samples for any number
+	WaveCutList render(const WaveCutList& srccl, const Range64& r, int maxpieces = 0) const;
+};
@@ -0,0 +1,230 @@
+//
+//  WaveJournal.cpp
+//  TestWaveEdit_App
+//
+
+#include "WaveJournal.h"
+#include "WaveTrace.h"
+
+namespace
+{
+	constexpr const char* FileExtension = ".wejl";
+	const char* const EditNames[] = { "insert", "erase", "replace", "undo", "redo", "eraseranges" };
+
+	// held for the life of the journal; the system releases it when the process dies, which tells the orphans apart
+	juce::String getLockName(const juce::File& file)
+	{
+		return "TestWaveEditJournal-" + file.getFileNameWithoutExtension();
+	}
+}
+
+class WaveJournalImpl : public WaveJournal, private juce::Timer
+{
+public:
+	juce::File file;
+	std::unique_ptr<juce::InterProcessLock> lock;
+	std::unique_ptr<juce::FileOutputStream> stream;
+	// the sources the records refer to; holding them keeps their renders until the next checkpoint drops them
+	WaveProject::SourceTable sourceTable;
+	int numRecords = 0;
+	WaveJournalImpl()
+	{
+		getDirectory().createDirectory();
+		file = getDirectory().getChildFile(juce::Uuid().toString() + FileExtension);
+		lock = std::make_unique<juce::InterProcessLock>(getLockName(file));
+		lock->enter(0);
+	}
+	virtual ~WaveJournalImpl()
+	{
+		stopTimer();
+		stream = nullptr;
+		file.deleteFile();
+		lock->exit();
+	}
+	void writeRecord(const juce::var& v)
+	{
+		if(!stream) return;
+		*stream << juce::JSON::toString(v, true) << "\n";
+		++numRecords;
+		if(!isTimerRunning()) startTimer(FlushInterval);
+	}
+	void writeSources(const WaveCutList& cl)
+	{
+		for(const WaveCut& c : cl)
+		{
+			auto [index, added] = sourceTable.add(c.sourceFile);
+			if(!added) continue;
+			juce::Result r = juce::Result::ok();
+			juce::var v = WaveProject::sourceToVar(*c.sourceFile, {}, {}, r);
+			if(juce::DynamicObject* obj = v.getDynamicObject())
+			{
+				obj->setProperty("op", "source");
+				obj->setProperty("id", index);
+			}
+			writeRecord(v);
+		}
+	}
+	// juce::Timer
+	virtual void timerCallback() override
+	{
+		flush();
+	}
+	// WaveJournal
+	virtual juce::File getFile() const override
+	{
+		return file;
+	}
+	virtual int getNumRecordsSinceCheckpoint() const override
+	{
+		return numRecords;
+	}
+	virtual void flush() override
+	{
+		stopTimer();
+		// flushing syncs the file to the disk, once per batch of records
+		if(stream) stream->flush();
+	}
+	virtual void writeCheckpoint(const WaveProject::Content& content, const juce::File& docfile, bool changed) override
+	{
+		WAVE_TRACE_SCOPE("io", "WaveJournal::writeCheckpoint");
+		stopTimer();
+		stream = nullptr;
+		sourceTable = {};
+		numRecords = 0;
+		juce::Result r = juce::Result::ok();
+		juce::var root = WaveProject::contentToVar(content, {}, {}, sourceTable, r);
+		if(juce::DynamicObject* obj = root.getDynamicObject())
+		{
+			obj->setProperty("op", "checkpoint");
+			obj->setProperty("documentFile", docfile.getFullPathName());
+			obj->setProperty("changed", changed);
+		}
+		// swapped in whole, so that a crash meanwhile leaves the previous checkpoint and its records
+		juce::TemporaryFile tmp(file);
+		if(r.failed() || !tmp.getFile().replaceWithText(juce::JSON::toString(root, true) + "\n") || !tmp.overwriteTargetFileWithTemporary())
+		{
+			DBG("[WaveJournal] writeCheckpoint() failed " << r.getErrorMessage().quoted());
+			return;
+		}
+		stream = std::make_unique<juce::FileOutputStream>(file);
+		if(stream->failedToOpen()) stream = nullptr;
+	}
+	virtual void writeEdit(const Edit& edit) override
+	{
+		writeSources(edit.cutList);
+		juce::DynamicObject::Ptr obj = new juce::DynamicObject();
+		obj->setProperty("op", EditNames[edit.type]);
+		if(edit.name.isNotEmpty()) obj->setProperty("name", edit.name);
+		if(edit.type == Edit::EraseRanges)
+		{
+			juce::Array<juce::var> ranges;
+			for(const Range64& r : edit.ranges) ranges.add(juce::Array<juce::var>{ (juce::int64)r.begin, (juce::int64)r.end });
+			obj->setProperty("ranges", ranges);
+		}
+		else if((edit.type != Edit::Undo) && (edit.type != Edit::Redo))
+		{
+			obj->setProperty("begin", (juce::int64)edit.range.begin);
+			obj->setProperty("end", (juce::int64)edit.range.end);
+		}
+		if(!edit.cutList.empty()) obj->setProperty("cuts", WaveProject::cutListToVar(edit.cutList, sourceTable));
+		writeRecord(obj.get());
+	}
+};
+
+juce::File WaveJournal::getDirectory()
+{
+	return TemporaryWaveSourceFile::getTempDirectory().getChildFile("Journal");
+}
+
+std::unique_ptr<WaveJournal> WaveJournal::createInstance()
+{
+	return std::make_unique<WaveJournalImpl>();
+}
+
+juce::Array<juce::File> WaveJournal::findOrphans()
+{
+	juce::Array<juce::File> files = getDirectory().findChildFiles(juce::File::findFiles, false, juce::String("*") + FileExtension);
+	juce::Array<juce::File> orphans;
+	for(const juce::File& f : files)
+	{
+		juce::InterProcessLock l(getLockName(f));
+		if(!l.enter(0)) continue;
+		l.exit();
+		orphans.add(f);
+	}
+	std::sort(orphans.begin(), orphans.end(), [](const juce::File& a, const juce::File& b) { return b.getLastModificationTime() < a.getLastModificationTime(); });
+	return orphans;
+}
+
+bool WaveJournal::hasUnsavedEdits(const juce::File& file)
+{
+	juce::FileInputStream str(file);
+	if(str.failedToOpen()) return false;
+	// the checkpoint is the first line; anything but sources after it is an edit
+	juce::var checkpoint = juce::JSON::parse(str.readNextLine());
+	// an empty document has neither cuts nor steps
+	if(!checkpoint.getDynamicObject() || ((checkpoint["base"].size() == 0) && (checkpoint["history"].size() == 0))) return false;
+	if((bool)checkpoint["changed"]) return true;
+	while(!str.isExhausted())
+	{
+		// as in read(), the records end at the first that is cut short
+		juce::var v;
+		if(juce::JSON::parse(str.readNextLine(), v).failed() || !v.getDynamicObject()) break;
+		if(v["op"].toString() != "source") return true;
+	}
+	return false;
+}
+
+juce::Result WaveJournal::read(juce::AudioFormatManager& afm, const juce::File& file, Recovery& recovery)
+{
+	WAVE_TRACE_SCOPE("io", "WaveJournal::read");
+	recovery = {};
+	juce::FileInputStream str(file);
+	if(str.failedToOpen()) return juce::Result::fail("failed to open " + file.getFullPathName().quoted());
+	juce::var checkpoint = juce::JSON::parse(str.readNextLine());
+	if(checkpoint["op"].toString() != "checkpoint") return juce::Result::fail("no checkpoint");
+	juce::Array<WaveSourceFile::Ptr>& sources = recovery.sources;
+	juce::Result r = WaveProject::varToContent(afm, checkpoint, {}, {}, recovery.checkpoint, sources);
+	if(r.failed()) return r;
+	recovery.documentFile = juce::File(checkpoint["documentFile"].toString());
+	recovery.changed = checkpoint["changed"];
+	while(!str.isExhausted())
+	{
+		// the last line may be cut short by the crash, the records before it are complete
+		juce::var v;
+		if(juce::JSON::parse(str.readNextLine(), v).failed() || !v.getDynamicObject()) break;
+		juce::String op = v["op"].toString();
+		if(op == "source")
+		{
+			if((int)v["id"] != sources.size()) return juce::Result::fail("broken journal");
+			WaveSourceFile::Ptr src = WaveProject::varToSource(afm, v, {}, {}, recovery.checkpoint.format, r);
+			if(!src) return r;
+			sources.add(src);
+			continue;
+		}
+		int type = (int)(std::find_if(std::begin(EditNames), std::end(EditNames), [&op](const char* n) { return op == n; }) - std::begin(EditNames));
+		if(type == (int)std::size(EditNames)) return juce::Result::fail("unknown record " + op.quoted());
+		Edit e;
+		e.type = (Edit::Type)type;
+		e.name = v["name"].toString();
+		e.range = { (juce::int64)v["begin"], (juce::int64)v["end"] };
+		if(e.type == Edit::EraseRanges)
+		{
+			// written sorted and disjoint; anything else would erase other samples on replay than it did
+			const juce::Array<juce::var>* ranges = v["ranges"].getArray();
+			if(!ranges || ranges->isEmpty()) return juce::Result::fail("broken journal");
+			for(const juce::var& rv : *ranges)
+			{
+				const juce::Array<juce::var>* a = rv.getArray();
+				if(!a || (a->size() != 2)) return juce::Result::fail("broken journal");
+				Range64 rr{ (juce::int64)(*a)[0], (juce::int64)(*a)[1] };
+				if(rr.isEmpty() || (rr.begin < 0) || (!e.ranges.empty() && (rr.begin < e.ranges.back().end))) return juce::Result::fail("broken journal");
+				e.ranges.push_back(rr);
+			}
+		}
+		if(v.hasProperty("cuts") && !WaveProject::varToCutList(v["cuts"], sources, e.cutList)) return juce::Result::fail("broken journal");
+		recovery.edits.push_back(std::move(e));
+		recovery.changed = true;
+	}
+	return juce::Result::ok();
+}
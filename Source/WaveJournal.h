@@ -0,0 +1,64 @@
+//
+//  WaveJournal.h
+//  TestWaveEdit_App
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "WaveCutList.h"
+#include "WaveProject.h"
+
+// an append-only record of the edits of a document, one JSON object per line, so that a session that died can be
+// rebuilt from it and the renders it left in the temporary directory
+// a checkpoint holds the whole undo history and starts the file anew, the records after it hold the edits since;
+// the records are flushed to the disk in batches, so a crash loses at most the last FlushInterval of edits
+class WaveJournal
+{
+protected:
+	WaveJournal() {}
+public:
+	static constexpr int FlushInterval = 500; // ms
+	struct Edit
+	{
+		enum Type
+		{
+			Insert,
+			Erase,
+			Replace,
+			Undo,
+			Redo,
+			EraseRanges,
+		};
+		Type type = Insert;
+		juce::String name;
+		Range64 range;		// the erased or replaced range; begin is the insertion point
+		WaveCutList cutList;	// the inserted or replacing cuts
+		std::vector<Range64> ranges;	// the erased ranges of EraseRanges, sorted and disjoint
+	};
+	struct Recovery
+	{
+		WaveProject::Content checkpoint;
+		std::vector<Edit> edits;
+		juce::File documentFile;
+		bool changed = false;	// whether the document had edits that were not saved
+		juce::Array<WaveSourceFile::Ptr> sources;	// all that the checkpoint and the edits refer to
+	};
+	// a journal that outlives its session marks a crash, so it is deleted with the instance
+	virtual ~WaveJournal() {}
+	virtual juce::File getFile() const = 0;
+	virtual int getNumRecordsSinceCheckpoint() const = 0;
+	// writes the batched records out now rather than at the end of the batch, e.g. before the file is read back
+	virtual void flush() = 0;
+	virtual void writeCheckpoint(const WaveProject::Content& content, const juce::File& docfile, bool changed) = 0;
+	virtual void writeEdit(const Edit& edit) = 0;
+	static juce::File getDirectory();
+	static std::unique_ptr<WaveJournal> createInstance();
+	// the journals of sessions that did not end normally, newest first; call it before this process creates its own
+	static juce::Array<juce::File> findOrphans();
+	// whether the journal holds anything that was not saved, without opening its sources
+	static bool hasUnsavedEdits(const juce::File& file);
+	// reads up to the last complete record; the renders it refers to in the temporary directory are left in place
+	// until the caller adopts them, see TemporaryWaveSourceFile::adopt(), so a recovery that fails can be tried again
+	static juce::Result read(juce::AudioFormatManager& afm, const juce::File& file, Recovery& recovery);
+};
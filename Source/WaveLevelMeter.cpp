@@ -0,0 +1,158 @@
+//
+//  WaveLevelMeter.cpp
+//  TestWaveEdit_App
+//
+
+#include "WaveLevelMeter.h"
+#if JUCE_INTEL
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// ITU-R BS.1770-4 Annex 2, 48-tap interpolator arranged as 4 phases of 12 taps
+	constexpr int TruePeakTaps = 12;
+	constexpr int TruePeakPhases = 4;
+	const float TruePeakCoefs[TruePeakPhases][TruePeakTaps] =
+	{
+		{ 0.0017089843750f, 0.0109863281250f, -0.0196533203125f, 0.0332031250000f, -0.0594482421875f, 0.1373291015625f, 0.9721679687500f, -0.1022949218750f, 0.0476074218750f, -0.0266113281250f, 0.0148925781250f, -0.0083007812500f },
+		{ -0.0291748046875f, 0.0292968750000f, -0.0517578125000f, 0.0891113281250f, -0.1665039062500f, 0.4650878906250f, 0.7797851562500f, -0.2003173828125f, 0.1015625000000f, -0.0582275390625f, 0.0330810546875f, -0.0189208984375f },
+		{ -0.0189208984375f, 0.0330810546875f, -0.0582275390625f, 0.1015625000000f, -0.2003173828125f, 0.7797851562500f, 0.4650878906250f, -0.1665039062500f, 0.0891113281250f, -0.0517578125000f, 0.0292968750000f, -0.0291748046875f },
+		{ -0.0083007812500f, 0.0148925781250f, -0.0266113281250f, 0.0476074218750f, -0.1022949218750f, 0.9721679687500f, 0.1373291015625f, -0.0594482421875f, 0.0332031250000f, -0.0196533203125f, 0.0109863281250f, 0.0017089843750f },
+	};
+	constexpr double RmsTime = 0.3;
+
+	void storeMax(std::atomic<float>& a, float v)
+	{
+		float cur = a.load(std::memory_order_relaxed);
+		while((cur < v) && !a.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {}
+	}
+
+	float sumOfSquares(const float* p, int len)
+	{
+		// four independent accumulators so that the loop vectorizes
+		float a[4] = {};
+		int i = 0;
+		for(; i + 4 <= len; i += 4)
+		{
+			for(int j = 0; j < 4; ++j) a[j] += p[i + j] * p[i + j];
+		}
+		for(; i < len; ++i) a[0] += p[i] * p[i];
+		return (a[0] + a[1]) + (a[2] + a[3]);
+	}
+}
+
+class WaveLevelMeterImpl : public WaveLevelMeter
+{
+public:
+	struct Channel
+	{
+		std::atomic<float> peak{ 0 };
+		std::atomic<float> rms{ 0 };
+		std::atomic<float> truePeak{ 0 };
+		// audio thread state
+		double meanSquare = 0;
+		// the last TruePeakTaps samples, stored twice so that the window is always contiguous
+		float history[TruePeakTaps * 2] = {};
+		int historyIndex = 0;
+	};
+	Channel channels[MaxChannels];
+	// taps arranged newest-first with the 4 phases interleaved, so that one tap of all phases is a single vector
+	alignas(16) float coefsByTap[TruePeakTaps][TruePeakPhases];
+	std::atomic<int> numChannels{ 0 };
+	std::atomic<double> averageCost{ 0 };
+	std::atomic<double> maximumCost{ 0 };
+	double sampleRate = 44100;
+	WaveLevelMeterImpl()
+	{
+		for(int k = 0; k < TruePeakTaps; ++k)
+		{
+			for(int p = 0; p < TruePeakPhases; ++p) coefsByTap[k][p] = TruePeakCoefs[p][TruePeakTaps - 1 - k];
+		}
+	}
+	float processTruePeak(Channel& c, const float* p, int len)
+	{
+		float tp = 0;
+		for(int i = 0; i < len; ++i)
+		{
+			c.historyIndex = (c.historyIndex + 1) % TruePeakTaps;
+			c.history[c.historyIndex] = c.history[c.historyIndex + TruePeakTaps] = p[i];
+			// newest first: x[n - k] = window[k]
+			const float* window = c.history + c.historyIndex + TruePeakTaps;
+#if JUCE_INTEL
+			__m128 acc = _mm_setzero_ps();
+			for(int k = 0; k < TruePeakTaps; ++k) acc = _mm_add_ps(acc, _mm_mul_ps(_mm_load_ps(coefsByTap[k]), _mm_set1_ps(window[-k])));
+			const __m128 signmask = _mm_set1_ps(-0.0f);
+			acc = _mm_andnot_ps(signmask, acc);
+			alignas(16) float y[4];
+			_mm_store_ps(y, acc);
+			tp = std::max(tp, std::max(std::max(y[0], y[1]), std::max(y[2], y[3])));
+#else
+			float y[TruePeakPhases] = {};
+			for(int k = 0; k < TruePeakTaps; ++k)
+			{
+				for(int ph = 0; ph < TruePeakPhases; ++ph) y[ph] += coefsByTap[k][ph] * window[-k];
+			}
+			for(int ph = 0; ph < TruePeakPhases; ++ph) tp = std::max(tp, std::abs(y[ph]));
+#endif
+		}
+		return tp;
+	}
+	// --------------------------------------------------------------------------------
+	// WaveLevelMeter
+	virtual void prepare(double fs) override
+	{
+		sampleRate = (0 < fs) ? fs : 44100;
+		for(auto& c : channels)
+		{
+			c.peak = c.rms = c.truePeak = 0;
+			c.meanSquare = 0;
+			std::fill(std::begin(c.history), std::end(c.history), 0.0f);
+			c.historyIndex = 0;
+		}
+	}
+	virtual void process(const float* const* pp, int cch, int len) override
+	{
+		int64_t t0 = juce::Time::getHighResolutionTicks();
+		cch = std::min(cch, (int)MaxChannels);
+		numChannels.store(cch, std::memory_order_relaxed);
+		if(len <= 0) return;
+		double alpha = 1 - std::exp(-(double)len / (sampleRate * RmsTime));
+		for(int ich = 0; ich < cch; ++ich)
+		{
+			Channel& c = channels[ich];
+			const float* p = pp[ich];
+			juce::Range<float> mm = juce::FloatVectorOperations::findMinAndMax(p, len);
+			storeMax(c.peak, std::max(-mm.getStart(), mm.getEnd()));
+			c.meanSquare += alpha * ((double)sumOfSquares(p, len) / (double)len - c.meanSquare);
+			c.rms.store((float)std::sqrt(c.meanSquare), std::memory_order_relaxed);
+			storeMax(c.truePeak, processTruePeak(c, p, len));
+		}
+		double us = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - t0) * 1e6;
+		averageCost.store(averageCost.load(std::memory_order_relaxed) * 0.99 + us * 0.01, std::memory_order_relaxed);
+		if(maximumCost.load(std::memory_order_relaxed) < us) maximumCost.store(us, std::memory_order_relaxed);
+	}
+	virtual int getNumChannels() const override
+	{
+		return numChannels;
+	}
+	virtual Levels getLevels(int ich) override
+	{
+		if((ich < 0) || (MaxChannels <= ich)) return {};
+		Channel& c = channels[ich];
+		return { c.peak.exchange(0), c.rms.load(), c.truePeak.exchange(0) };
+	}
+	virtual double getAverageCost() const override
+	{
+		return averageCost;
+	}
+	virtual double getMaximumCost() const override
+	{
+		return maximumCost;
+	}
+};
+
+std::unique_ptr<WaveLevelMeter> WaveLevelMeter::createInstance()
+{
+	return std::make_unique<WaveLevelMeterImpl>();
+}
@@ -0,0 +1,32 @@
+//
+//  WaveLevelMeter.h
+//  TestWaveEdit_App
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// per-channel peak, RMS and true-peak levels measured on the audio thread and read lock-free from any other thread
+class WaveLevelMeter
+{
+public:
+	static constexpr int MaxChannels = 8;
+	struct Levels
+	{
+		float peak = 0;		// linear, the maximum since the previous getLevels()
+		float rms = 0;		// linear, 300 ms exponential average
+		float truePeak = 0;	// linear, 4x oversampled as in ITU-R BS.1770, the maximum since the previous getLevels()
+	};
+	virtual ~WaveLevelMeter() {}
+	// call it while process() is not running
+	virtual void prepare(double fs) = 0;
+	// audio thread, does not allocate
+	virtual void process(const float* const* pp, int cch, int len) = 0;
+	virtual int getNumChannels() const = 0;
+	virtual Levels getLevels(int ich) = 0;
+	// microseconds spent in process() per call, averaged and worst case
+	virtual double getAverageCost() const = 0;
+	virtual double getMaximumCost() const = 0;
+	static std::unique_ptr<WaveLevelMeter> createInstance();
+};
@@ -0,0 +1,396 @@
+//
+//  WaveLoudness.cpp
+//  TestWaveEdit_App
+//
+
+#include "WaveLoudness.h"
+#include "WaveCutList.h"
+#include "WaveLevelMeter.h"
+#include "WaveTrace.h"
+
+namespace
+{
+	constexpr int MomentaryUnits = 40;	// 400 ms gating blocks
+	constexpr int ShortTermUnits = 300;	// 3 s blocks for the loudness range
+	constexpr int StepUnits = 10;		// both overlapped by 100 ms steps
+	constexpr double RelativeGate = -10;
+	constexpr double RangeRelativeGate = -20;
+
+	double toLoudness(double meansquare)
+	{
+		return -0.691 + 10 * std::log10(meansquare);
+	}
+
+	// ITU-R BS.1770-4 channel weights: 1 for L, R and C, 1.41 for the surrounds, the LFE left out; in the WAV order of 5.1
+	float getChannelWeight(int cch, int ich)
+	{
+		if(cch != 6) return 1;
+		const float weights[6] = { 1, 1, 1, 0, 1.41f, 1.41f };
+		return weights[ich];
+	}
+
+	// the shelving pre-filter and the high-pass of BS.1770, designed for any sample rate
+	class KWeightingFilter
+	{
+	public:
+		struct Biquad
+		{
+			double b0 = 1, b1 = 0, b2 = 0, a1 = 0, a2 = 0;
+			double z1 = 0, z2 = 0;
+			double process(double x)
+			{
+				double y = b0 * x + z1;
+				z1 = b1 * x - a1 * y + z2;
+				z2 = b2 * x - a2 * y;
+				return y;
+			}
+		};
+		Biquad shelf, highpass;
+		KWeightingFilter(double fs)
+		{
+			{
+				const double f0 = 1681.974450955533, g = 3.999843853973347, q = 0.7071752369554196;
+				double k = std::tan(juce::MathConstants<double>::pi * f0 / fs);
+				double vh = std::pow(10.0, g / 20), vb = std::pow(vh, 0.4996667741545416);
+				double a0 = 1 + k / q + k * k;
+				shelf.b0 = (vh + vb * k / q + k * k) / a0;
+				shelf.b1 = 2 * (k * k - vh) / a0;
+				shelf.b2 = (vh - vb * k / q + k * k) / a0;
+				shelf.a1 = 2 * (k * k - 1) / a0;
+				shelf.a2 = (1 - k / q + k * k) / a0;
+			}
+			{
+				const double f0 = 38.13547087602444, q = 0.5003270373238773;
+				double k = std::tan(juce::MathConstants<double>::pi * f0 / fs);
+				double a0 = 1 + k / q + k * k;
+				highpass.b0 = 1;
+				highpass.b1 = -2;
+				highpass.b2 = 1;
+				highpass.a1 = 2 * (k * k - 1) / a0;
+				highpass.a2 = (1 - k / q + k * k) / a0;
+			}
+		}
+		double processSumOfSquares(const float* p, int len)
+		{
+			double sum = 0;
+			for(int i = 0; i < len; ++i)
+			{
+				double y = highpass.process(shelf.process((double)p[i]));
+				sum += y * y;
+			}
+			return sum;
+		}
+	};
+}
+
+// ================================================================================
+// summary
+
+class WaveLoudnessSummaryImpl : public WaveLoudnessSummary
+{
+public:
+	double sampleRate;
+	int numChannels;
+	int64_t length;
+	int unitLength;
+	// allocated up front, so that the builder only fills them; read once analysedLength reaches length
+	std::vector<float> energies;
+	std::vector<float> truePeaks;
+	std::atomic<int64_t> analysedLength{ 0 };
+	std::atomic<bool> failed{ false };
+	WaveLoudnessSummaryImpl(double fs, int cch, int64_t len) : sampleRate(fs), numChannels(cch), length(len)
+	{
+		unitLength = std::max(1, juce::roundToInt(fs * UnitSeconds));
+		size_t numunits = (size_t)((len + unitLength - 1) / unitLength);
+		energies.resize(numunits);
+		truePeaks.resize(numunits);
+	}
+	virtual int64_t getLength() const override
+	{
+		return length;
+	}
+	virtual int getUnitLength() const override
+	{
+		return unitLength;
+	}
+	virtual int64_t getAnalysedLength() const override
+	{
+		return analysedLength;
+	}
+	virtual bool isComplete() const override
+	{
+		return length <= analysedLength;
+	}
+	virtual bool hasFailed() const override
+	{
+		return failed;
+	}
+	virtual float getEnergy(int64_t unit) const override
+	{
+		return energies[(size_t)unit];
+	}
+	virtual float getTruePeak(int64_t unit) const override
+	{
+		return truePeaks[(size_t)unit];
+	}
+};
+
+WaveLoudnessSummary::Ptr WaveLoudnessSummary::createInstance(double fs, int cch, int64_t len)
+{
+	if((fs <= 0) || (cch <= 0) || (len <= 0)) return nullptr;
+	return std::make_shared<WaveLoudnessSummaryImpl>(fs, cch, len);
+}
+
+class WaveLoudnessBuilderJob : public juce::ThreadPoolJob
+{
+public:
+	static constexpr int UnitsPerRun = 100;
+	static constexpr int ReadLength = 16384;
+	WaveSourceFile::Ptr sourceFile;
+	WaveSourceFile::Decoder decoder; // of its own, so that the scan does not hold up the playback
+	std::shared_ptr<WaveLoudnessSummaryImpl> summary;
+	juce::AudioBuffer<float> buffer;
+	std::vector<float*> ptrArray;
+	std::vector<KWeightingFilter> filters;
+	// the true peak of the playback meter, fed unit by unit and read back after each
+	std::unique_ptr<WaveLevelMeter> truePeakMeter;
+	WaveLoudnessBuilderJob(WaveSourceFile::Ptr src, std::shared_ptr<WaveLoudnessSummaryImpl> s) : juce::ThreadPoolJob("WaveLoudnessBuilder"), sourceFile(src), summary(s)
+	{
+		buffer.setSize(summary->numChannels, summary->unitLength * UnitsPerRun);
+		ptrArray.resize((size_t)summary->numChannels);
+		filters.assign((size_t)summary->numChannels, KWeightingFilter(summary->sampleRate));
+		truePeakMeter = WaveLevelMeter::createInstance();
+		truePeakMeter->prepare(summary->sampleRate);
+	}
+	bool readChunk(int64_t pos, int len)
+	{
+		int cch = summary->numChannels;
+		for(int off = 0; off < len; off += ReadLength)
+		{
+			for(int ich = 0; ich < cch; ++ich) ptrArray[(size_t)ich] = buffer.getWritePointer(ich, off);
+			if(!sourceFile->readWith(decoder, ptrArray.data(), cch, pos + off, std::min(ReadLength, len - off))) return false;
+		}
+		return true;
+	}
+	JobStatus giveUp()
+	{
+		summary->failed = true;
+		sourceFile->loudnessSummary.discard(summary);
+		return jobHasFinished;
+	}
+	virtual JobStatus runJob() override
+	{
+		if(sourceFile->getReferenceCount() <= 1) return giveUp();
+		// cancelled rather than failed, e.g. with a measurement; the summary is abandoned for the next to ask to build again
+		if(shouldExit())
+		{
+			sourceFile->loudnessSummary.discard(summary);
+			return jobHasFinished;
+		}
+		int64_t pos = summary->analysedLength;
+		int lchunk = (int)std::min(summary->length - pos, (int64_t)buffer.getNumSamples());
+		if(lchunk <= 0) return jobHasFinished;
+		if(!readChunk(pos, lchunk)) return giveUp();
+		int cch = summary->numChannels;
+		int cchmeter = std::min(cch, (int)WaveLevelMeter::MaxChannels);
+		size_t iunit = (size_t)(pos / summary->unitLength);
+		for(int off = 0; off < lchunk; off += summary->unitLength, ++iunit)
+		{
+			int n = std::min(summary->unitLength, lchunk - off);
+			for(int ich = 0; ich < cch; ++ich) ptrArray[(size_t)ich] = buffer.getWritePointer(ich, off);
+			truePeakMeter->process(ptrArray.data(), cchmeter, n);
+			float tp = 0;
+			for(int ich = 0; ich < cchmeter; ++ich) tp = std::max(tp, truePeakMeter->getLevels(ich).truePeak);
+			double e = 0;
+			for(int ich = 0; ich < cch; ++ich)
+			{
+				float w = getChannelWeight(cch, ich);
+				if(0 < w) e += w * filters[(size_t)ich].processSumOfSquares(ptrArray[(size_t)ich], n);
+			}
+			summary->energies[iunit] = (float)e;
+			summary->truePeaks[iunit] = tp;
+		}
+		summary->analysedLength = pos + lchunk;
+		return summary->isComplete() ? jobHasFinished : jobNeedsRunningAgain;
+	}
+};
+
+juce::ThreadPoolJob* WaveLoudnessSummary::createBuilderJob(juce::ReferenceCountedObjectPtr<WaveSourceFile> src, Ptr summary)
+{
+	std::shared_ptr<WaveLoudnessSummaryImpl> impl = std::dynamic_pointer_cast<WaveLoudnessSummaryImpl>(summary);
+	if(!src || !impl) return nullptr;
+	return new WaveLoudnessBuilderJob(src, impl);
+}
+
+// ================================================================================
+// measurement
+
+bool WaveLoudness::measure(const WaveCutList& cl, Result& result)
+{
+	WAVE_TRACE_SCOPE("analysis", "WaveLoudness::measure");
+	result = {};
+	if(cl.empty()) return true;
+	int64_t lunit = 0;
+	// taken once, the sources may swap theirs meanwhile
+	std::vector<std::shared_ptr<const WaveLoudnessSummary>> summaries;
+	for(const WaveCut& wc : cl)
+	{
+		std::shared_ptr<const WaveLoudnessSummary> s = wc.sourceFile->loudnessSummary.get();
+		if(!s || !s->isComplete()) return false;
+		if(lunit == 0) lunit = s->getUnitLength();
+		if(s->getUnitLength() != lunit) return false;
+		summaries.push_back(s);
+	}
+	// the units of the list, filled from the units of the sources under the cuts; a partial unit counts by its share of the samples
+	int64_t total = cl.calcTotalSize();
+	std::vector<double> units((size_t)((total + lunit - 1) / lunit), 0.0);
+	float truepeak = 0;
+	int64_t pos = 0;
+	auto its = summaries.begin();
+	for(const WaveCut& wc : cl)
+	{
+		const WaveLoudnessSummary* s = (its++)->get();
+		for(int64_t u = wc.range.begin / lunit; (u * lunit) < wc.range.end; ++u)
+		{
+			int64_t n = std::min(wc.range.end, (u + 1) * lunit) - std::max(wc.range.begin, u * lunit);
+			int64_t nunit = std::min(lunit, s->getLength() - u * lunit);
+			double e = (double)s->getEnergy(u) * (double)n / (double)nunit;
+			size_t iu = (size_t)(pos / lunit);
+			int64_t nfirst = std::min(n, lunit - pos % lunit);
+			units[iu] += e * (double)nfirst / (double)n;
+			if(nfirst < n) units[iu + 1] += e * (double)(n - nfirst) / (double)n;
+			truepeak = std::max(truepeak, s->getTruePeak(u));
+			pos += n;
+		}
+	}
+	result.truePeak = 20 * std::log10((double)truepeak);
+	// the mean squares of the overlapping blocks, as differences of the running sum
+	std::vector<double> cum(units.size() + 1, 0.0);
+	std::partial_sum(units.begin(), units.end(), cum.begin() + 1);
+	auto blocks = [&](int len)
+	{
+		std::vector<double> z;
+		for(size_t b = 0; (b + (size_t)len) <= units.size(); b += StepUnits) z.push_back((cum[b + (size_t)len] - cum[b]) / (double)(len * lunit));
+		return z;
+	};
+	// the mean square of the blocks above the absolute gate and the given one relative to their own mean
+	auto gate = [](const std::vector<double>& z, double relative, std::vector<double>& gated)
+	{
+		double sum = 0;
+		size_t n = 0;
+		for(double v : z) if(WaveLoudness::AbsoluteGate < toLoudness(v)) { sum += v; ++n; }
+		gated.clear();
+		if(n == 0) return;
+		double threshold = toLoudness(sum / (double)n) + relative;
+		for(double v : z) if((WaveLoudness::AbsoluteGate < toLoudness(v)) && (threshold < toLoudness(v))) gated.push_back(v);
+	};
+	std::vector<double> gated;
+	gate(blocks(MomentaryUnits), RelativeGate, gated);
+	if(!gated.empty()) result.integrated = toLoudness(std::accumulate(gated.begin(), gated.end(), 0.0) / (double)gated.size());
+	// EBU Tech 3342: the spread between the 10th and the 95th percentile of the gated short-term loudness
+	gate(blocks(ShortTermUnits), RangeRelativeGate, gated);
+	if(2 <= gated.size())
+	{
+		std::sort(gated.begin(), gated.end());
+		auto percentile = [&](double p) { return toLoudness(gated[(size_t)std::llround(p * (double)(gated.size() - 1))]); };
+		result.range = percentile(0.95) - percentile(0.10);
+	}
+	return true;
+}
+
+// ================================================================================
+// analyzer
+
+class WaveLoudnessAnalyzerImpl : public WaveLoudnessAnalyzer, private juce::Timer
+{
+public:
+	static constexpr int PollInterval = 200; // ms
+	juce::ThreadPool pool{ std::max(1, juce::SystemStats::getNumCpus() - 1) };
+	WaveCutList waveCutList;
+	std::set<std::shared_ptr<const WaveLoudnessSummary>> summaries; // those the list waits for
+	WaveLoudness::Result result;
+	bool upToDate = false;
+	bool failed = false;
+	WaveLoudnessAnalyzerImpl()
+	{
+	}
+	virtual ~WaveLoudnessAnalyzerImpl()
+	{
+		stopTimer();
+		pool.removeAllJobs(true, 4000);
+	}
+	// installs the summaries the sources lack and builds them; also those a cancelled measurement abandoned
+	void schedule()
+	{
+		for(const WaveCut& wc : waveCutList)
+		{
+			WaveLoudnessSummary::Ptr s = wc.sourceFile->loudnessSummary.get();
+			if(!s)
+			{
+				s = WaveLoudnessSummary::createInstance(wc.sourceFile->format.sampleRate, wc.sourceFile->format.numChannels, wc.sourceFile->length);
+				if(!s) continue;
+				if(wc.sourceFile->loudnessSummary.install(s)) pool.addJob(WaveLoudnessSummary::createBuilderJob(wc.sourceFile, s), true);
+				else s = wc.sourceFile->loudnessSummary.get();
+			}
+			if(s) summaries.insert(s);
+		}
+	}
+	void update()
+	{
+		failed = std::any_of(summaries.begin(), summaries.end(), [](const std::shared_ptr<const WaveLoudnessSummary>& s) { return s->hasFailed(); });
+		if(failed) stopTimer();
+		else
+		{
+			schedule();
+			if(WaveLoudness::measure(waveCutList, result))
+			{
+				upToDate = true;
+				stopTimer();
+			}
+			else if(!isTimerRunning()) startTimer(PollInterval);
+		}
+		// also while building, for the progress
+		sendChangeMessage();
+	}
+	// juce::Timer
+	virtual void timerCallback() override
+	{
+		update();
+	}
+	// WaveLoudnessAnalyzer
+	virtual void setWaveCutList(const WaveCutList& cl) override
+	{
+		waveCutList = cl;
+		upToDate = false;
+		// a summary that failed has been taken out of its source, so the new list builds it anew
+		summaries.clear();
+		update();
+	}
+	virtual bool getResult(WaveLoudness::Result& r) const override
+	{
+		r = result;
+		return upToDate;
+	}
+	virtual bool hasFailed() const override
+	{
+		return failed;
+	}
+	virtual double getProgress() const override
+	{
+		std::set<const WaveLoudnessSummary*> visited;
+		int64_t analysed = 0, total = 0;
+		for(const WaveCut& wc : waveCutList)
+		{
+			std::shared_ptr<const WaveLoudnessSummary> s = wc.sourceFile->loudnessSummary.get();
+			if(!s || !visited.insert(s.get()).second) continue;
+			analysed += s->getAnalysedLength();
+			total += s->getLength();
+		}
+		return (0 < total) ? ((double)analysed / (double)total) : 1;
+	}
+};
+
+std::unique_ptr<WaveLoudnessAnalyzer> WaveLoudnessAnalyzer::createInstance()
+{
+	return std::make_unique<WaveLoudnessAnalyzerImpl>();
+}
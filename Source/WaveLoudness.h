@@ -0,0 +1,70 @@
+//
+//  WaveLoudness.h
+//  TestWaveEdit_App
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class WaveSourceFile;
+class WaveCutList;
+
+// per-source K-weighted energy and true peak in short units, from which the loudness of any cut list over the source is recombined without reading it again
+class WaveLoudnessSummary
+{
+protected:
+	WaveLoudnessSummary() {}
+public:
+	using Ptr = std::shared_ptr<WaveLoudnessSummary>;
+	static constexpr double UnitSeconds = 0.01;	// a tenth of the step of the gating blocks
+	virtual ~WaveLoudnessSummary() {}
+	virtual int64_t getLength() const = 0;
+	virtual int getUnitLength() const = 0;
+	virtual int64_t getAnalysedLength() const = 0;
+	virtual bool isComplete() const = 0;
+	// its builder gave up, e.g. on a read error, and took it out of the source, so that the next to ask builds another
+	virtual bool hasFailed() const = 0;
+	// the channel-weighted sum of the squared K-weighted samples of a unit, and its 4x oversampled peak; valid once complete
+	virtual float getEnergy(int64_t unit) const = 0;
+	virtual float getTruePeak(int64_t unit) const = 0;
+	static Ptr createInstance(double fs, int cch, int64_t len);
+	// the job filters the source sequentially; it gives up once it holds the last reference to the source
+	// install the summary in the source, see WaveAnalysisCache, before the job is scheduled
+	static juce::ThreadPoolJob* createBuilderJob(juce::ReferenceCountedObjectPtr<WaveSourceFile> src, Ptr summary);
+};
+
+// integrated loudness, loudness range and true peak of a cut list after EBU R128 and ITU-R BS.1770-4
+class WaveLoudness
+{
+protected:
+	WaveLoudness() {}
+public:
+	static constexpr double AbsoluteGate = -70; // LUFS
+	struct Result
+	{
+		double integrated = -std::numeric_limits<double>::infinity();	// LUFS
+		double range = 0;												// LU
+		double truePeak = -std::numeric_limits<double>::infinity();		// dBTP
+	};
+	// recombines the summaries of the sources, which must all be complete; O(length) in units, nothing is read
+	// the units of a cut are on the grid of its source, so a cut that starts off the grid of the list is apportioned between two of its units
+	static bool measure(const WaveCutList& cl, Result& result);
+};
+
+// keeps the loudness of a cut list up to date: builds the missing summaries on a worker pool and recombines once they are complete
+// after an edit only the new sources, i.e. the renders, are analysed
+class WaveLoudnessAnalyzer : public juce::ChangeBroadcaster
+{
+protected:
+	WaveLoudnessAnalyzer() {}
+public:
+	virtual ~WaveLoudnessAnalyzer() {}
+	virtual void setWaveCutList(const WaveCutList& cl) = 0;
+	// false while the summaries are being built, or once one of them failed
+	virtual bool getResult(WaveLoudness::Result& result) const = 0;
+	// a summary failed and the analyzer stopped waiting; the next list tries again
+	virtual bool hasFailed() const = 0;
+	virtual double getProgress() const = 0;
+	static std::unique_ptr<WaveLoudnessAnalyzer> createInstance();
+};
@@ -0,0 +1,215 @@
+//
+//  WaveNormalizer.cpp
+//  TestWaveEdit_App
+//
+
+#include "WaveNormalizer.h"
+#include "WavePeakIndex.h"
+#include "WaveTrace.h"
+
+namespace
+{
+	constexpr int64_t BlockLength = WavePeakIndex::BlockLength;
+	constexpr int StallTimeout = 10000; // ms without progress after which the summaries are given up on, e.g. one built by a pool that is busy elsewhere
+	constexpr int PollInterval = 50; // ms, for the cancellation and the summaries built elsewhere
+
+	// a part of a source no longer than a piece, its whole blocks on the grid of the peak index
+	struct WavePeakPiece
+	{
+		WaveSourceFile* sourceFile;
+		Range64 range;
+	};
+
+	class WavePeakJob : public juce::ThreadPoolJob
+	{
+	public:
+		const std::vector<WavePeakPiece>& pieces;
+		std::atomic<size_t>& nextPiece;
+		float peak = 0;
+		bool failed = false;
+		juce::AudioBuffer<float> buffer;
+		std::map<WaveSourceFile*, WaveSourceFile::Decoder> decoders; // of its own, so that the workers neither wait for each other nor hold up the playback
+		WavePeakJob(const std::vector<WavePeakPiece>& p, std::atomic<size_t>& next) : juce::ThreadPoolJob("WavePeak"), pieces(p), nextPiece(next)
+		{
+		}
+		bool readPeak(WaveSourceFile& src, const Range64& r)
+		{
+			if(r.isEmpty()) return true;
+			int cch = src.format.numChannels;
+			int len = (int)r.size();
+			buffer.setSize(cch, len, false, false, true);
+			if(!src.readWith(decoders[&src], buffer.getArrayOfWritePointers(), cch, r.begin, len)) return false;
+			for(int ich = 0; ich < cch; ++ich) peak = std::max(peak, buffer.getMagnitude(ich, 0, len));
+			return true;
+		}
+		// a block the index knows exactly is taken from it, the runs of the others are read in one go
+		bool measurePiece(const WavePeakPiece& pc)
+		{
+			WaveSourceFile& src = *pc.sourceFile;
+			std::shared_ptr<const WavePeakIndex> index = src.peakIndex.get();
+			Range64 rread{ pc.range.begin, pc.range.begin };
+			for(int64_t b = pc.range.begin; b < pc.range.end; )
+			{
+				int64_t e = std::min(pc.range.end, (b / BlockLength + 1) * BlockLength);
+				bool known = index && ((e - b) == BlockLength);
+				float pkblock = 0;
+				for(int ich = 0; known && (ich < src.format.numChannels); ++ich)
+				{
+					WavePeakIndex::Peak pk;
+					known = index->getPeak(ich, b, e, pk) == WavePeakIndex::PrecisionExact;
+					pkblock = std::max(pkblock, std::max(-pk.min, pk.max));
+				}
+				if(known)
+				{
+					if(!readPeak(src, rread)) return false;
+					rread = { e, e };
+					peak = std::max(peak, pkblock);
+				}
+				else rread.end = e;
+				b = e;
+			}
+			return readPeak(src, rread);
+		}
+		virtual JobStatus runJob() override
+		{
+			WAVE_TRACE_SCOPE("analysis", "WavePeakJob::runJob");
+			for(size_t i = nextPiece++; i < pieces.size(); i = nextPiece++)
+			{
+				if(shouldExit() || !measurePiece(pieces[i]))
+				{
+					failed = true;
+					break;
+				}
+			}
+			return jobHasFinished;
+		}
+	};
+
+	// waits for the summaries of the sources to complete, building those that are missing on a worker each
+	// a summary already being built, e.g. by the analyzer of the meter, is waited for rather than built twice
+	juce::Result completeLoudnessSummaries(const WaveCutList& cl, const std::function<bool()>& shouldcancel)
+	{
+		std::map<WaveSourceFile*, WaveLoudnessSummary::Ptr> summaries;
+		for(const WaveCut& wc : cl) summaries.insert({ wc.sourceFile.get(), nullptr });
+		// the jobs outlive the pool, which stops them when it is destroyed early
+		std::vector<std::unique_ptr<juce::ThreadPoolJob>> jobs;
+		juce::ThreadPool pool(juce::SystemStats::getNumCpus());
+		for(auto& [src, s] : summaries)
+		{
+			s = src->loudnessSummary.get();
+			if(s) continue;
+			s = WaveLoudnessSummary::createInstance(src->format.sampleRate, src->format.numChannels, src->length);
+			if(!s) return juce::Result::fail("failed to analyse " + src->backingFile.getFileName().quoted());
+			if(!src->loudnessSummary.install(s))
+			{
+				s = src->loudnessSummary.get();
+				continue;
+			}
+			jobs.emplace_back(WaveLoudnessSummary::createBuilderJob(src, s));
+			if(!jobs.back()) return juce::Result::fail("failed to analyse " + src->backingFile.getFileName().quoted());
+			pool.addJob(jobs.back().get(), false);
+		}
+		// the progress of the summaries, so that one built elsewhere that stops advancing is told from one that is slow
+		int64_t analysed = -1;
+		juce::uint32 tprogress = juce::Time::getMillisecondCounter();
+		for(;;)
+		{
+			int64_t sum = 0;
+			bool complete = true;
+			for(auto& [src, s] : summaries)
+			{
+				if(s && s->hasFailed()) return juce::Result::fail("failed to analyse " + src->backingFile.getFileName().quoted());
+				if(!s) continue;
+				sum += s->getAnalysedLength();
+				complete = complete && s->isComplete();
+			}
+			if(complete) return juce::Result::ok();
+			if(shouldcancel && shouldcancel()) return juce::Result::fail("cancelled");
+			if(analysed != sum)
+			{
+				analysed = sum;
+				tprogress = juce::Time::getMillisecondCounter();
+			}
+			else if(StallTimeout < (int)(juce::Time::getMillisecondCounter() - tprogress)) return juce::Result::fail("the loudness analysis stopped advancing");
+			juce::Thread::sleep(PollInterval);
+		}
+	}
+}
+
+float WaveNormalizer::measurePeak(const WaveCutList& cl, const Range64& r, const std::function<bool()>& shouldcancel)
+{
+	WAVE_TRACE_SCOPE("analysis", "WaveNormalizer::measurePeak");
+	std::vector<WavePeakPiece> pieces;
+	int64_t offset = 0;
+	for(const WaveCut& wc : cl)
+	{
+		Range64 rtile{ offset, offset + wc.range.size() };
+		offset = rtile.end;
+		if(rtile.end <= r.begin) continue;
+		if(r.end <= rtile.begin) break;
+		Range64 rx = rtile.intersection(r);
+		Range64 rsrc{ wc.range.begin + (rx.begin - rtile.begin), wc.range.begin + (rx.end - rtile.begin) };
+		// the pieces break on the grid of the source so that only the ends of the cut are partial blocks
+		for(int64_t b = rsrc.begin; b < rsrc.end; )
+		{
+			int64_t e = std::min(rsrc.end, (b / PieceLength + 1) * PieceLength);
+			pieces.push_back({ wc.sourceFile.get(), { b, e } });
+			b = e;
+		}
+	}
+	if(pieces.empty()) return 0;
+	int numthreads = std::min(juce::SystemStats::getNumCpus(), (int)pieces.size());
+	std::atomic<size_t> nextpiece{ 0 };
+	// the jobs outlive the pool, which stops them when it is destroyed early
+	std::vector<std::unique_ptr<WavePeakJob>> jobs;
+	juce::ThreadPool pool(numthreads);
+	for(int i = 0; i < numthreads; ++i)
+	{
+		jobs.push_back(std::make_unique<WavePeakJob>(pieces, nextpiece));
+		pool.addJob(jobs.back().get(), false);
+	}
+	float peak = 0;
+	bool failed = false;
+	for(std::unique_ptr<WavePeakJob>& job : jobs)
+	{
+		while(!pool.waitForJobToFinish(job.get(), PollInterval))
+		{
+			if(shouldcancel && shouldcancel()) return -1;
+		}
+		peak = std::max(peak, job->peak);
+		failed = failed || job->failed;
+	}
+	return failed ? -1 : peak;
+}
+
+juce::Result WaveNormalizer::measureLoudness(const WaveCutList& cl, const Range64& r, WaveLoudness::Result& result, const std::function<bool()>& shouldcancel)
+{
+	WAVE_TRACE_SCOPE("analysis", "WaveNormalizer::measureLoudness");
+	WaveCutList clr = cl.intersectRange(r);
+	juce::Result res = completeLoudnessSummaries(clr, shouldcancel);
+	if(res.failed()) return res;
+	// a summary completed above may have been replaced since, e.g. after its builder gave up on a source that went away
+	if(!WaveLoudness::measure(clr, result)) return juce::Result::fail("failed to measure the loudness");
+	return juce::Result::ok();
+}
+
+juce::Result WaveNormalizer::calcGainToPeak(const WaveCutList& cl, const Range64& r, double targetdb, float& gain, const std::function<bool()>& shouldcancel)
+{
+	float peak = measurePeak(cl, r, shouldcancel);
+	if(shouldcancel && shouldcancel()) return juce::Result::fail("cancelled");
+	if(peak < 0) return juce::Result::fail("failed to read the range");
+	if(peak == 0) return juce::Result::fail("the range is silent");
+	gain = (float)(juce::Decibels::decibelsToGain(targetdb) / peak);
+	return juce::Result::ok();
+}
+
+juce::Result WaveNormalizer::calcGainToLoudness(const WaveCutList& cl, const Range64& r, double targetlufs, float& gain, const std::function<bool()>& shouldcancel)
+{
+	WaveLoudness::Result lr;
+	juce::Result res = measureLoudness(cl, r, lr, shouldcancel);
+	if(res.failed()) return res;
+	// below the absolute gate there is nothing the measurement could be scaled from
+	if(!std::isfinite(lr.integrated)) return juce::Result::fail("the range is below the absolute gate");
+	gain = (float)juce::Decibels::decibelsToGain(targetlufs - lr.integrated);
+	return juce::Result::ok();
+}
@@ -0,0 +1,30 @@
+//
+//  WaveNormalizer.h
+//  TestWaveEdit_App
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "WaveCutList.h"
+#include "WaveLoudness.h"
+
+// the first pass of a normalize: the gain that brings a range of a cut list to a target level
+// the second pass, applying it, is WaveCutListModifier::processParallelWithGain
+class WaveNormalizer
+{
+protected:
+	WaveNormalizer() {}
+public:
+	static constexpr double DefaultPeakDb = -1;		// dBFS
+	static constexpr double DefaultLoudness = -23;	// LUFS, after EBU R128
+	static constexpr int64_t PieceLength = 1 << 16;	// samples of a source measured by one step of a worker
+	// the largest absolute sample of the range over all channels, or -1 if a part of it could not be read or shouldcancel returned true
+	// the exact peak summaries stand in for the whole blocks they cover, the rest is read; the pieces are measured on a worker per CPU
+	static float measurePeak(const WaveCutList& cl, const Range64& r, const std::function<bool()>& shouldcancel = nullptr);
+	// the integrated loudness of the range; the summaries the sources lack are built first, one source per worker, and waited for
+	static juce::Result measureLoudness(const WaveCutList& cl, const Range64& r, WaveLoudness::Result& result, const std::function<bool()>& shouldcancel = nullptr);
+	// fail if the range is silent, could not be measured or was cancelled; they block, so the application calls them off the message thread
+	static juce::Result calcGainToPeak(const WaveCutList& cl, const Range64& r, double targetdb, float& gain, const std::function<bool()>& shouldcancel = nullptr);
+	static juce::Result calcGainToLoudness(const WaveCutList& cl, const Range64& r, double targetlufs, float& gain, const std::function<bool()>& shouldcancel = nullptr);
+};
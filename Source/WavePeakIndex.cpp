@@ -0,0 +1,206 @@
+//
+//  WavePeakIndex.cpp
+//  TestWaveEdit_App
+//
+
+#include "WavePeakIndex.h"
+#include "WaveCutList.h"
+
+class WavePeakIndexImpl : public WavePeakIndex
+{
+public:
+	static constexpr int ChunkLength = BlockLength * GroupLength; // the exact scan proceeds one group at a time
+	int numChannels = 0;
+	int64_t length = 0;
+	std::vector<std::vector<Peak>> exactPeaks;		// [channel][block]
+	std::vector<std::vector<Peak>> groupPeaks;		// [channel][group]
+	std::vector<std::vector<Peak>> overviewPeaks;	// [channel][entry]
+	std::unique_ptr<std::atomic<bool>[]> overviewValid;
+	std::atomic<int64_t> scannedLength{ 0 };
+	WavePeakIndexImpl(int cch, int64_t len) : numChannels(cch), length(len)
+	{
+		size_t nblocks = (size_t)((len + BlockLength - 1) / BlockLength);
+		size_t ngroups = (nblocks + GroupLength - 1) / GroupLength;
+		exactPeaks.assign(cch, std::vector<Peak>(nblocks));
+		groupPeaks.assign(cch, std::vector<Peak>(ngroups));
+		overviewPeaks.assign(cch, std::vector<Peak>(OverviewLength));
+		overviewValid.reset(new std::atomic<bool>[OverviewLength]);
+		for(int i = 0; i < OverviewLength; ++i) overviewValid[i] = false;
+	}
+	static void merge(Peak& acc, bool& found, const Peak& pk)
+	{
+		acc = found ? Peak{ std::min(acc.min, pk.min), std::max(acc.max, pk.max) } : pk;
+		found = true;
+	}
+	int64_t getOverviewBegin(int i) const
+	{
+		return length * i / OverviewLength;
+	}
+	void mergeExact(int ich, int64_t begin, int64_t end, Peak& acc, bool& found) const
+	{
+		const std::vector<Peak>& exact = exactPeaks[ich];
+		const std::vector<Peak>& group = groupPeaks[ich];
+		int64_t b = begin / BlockLength, bend = (end + BlockLength - 1) / BlockLength;
+		while(b < bend)
+		{
+			if(((b % GroupLength) == 0) && ((b + GroupLength) <= bend)) { merge(acc, found, group[(size_t)(b / GroupLength)]); b += GroupLength; }
+			else { merge(acc, found, exact[(size_t)b]); ++b; }
+		}
+	}
+	void mergeOverview(int ich, int64_t begin, int64_t end, Peak& acc, bool& found) const
+	{
+		int ib = (int)(begin * OverviewLength / length);
+		int ie = std::min(OverviewLength, (int)((end * OverviewLength + length - 1) / length));
+		for(int i = ib; i < ie; ++i)
+		{
+			if(overviewValid[i]) merge(acc, found, overviewPeaks[ich][i]);
+		}
+	}
+	// WavePeakIndex
+	virtual int getNumChannels() const override
+	{
+		return numChannels;
+	}
+	virtual int64_t getLength() const override
+	{
+		return length;
+	}
+	virtual int64_t getScannedLength() const override
+	{
+		return scannedLength;
+	}
+	virtual bool isComplete() const override
+	{
+		return length <= scannedLength;
+	}
+	virtual Precision getPeak(int ich, int64_t begin, int64_t end, Peak& pk) const override
+	{
+		if((ich < 0) || (numChannels <= ich)) return PrecisionNone;
+		begin = std::max((int64_t)0, begin);
+		end = std::min(length, end);
+		if(end <= begin) return PrecisionNone;
+		int64_t scanned = scannedLength;
+		Peak acc;
+		bool found = false;
+		if(begin < scanned) mergeExact(ich, begin, std::min(end, scanned), acc, found);
+		if(end <= scanned)
+		{
+			pk = acc;
+			return PrecisionExact;
+		}
+		mergeOverview(ich, std::max(begin, scanned), end, acc, found);
+		if(!found) return PrecisionNone;
+		pk = acc;
+		return PrecisionOverview;
+	}
+};
+
+WavePeakIndex::Ptr WavePeakIndex::createInstance(int cch, int64_t len)
+{
+	if((cch <= 0) || (len <= 0)) return nullptr;
+	return std::make_shared<WavePeakIndexImpl>(cch, len);
+}
+
+class WavePeakIndexBuilderJob : public juce::ThreadPoolJob
+{
+public:
+	static constexpr int ProbeLength = 4096;
+	static constexpr int ProbesPerRun = 16;
+	static constexpr int ReadLength = 16384;
+	WaveSourceFile::Ptr sourceFile;
+	WaveSourceFile::Decoder decoder; // of its own, so that the scan does not hold up the playback
+	std::shared_ptr<WavePeakIndexImpl> peakIndex;
+	juce::AudioBuffer<float> buffer;
+	std::vector<float*> ptrArray;
+	int nextProbe = 0;
+	WavePeakIndexBuilderJob(WaveSourceFile::Ptr src, std::shared_ptr<WavePeakIndexImpl> index) : juce::ThreadPoolJob("WavePeakIndexBuilder"), sourceFile(src), peakIndex(index)
+	{
+		buffer.setSize(peakIndex->numChannels, WavePeakIndexImpl::ChunkLength);
+		ptrArray.resize(peakIndex->numChannels);
+		// short sources are scanned exactly in about the time the overview would take
+		if(peakIndex->length < ((int64_t)WavePeakIndex::OverviewLength * ProbeLength * 4)) nextProbe = WavePeakIndex::OverviewLength;
+	}
+	static int reverseBits(int i)
+	{
+		// visits the overview entries coarse to fine: 0, 1/2, 1/4, 3/4, 1/8, ...
+		int r = 0;
+		for(int c = WavePeakIndex::OverviewLength; 1 < c; c >>= 1) { r = (r << 1) | (i & 1); i >>= 1; }
+		return r;
+	}
+	bool readChunk(int64_t pos, int len)
+	{
+		int cch = peakIndex->numChannels;
+		for(int off = 0; off < len; off += ReadLength)
+		{
+			for(int ich = 0; ich < cch; ++ich) ptrArray[ich] = buffer.getWritePointer(ich, off);
+			if(!sourceFile->readWith(decoder, ptrArray.data(), cch, pos + off, std::min(ReadLength, len - off))) return false;
+		}
+		return true;
+	}
+	bool probe(int i)
+	{
+		int64_t rb = peakIndex->getOverviewBegin(i), re = peakIndex->getOverviewBegin(i + 1);
+		int lw = (int)std::min(re - rb, (int64_t)ProbeLength);
+		if(0 < lw)
+		{
+			if(!readChunk(rb + (re - rb - lw) / 2, lw)) return false;
+			for(int ich = 0; ich < peakIndex->numChannels; ++ich)
+			{
+				juce::Range<float> r = juce::FloatVectorOperations::findMinAndMax(buffer.getReadPointer(ich), lw);
+				peakIndex->overviewPeaks[ich][i] = { r.getStart(), r.getEnd() };
+			}
+		}
+		peakIndex->overviewValid[i] = true;
+		return true;
+	}
+	bool scanNextChunk()
+	{
+		int64_t pos = peakIndex->scannedLength;
+		int lchunk = (int)std::min(peakIndex->length - pos, (int64_t)WavePeakIndexImpl::ChunkLength);
+		if(lchunk <= 0) return false;
+		if(!readChunk(pos, lchunk)) return false;
+		int64_t iblock = pos / WavePeakIndex::BlockLength;
+		for(int ich = 0; ich < peakIndex->numChannels; ++ich)
+		{
+			WavePeakIndex::Peak acc;
+			bool found = false;
+			for(int off = 0; off < lchunk; off += WavePeakIndex::BlockLength)
+			{
+				juce::Range<float> r = juce::FloatVectorOperations::findMinAndMax(buffer.getReadPointer(ich, off), std::min(WavePeakIndex::BlockLength, lchunk - off));
+				WavePeakIndex::Peak pk{ r.getStart(), r.getEnd() };
+				peakIndex->exactPeaks[ich][(size_t)(iblock + off / WavePeakIndex::BlockLength)] = pk;
+				WavePeakIndexImpl::merge(acc, found, pk);
+			}
+			peakIndex->groupPeaks[ich][(size_t)(iblock / WavePeakIndex::GroupLength)] = acc;
+		}
+		peakIndex->scannedLength = pos + lchunk;
+		return true;
+	}
+	// the incomplete index is taken out of the source, so that the view stops waiting for it and the next content builds another
+	JobStatus giveUp()
+	{
+		sourceFile->peakIndex.discard(peakIndex);
+		return jobHasFinished;
+	}
+	virtual JobStatus runJob() override
+	{
+		if(sourceFile->getReferenceCount() <= 1) return giveUp();
+		if(nextProbe < WavePeakIndex::OverviewLength)
+		{
+			for(int c = 0; (c < ProbesPerRun) && (nextProbe < WavePeakIndex::OverviewLength); ++c, ++nextProbe)
+			{
+				if(!probe(reverseBits(nextProbe))) return giveUp();
+			}
+			return jobNeedsRunningAgain;
+		}
+		if(!scanNextChunk()) return peakIndex->isComplete() ? jobHasFinished : giveUp();
+		return peakIndex->isComplete() ? jobHasFinished : jobNeedsRunningAgain;
+	}
+};
+
+juce::ThreadPoolJob* WavePeakIndex::createBuilderJob(juce::ReferenceCountedObjectPtr<WaveSourceFile> src, Ptr index)
+{
+	std::shared_ptr<WavePeakIndexImpl> impl = std::dynamic_pointer_cast<WavePeakIndexImpl>(index);
+	if(!src || !impl) return nullptr;
+	return new WavePeakIndexBuilderJob(src, impl);
+}
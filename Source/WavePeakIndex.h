@@ -0,0 +1,43 @@
+//
+//  WavePeakIndex.h
+//  TestWaveEdit_App
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class WaveSourceFile;
+
+// per-source min/max summary, filled coarse to fine while the source is already in use
+class WavePeakIndex
+{
+protected:
+	WavePeakIndex() {}
+public:
+	using Ptr = std::shared_ptr<WavePeakIndex>;
+	static constexpr int BlockLength = 1024;	// samples summarized by one exact entry
+	static constexpr int GroupLength = 64;		// exact entries summarized by one group entry
+	static constexpr int OverviewLength = 1024;	// entries of the sparse overview
+	enum Precision
+	{
+		PrecisionNone,
+		PrecisionOverview,	// estimated from a sparse probe of the region
+		PrecisionExact,		// exact at BlockLength resolution
+	};
+	struct Peak
+	{
+		float min = 0;
+		float max = 0;
+	};
+	virtual ~WavePeakIndex() {}
+	virtual int getNumChannels() const = 0;
+	virtual int64_t getLength() const = 0;
+	virtual int64_t getScannedLength() const = 0;
+	virtual bool isComplete() const = 0;
+	virtual Precision getPeak(int ich, int64_t begin, int64_t end, Peak& pk) const = 0;
+	static Ptr createInstance(int cch, int64_t len);
+	// the job probes the source sparsely first, then scans it sequentially; it gives up once it holds the last reference to the source
+	// install the index in the source, see WaveAnalysisCache, before the job is scheduled
+	static juce::ThreadPoolJob* createBuilderJob(juce::ReferenceCountedObjectPtr<WaveSourceFile> src, Ptr index);
+};
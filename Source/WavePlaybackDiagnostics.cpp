@@ -0,0 +1,140 @@
+//
+//  WavePlaybackDiagnostics.cpp
+//  TestWaveEdit_App
+//
+
+#include "WavePlaybackDiagnostics.h"
+
+// ================================================================================
+// WaveHistogram
+
+double WaveHistogram::Snapshot::getPercentile(double p) const
+{
+	if(count == 0) return 0;
+	uint64_t rank = (uint64_t)std::ceil(juce::jlimit(0.0, 1.0, p) * (double)count);
+	uint64_t acc = 0;
+	for(int i = 0; i < NumBins; ++i)
+	{
+		acc += bins[i];
+		if(rank <= acc) return std::min(getBinUpperEdge(i), maximum);
+	}
+	return maximum;
+}
+
+double WaveHistogram::getBinUpperEdge(int i)
+{
+	return (i < (NumBins - 1)) ? std::exp2((double)i * 0.5) : std::numeric_limits<double>::infinity();
+}
+
+void WaveHistogram::add(double v)
+{
+	int i = (v < 1) ? 0 : std::min(NumBins - 1, 1 + (int)(std::log2(v) * 2));
+	bins[i].fetch_add(1, std::memory_order_relaxed);
+	// a single writer, so load and store do not lose updates
+	sum.store(sum.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+	if(maximum.load(std::memory_order_relaxed) < v) maximum.store(v, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_release);
+}
+
+void WaveHistogram::reset()
+{
+	for(auto& b : bins) b.store(0, std::memory_order_relaxed);
+	sum.store(0, std::memory_order_relaxed);
+	maximum.store(0, std::memory_order_relaxed);
+	count.store(0, std::memory_order_release);
+}
+
+WaveHistogram::Snapshot WaveHistogram::getSnapshot() const
+{
+	Snapshot s;
+	s.count = count.load(std::memory_order_acquire);
+	for(int i = 0; i < NumBins; ++i) s.bins[i] = bins[i].load(std::memory_order_relaxed);
+	s.sum = sum.load(std::memory_order_relaxed);
+	s.maximum = maximum.load(std::memory_order_relaxed);
+	return s;
+}
+
+// ================================================================================
+// WavePlaybackDiagnostics
+
+void WavePlaybackDiagnostics::addCallback(double seconds, double period)
+{
+	callbackTime.add(seconds * 1e6);
+	if(0 < period)
+	{
+		callbackLoad.add(seconds / period * 100);
+		if(period < seconds) deadlineMisses.fetch_add(1, std::memory_order_relaxed);
+	}
+	numCallbacks.fetch_add(1, std::memory_order_relaxed);
+}
+
+void WavePlaybackDiagnostics::resetIfRequested()
+{
+	if(!resetRequested.exchange(false)) return;
+	callbackTime.reset();
+	callbackLoad.reset();
+	readTime.reset();
+	scrubHeadroom.reset();
+	numCallbacks = 0;
+	deadlineMisses = 0;
+	readFailures = 0;
+	scrubUnderruns = 0;
+}
+
+namespace
+{
+	juce::var histogramToVar(const WaveHistogram& h)
+	{
+		WaveHistogram::Snapshot s = h.getSnapshot();
+		juce::DynamicObject::Ptr obj = new juce::DynamicObject();
+		obj->setProperty("count", (juce::int64)s.count);
+		obj->setProperty("mean", s.getMean());
+		obj->setProperty("p50", s.getPercentile(0.5));
+		obj->setProperty("p90", s.getPercentile(0.9));
+		obj->setProperty("p99", s.getPercentile(0.99));
+		obj->setProperty("max", s.maximum);
+		// the non-empty bins as [upper edge, count], the last edge is open
+		juce::Array<juce::var> bins;
+		for(int i = 0; i < WaveHistogram::NumBins; ++i)
+		{
+			if(s.bins[i] == 0) continue;
+			double edge = WaveHistogram::getBinUpperEdge(i);
+			bins.add(juce::Array<juce::var>{ std::isfinite(edge) ? juce::var(edge) : juce::var(), (juce::int64)s.bins[i] });
+		}
+		obj->setProperty("bins", bins);
+		return obj.get();
+	}
+
+	juce::String histogramToText(const char* name, const WaveHistogram& h, const char* unit)
+	{
+		WaveHistogram::Snapshot s = h.getSnapshot();
+		return juce::String::formatted("%-16s n=%-9llu mean %9.1f  p50 %9.1f  p99 %9.1f  max %9.1f %s\n",
+			name, (unsigned long long)s.count, s.getMean(), s.getPercentile(0.5), s.getPercentile(0.99), s.maximum, unit);
+	}
+}
+
+juce::var WavePlaybackDiagnostics::toVar() const
+{
+	juce::DynamicObject::Ptr obj = new juce::DynamicObject();
+	obj->setProperty("callbacks", (juce::int64)numCallbacks.load());
+	obj->setProperty("deadlineMisses", (juce::int64)deadlineMisses.load());
+	obj->setProperty("readFailures", (juce::int64)readFailures.load());
+	obj->setProperty("scrubUnderruns", (juce::int64)scrubUnderruns.load());
+	obj->setProperty("callbackTimeUs", histogramToVar(callbackTime));
+	obj->setProperty("callbackLoadPercent", histogramToVar(callbackLoad));
+	obj->setProperty("readTimeUs", histogramToVar(readTime));
+	obj->setProperty("scrubHeadroomSamples", histogramToVar(scrubHeadroom));
+	return obj.get();
+}
+
+juce::String WavePlaybackDiagnostics::toText() const
+{
+	juce::String s;
+	s << juce::String::formatted("callbacks %lld, deadline misses %lld, read failures %lld, scrub underruns %lld\n",
+		(long long)numCallbacks.load(), (long long)deadlineMisses.load(), (long long)readFailures.load(), (long long)scrubUnderruns.load());
+	s << histogramToText("callback time", callbackTime, "us");
+	s << histogramToText("callback load", callbackLoad, "%");
+	s << histogramToText("read time", readTime, "us");
+	s << histogramToText("scrub headroom", scrubHeadroom, "samples");
+	return s;
+}
@@ -0,0 +1,58 @@
+//
+//  WavePlaybackDiagnostics.h
+//  TestWaveEdit_App
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// a histogram filled by one thread and read by any other without locking
+// bin 0 counts values below 1, bin i counts values in [2^((i-1)/2), 2^(i/2)), the last bin everything above
+class WaveHistogram
+{
+public:
+	static constexpr int NumBins = 40;
+	struct Snapshot
+	{
+		uint64_t bins[NumBins] = {};
+		uint64_t count = 0;
+		double sum = 0;
+		double maximum = 0;
+		double getMean() const { return (0 < count) ? (sum / (double)count) : 0; }
+		// the upper edge of the bin holding the given fraction of the values
+		double getPercentile(double p) const;
+	};
+	static double getBinUpperEdge(int i);
+	// the filling thread
+	void add(double v);
+	void reset();
+	// any thread; the fields may be off by the one value being added meanwhile
+	Snapshot getSnapshot() const;
+private:
+	std::atomic<uint64_t> bins[NumBins]{};
+	std::atomic<uint64_t> count{ 0 };
+	std::atomic<double> sum{ 0 };
+	std::atomic<double> maximum{ 0 };
+};
+
+// what the audio callback reports about itself; only the audio thread writes, so reading never disturbs it
+struct WavePlaybackDiagnostics
+{
+	WaveHistogram callbackTime;		// microseconds of wall time per callback
+	WaveHistogram callbackLoad;		// the callback time in percent of the buffer period
+	WaveHistogram readTime;			// microseconds per callback spent reading the source files
+	WaveHistogram scrubHeadroom;	// samples the scrub window held ahead of the position after each block
+	std::atomic<int64_t> numCallbacks{ 0 };
+	std::atomic<int64_t> deadlineMisses{ 0 };	// callbacks that took longer than the buffer period
+	std::atomic<int64_t> readFailures{ 0 };		// blocks the source files could not deliver
+	std::atomic<int64_t> scrubUnderruns{ 0 };	// blocks rendered while the scrub window did not cover the position
+	std::atomic<bool> resetRequested{ false };
+	// audio thread
+	void addCallback(double seconds, double period);
+	void resetIfRequested();
+	// any thread; the audio thread clears everything on its next callback
+	void requestReset() { resetRequested = true; }
+	juce::var toVar() const;
+	juce::String toText() const;
+};
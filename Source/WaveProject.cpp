@@ -0,0 +1,287 @@
+//
+//  WaveProject.cpp
+//  TestWaveEdit_App
+//
+
+#include "WaveProject.h"
+#include "WaveTrace.h"
+
+namespace
+{
+	constexpr const char* FormatName = "TestWaveEdit EDL";
+	constexpr int FormatVersion = 1;
+
+	bool isRender(const WaveSourceFile& src)
+	{
+		// a detached archived source reads from a render in the temporary directory as well
+		return (dynamic_cast<const TemporaryWaveSourceFile*>(&src) != nullptr) || src.backingFile.isAChildOf(TemporaryWaveSourceFile::getTempDirectory());
+	}
+}
+
+std::pair<int, bool> WaveProject::SourceTable::add(const WaveSourceFile::Ptr& src)
+{
+	auto [it, added] = indices.insert({ src.get(), sources.size() });
+	if(added) sources.add(src);
+	return { it->second, added };
+}
+
+void WaveProject::applyChange(WaveCutList& cl, const Change& c)
+{
+	if(!c.range.isEmpty()) cl.eraseRange(c.range);
+	if(!c.cutList.empty()) cl.insertList(c.cutList, c.range.begin);
+}
+
+juce::File WaveProject::getDataDirectory(const juce::File& path)
+{
+	return path.getSiblingFile(path.getFileNameWithoutExtension() + " Data");
+}
+
+uint64_t WaveProject::calcFingerprint(const juce::File& file)
+{
+	static constexpr int64_t SpanLength = 65536;
+	juce::FileInputStream str(file);
+	if(str.failedToOpen()) return 0;
+	// FNV-1a, like the output checksum of the null device
+	uint64_t h = 0xcbf29ce484222325ULL;
+	auto add = [&h](const void* p, size_t n)
+	{
+		for(size_t i = 0; i < n; ++i) h = (h ^ ((const uint8_t*)p)[i]) * 0x100000001b3ULL;
+	};
+	int64_t size = str.getTotalLength();
+	add(&size, sizeof(size));
+	juce::HeapBlock<char> buf(SpanLength);
+	for(int64_t pos : { (int64_t)0, std::max((int64_t)0, size - SpanLength) })
+	{
+		str.setPosition(pos);
+		int len = str.read(buf, (int)SpanLength);
+		add(buf, (size_t)std::max(0, len));
+	}
+	return h;
+}
+
+juce::var WaveProject::sourceToVar(const WaveSourceFile& src, const juce::File& path, const juce::File& datadir, juce::Result& r)
+{
+	juce::DynamicObject::Ptr obj = new juce::DynamicObject();
+	juce::File file = src.backingFile;
+	if(isRender(src))
+	{
+		obj->setProperty("kind", "render");
+		if(datadir != juce::File())
+		{
+			// the renders are never written again once created, so a kept copy of the same name is up to date
+			juce::File kept = datadir.getChildFile(file.getFileName());
+			if((kept != file) && (!kept.existsAsFile() || (kept.getSize() != file.getSize())))
+			{
+				if(!datadir.createDirectory() || !file.copyFileTo(kept))
+				{
+					r = juce::Result::fail("failed to copy " + file.getFileName().quoted() + " to " + datadir.getFullPathName().quoted());
+					return {};
+				}
+			}
+			obj->setProperty("name", kept.getFileName());
+			file = kept;
+		}
+		else obj->setProperty("path", file.getFullPathName());
+	}
+	else
+	{
+		obj->setProperty("kind", "file");
+		obj->setProperty("path", file.getFullPathName());
+		if(path != juce::File()) obj->setProperty("relativePath", file.getRelativePathFrom(path.getParentDirectory()));
+		// the renders have unique names and are ours alone, so checking their size is enough; the originals may be replaced behind our back
+		obj->setProperty("fingerprint", juce::String::toHexString((juce::int64)calcFingerprint(file)));
+	}
+	obj->setProperty("size", file.getSize());
+	obj->setProperty("length", (juce::int64)src.length);
+	return obj.get();
+}
+
+WaveSourceFile::Ptr WaveProject::varToSource(juce::AudioFormatManager& afm, const juce::var& v, const juce::File& path, const juce::File& datadir, const WaveFormat& fmt, juce::Result& r)
+{
+	bool render = (v["kind"].toString() == "render");
+	juce::File file = v.hasProperty("path") ? juce::File(v["path"].toString()) : datadir.getChildFile(v["name"].toString());
+	// a project moved together with its sources finds them where they were relative to it
+	if(!render && !file.existsAsFile() && v.hasProperty("relativePath")) file = path.getParentDirectory().getChildFile(v["relativePath"].toString());
+	if(!file.existsAsFile())
+	{
+		r = juce::Result::fail(file.getFullPathName().quoted() + " is missing");
+		return nullptr;
+	}
+	if((file.getSize() != (juce::int64)v["size"]) || (!render && (juce::String::toHexString((juce::int64)calcFingerprint(file)) != v["fingerprint"].toString())))
+	{
+		r = juce::Result::fail(file.getFullPathName().quoted() + " has changed since it was saved");
+		return nullptr;
+	}
+	// renders left in the temporary directory are owned again, the others stay where they are
+	WaveSourceFile::Ptr src;
+	if(!render) src = ArchivedWaveSourceFile::createInstance(afm, file);
+	else if(file.isAChildOf(TemporaryWaveSourceFile::getTempDirectory())) src = TemporaryWaveSourceFile::createInstanceFromCompatiblePath(file);
+	else src = TemporaryWaveSourceFile::createInstanceFromKeptPath(file);
+	if(!src)
+	{
+		r = juce::Result::fail("failed to open " + file.getFullPathName().quoted());
+		return nullptr;
+	}
+	if((src->length != (juce::int64)v["length"]) || (src->format != fmt))
+	{
+		r = juce::Result::fail(file.getFullPathName().quoted() + " does not match");
+		return nullptr;
+	}
+	return src;
+}
+
+juce::var WaveProject::cutListToVar(const WaveCutList& cl, const SourceTable& table)
+{
+	juce::Array<juce::var> cuts;
+	cuts.ensureStorageAllocated((int)cl.size());
+	for(const WaveCut& c : cl) cuts.add(juce::Array<juce::var>{ table.indices.at(c.sourceFile.get()), (juce::int64)c.range.begin, (juce::int64)c.range.end });
+	return cuts;
+}
+
+bool WaveProject::varToCutList(const juce::var& v, const juce::Array<WaveSourceFile::Ptr>& sources, WaveCutList& cl)
+{
+	const juce::Array<juce::var>* cuts = v.getArray();
+	if(!cuts) return false;
+	for(const juce::var& c : *cuts)
+	{
+		const juce::Array<juce::var>* a = c.getArray();
+		if(!a || (a->size() != 3)) return false;
+		int isrc = (*a)[0];
+		Range64 r{ (juce::int64)(*a)[1], (juce::int64)(*a)[2] };
+		if(!juce::isPositiveAndBelow(isrc, sources.size()) || r.isEmpty() || (r.begin < 0) || (sources[isrc]->length < r.end)) return false;
+		cl.push_back({ sources[isrc], r });
+	}
+	return true;
+}
+
+juce::var WaveProject::contentToVar(const Content& content, const juce::File& path, const juce::File& datadir, SourceTable& table, juce::Result& r)
+{
+	juce::Array<juce::var> sources;
+	auto addSources = [&](const WaveCutList& cl)
+	{
+		for(const WaveCut& c : cl)
+		{
+			if(!table.add(c.sourceFile).second) continue;
+			sources.add(sourceToVar(*c.sourceFile, path, datadir, r));
+			if(r.failed()) return false;
+		}
+		return true;
+	};
+	if(!addSources(content.base)) return {};
+	for(const Step& st : content.history)
+	{
+		for(const Change& c : st.changes)
+		{
+			if(!addSources(c.cutList)) return {};
+		}
+	}
+	// a step holds what its edit replaced, so the file grows with the edits rather than with the cuts times the steps
+	juce::Array<juce::var> history;
+	for(const Step& st : content.history)
+	{
+		juce::Array<juce::var> changes;
+		for(const Change& c : st.changes) changes.add(juce::Array<juce::var>{ (juce::int64)c.range.begin, (juce::int64)c.range.end, cutListToVar(c.cutList, table) });
+		juce::DynamicObject::Ptr obj = new juce::DynamicObject();
+		obj->setProperty("name", st.name);
+		obj->setProperty("changes", changes);
+		history.add(obj.get());
+	}
+	juce::DynamicObject::Ptr metadata = new juce::DynamicObject();
+	for(const juce::String& key : content.metadata.getAllKeys()) metadata->setProperty(key, content.metadata[key]);
+	juce::DynamicObject::Ptr root = new juce::DynamicObject();
+	root->setProperty("format", FormatName);
+	root->setProperty("version", FormatVersion);
+	root->setProperty("sampleRate", content.format.sampleRate);
+	root->setProperty("numChannels", content.format.numChannels);
+	root->setProperty("bitsPerSample", content.bitsPerSample);
+	root->setProperty("metadata", metadata.get());
+	root->setProperty("sources", sources);
+	root->setProperty("base", cutListToVar(content.base, table));
+	root->setProperty("history", history);
+	root->setProperty("current", content.current);
+	return root.get();
+}
+
+juce::Result WaveProject::varToContent(juce::AudioFormatManager& afm, const juce::var& root, const juce::File& path, const juce::File& datadir, Content& content, juce::Array<WaveSourceFile::Ptr>& sources)
+{
+	content = {};
+	sources.clear();
+	if(root["format"].toString() != FormatName) return juce::Result::fail("not a project");
+	if(FormatVersion < (int)root["version"]) return juce::Result::fail("saved by a newer version");
+	content.format = { (double)root["sampleRate"], (int)root["numChannels"] };
+	content.bitsPerSample = root["bitsPerSample"];
+	if(juce::DynamicObject* metadata = root["metadata"].getDynamicObject())
+	{
+		for(const juce::NamedValueSet::NamedValue& nv : metadata->getProperties()) content.metadata.set(nv.name.toString(), nv.value.toString());
+	}
+	if(const juce::Array<juce::var>* vsources = root["sources"].getArray())
+	{
+		for(const juce::var& v : *vsources)
+		{
+			juce::Result r = juce::Result::ok();
+			WaveSourceFile::Ptr src = varToSource(afm, v, path, datadir, content.format, r);
+			if(!src) return r;
+			sources.add(src);
+		}
+	}
+	if(!root["base"].isArray() || !varToCutList(root["base"], sources, content.base)) return juce::Result::fail("broken cut list");
+	// the ranges are checked against the length of the list they apply to, so that restoring the history cannot fail halfway
+	const juce::Array<juce::var>* vhistory = root["history"].getArray();
+	int64_t length = content.base.calcTotalSize();
+	for(int i = 0; vhistory && (i < vhistory->size()); ++i)
+	{
+		const juce::var& v = (*vhistory)[i];
+		const juce::Array<juce::var>* vchanges = v["changes"].getArray();
+		if(!vchanges || vchanges->isEmpty()) return juce::Result::fail("broken history");
+		Step st;
+		st.name = v["name"].toString();
+		for(const juce::var& vc : *vchanges)
+		{
+			const juce::Array<juce::var>* a = vc.getArray();
+			if(!a || (a->size() != 3)) return juce::Result::fail("broken history");
+			Change c;
+			c.range = { (juce::int64)(*a)[0], (juce::int64)(*a)[1] };
+			if((c.range.begin < 0) || (c.range.end < c.range.begin) || (length < c.range.end) || !varToCutList((*a)[2], sources, c.cutList)) return juce::Result::fail("broken history");
+			length += c.cutList.calcTotalSize() - c.range.size();
+			st.changes.push_back(std::move(c));
+		}
+		content.history.push_back(std::move(st));
+	}
+	content.current = juce::jlimit(0, (int)content.history.size(), (int)root["current"]);
+	return juce::Result::ok();
+}
+
+juce::Result WaveProject::write(const juce::File& path, const Content& content)
+{
+	WAVE_TRACE_SCOPE("io", "WaveProject::write");
+	SourceTable table;
+	juce::Result r = juce::Result::ok();
+	juce::File datadir = getDataDirectory(path);
+	juce::var root = contentToVar(content, path, datadir, table, r);
+	if(r.failed()) return r;
+	// written beside and swapped in, so that a failure leaves the previous save intact
+	juce::TemporaryFile tmp(path);
+	if(!tmp.getFile().replaceWithText(juce::JSON::toString(root, true))) return juce::Result::fail("failed to write " + path.getFileName().quoted());
+	if(!tmp.overwriteTargetFileWithTemporary()) return juce::Result::fail("failed to replace " + path.getFileName().quoted());
+	// the kept renders that the new save no longer refers to, e.g. those of edits undone since the last one, go only once it is in place
+	juce::StringArray kept;
+	for(const WaveSourceFile::Ptr& src : table.sources)
+	{
+		if(isRender(*src)) kept.add(src->backingFile.getFileName());
+	}
+	for(const juce::File& file : datadir.findChildFiles(juce::File::findFiles, false))
+	{
+		if(!kept.contains(file.getFileName()) && !file.deleteFile()) DBG("[WaveProject] write() failed to delete " << file.getFullPathName().quoted());
+	}
+	return juce::Result::ok();
+}
+
+juce::Result WaveProject::read(juce::AudioFormatManager& afm, const juce::File& path, Content& content)
+{
+	WAVE_TRACE_SCOPE("io", "WaveProject::read");
+	juce::var root;
+	juce::Result r = juce::JSON::parse(path.loadFileAsString(), root);
+	if(r.failed()) return r;
+	juce::Array<WaveSourceFile::Ptr> sources;
+	return varToContent(afm, root, path, getDataDirectory(path), content, sources);
+}
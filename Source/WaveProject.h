@@ -0,0 +1,61 @@
+//
+//  WaveProject.h
+//  TestWaveEdit_App
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "WaveCutList.h"
+
+// an edit decision list: the cut lists of a document and its undo history as references into the source files
+// the sources are checked against a fingerprint on reopening; the renders are kept in a directory next to the project,
+// and only those not kept yet are copied, so saving takes milliseconds regardless of the audio length
+class WaveProject
+{
+public:
+	static constexpr const char* FileExtension = ".wedl";
+	// a part of an edit: the range of the list before it, replaced by the cuts
+	struct Change
+	{
+		Range64 range;
+		WaveCutList cutList;
+	};
+	// an undo transaction as the changes it made, in their order
+	struct Step
+	{
+		juce::String name;
+		std::vector<Change> changes;
+	};
+	struct Content
+	{
+		WaveFormat format = {};
+		int bitsPerSample = 0;
+		juce::StringPairArray metadata;
+		WaveCutList base;			// the state the oldest step starts from
+		std::vector<Step> history;	// oldest first
+		int current = 0;			// the steps done, those after it can be redone
+	};
+	// the sources of a content in the order of their first use, the cut lists refer to them by index
+	struct SourceTable
+	{
+		std::map<const WaveSourceFile*, int> indices;
+		juce::Array<WaveSourceFile::Ptr> sources;
+		// the index of the source, and whether it was added
+		std::pair<int, bool> add(const WaveSourceFile::Ptr& src);
+	};
+	static void applyChange(WaveCutList& cl, const Change& c);
+	static juce::File getDataDirectory(const juce::File& path);
+	// the size and the first and last 64 KiB; enough to notice a replaced or rewritten file without reading it all
+	static uint64_t calcFingerprint(const juce::File& file);
+	// the files of the data directory that the content does not refer to are deleted once the project is in place
+	static juce::Result write(const juce::File& path, const Content& content);
+	static juce::Result read(juce::AudioFormatManager& afm, const juce::File& path, Content& content);
+	// the pieces shared with the journal; without a data directory the renders are referred to where they are
+	static juce::var sourceToVar(const WaveSourceFile& src, const juce::File& path, const juce::File& datadir, juce::Result& r);
+	static WaveSourceFile::Ptr varToSource(juce::AudioFormatManager& afm, const juce::var& v, const juce::File& path, const juce::File& datadir, const WaveFormat& fmt, juce::Result& r);
+	static juce::var cutListToVar(const WaveCutList& cl, const SourceTable& table);
+	static bool varToCutList(const juce::var& v, const juce::Array<WaveSourceFile::Ptr>& sources, WaveCutList& cl);
+	static juce::var contentToVar(const Content& content, const juce::File& path, const juce::File& datadir, SourceTable& table, juce::Result& r);
+	static juce::Result varToContent(juce::AudioFormatManager& afm, const juce::var& root, const juce::File& path, const juce::File& datadir, Content& content, juce::Array<WaveSourceFile::Ptr>& sources);
+};
@@ -0,0 +1,329 @@
+//
+//  WaveResampler.cpp
+//  TestWaveEdit_App
+//
+
+#include "WaveResampler.h"
+#if JUCE_INTEL
+#include <emmintrin.h>
+#elif JUCE_ARM && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+	struct QualitySpec
+	{
+		int numTaps;		// kernel length at unity ratio, grows with the decimation ratio
+		int numPhases;		// table rows between two input samples, interpolated linearly
+		double passBand;	// cutoff relative to the lower Nyquist frequency
+		double kaiserBeta;
+	};
+	const QualitySpec QualitySpecs[WaveResampler::NumQualities] =
+	{
+		{ 8, 64, 0.80, 4.0 },
+		{ 32, 256, 0.90, 7.0 },
+		{ 128, 1024, 0.96, 10.0 },
+	};
+	constexpr int MaxTaps = 2048;
+
+	double besselI0(double x)
+	{
+		double sum = 1, term = 1, q = x * x * 0.25;
+		for(int k = 1; k < 64; ++k)
+		{
+			term *= q / (double)(k * k);
+			sum += term;
+			if(term < (sum * 1e-12)) break;
+		}
+		return sum;
+	}
+
+	// returns the dot products of x with two kernel rows; n is a multiple of 4
+	void dotProduct2(const float* c0, const float* c1, const float* x, int n, float& r0, float& r1)
+	{
+#if JUCE_INTEL
+		__m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+		for(int k = 0; k < n; k += 4)
+		{
+			__m128 v = _mm_loadu_ps(x + k);
+			a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(c0 + k), v));
+			a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(c1 + k), v));
+		}
+		alignas(16) float s0[4], s1[4];
+		_mm_store_ps(s0, a0);
+		_mm_store_ps(s1, a1);
+		r0 = (s0[0] + s0[1]) + (s0[2] + s0[3]);
+		r1 = (s1[0] + s1[1]) + (s1[2] + s1[3]);
+#elif JUCE_ARM && defined(__ARM_NEON)
+		float32x4_t a0 = vdupq_n_f32(0), a1 = vdupq_n_f32(0);
+		for(int k = 0; k < n; k += 4)
+		{
+			float32x4_t v = vld1q_f32(x + k);
+			a0 = vmlaq_f32(a0, vld1q_f32(c0 + k), v);
+			a1 = vmlaq_f32(a1, vld1q_f32(c1 + k), v);
+		}
+		float32x2_t p0 = vadd_f32(vget_low_f32(a0), vget_high_f32(a0));
+		float32x2_t p1 = vadd_f32(vget_low_f32(a1), vget_high_f32(a1));
+		r0 = vget_lane_f32(p0, 0) + vget_lane_f32(p0, 1);
+		r1 = vget_lane_f32(p1, 0) + vget_lane_f32(p1, 1);
+#else
+		float a0[4] = {}, a1[4] = {};
+		for(int k = 0; k < n; k += 4)
+		{
+			for(int j = 0; j < 4; ++j)
+			{
+				a0[j] += c0[k + j] * x[k + j];
+				a1[j] += c1[k + j] * x[k + j];
+			}
+		}
+		r0 = (a0[0] + a0[1]) + (a0[2] + a0[3]);
+		r1 = (a1[0] + a1[1]) + (a1[2] + a1[3]);
+#endif
+	}
+}
+
+class WaveResamplerImpl : public WaveResampler
+{
+public:
+	juce::AudioSource* input;
+	int numChannels = 0;
+	std::unique_ptr<Kernel> kernel;
+	// copied from the kernel
+	Quality quality = QualityNormal;
+	double ratio = 1;
+	int numTaps = 0;
+	int numPhases = 0;
+	// input history: samples [0, bufferedLength) are valid, the next output is centered between readIndex and readIndex + 1
+	juce::AudioBuffer<float> inputBuffer;
+	int bufferedLength = 0;
+	int readIndex = 0;
+	double readFraction = 0;
+	int maxOutputPerPass = 512;
+	WaveResamplerImpl(juce::AudioSource* src, int cch, Quality q) : input(src), numChannels(cch)
+	{
+		std::unique_ptr<Kernel> k = createKernel(q, 1);
+		swapKernel(k);
+	}
+	void allocateBuffer()
+	{
+		int capacity = numTaps + (int)std::ceil(std::max(1, maxOutputPerPass) * ratio) + 2;
+		if(capacity <= inputBuffer.getNumSamples() && (numChannels == inputBuffer.getNumChannels())) { clampHistory(); return; }
+		juce::AudioBuffer<float> newbuffer(numChannels, capacity);
+		newbuffer.clear();
+		int keep = std::min(bufferedLength, capacity - numTaps);
+		int drop = bufferedLength - keep;
+		for(int ich = 0; ich < std::min(numChannels, inputBuffer.getNumChannels()); ++ich)
+		{
+			if(0 < keep) newbuffer.copyFrom(ich, 0, inputBuffer, ich, drop, keep);
+		}
+		inputBuffer = std::move(newbuffer);
+		bufferedLength = keep;
+		readIndex = std::max(0, readIndex - drop);
+		clampHistory();
+	}
+	void clampHistory()
+	{
+		// a longer kernel needs at least half of its length of history before the read position
+		int half = numTaps / 2;
+		if(readIndex < (half - 1))
+		{
+			int shift = (half - 1) - readIndex;
+			if(inputBuffer.getNumSamples() < (bufferedLength + shift)) { resetHistory(); return; }
+			for(int ich = 0; ich < numChannels; ++ich)
+			{
+				float* p = inputBuffer.getWritePointer(ich);
+				std::memmove(p + shift, p, sizeof(float) * (size_t)bufferedLength);
+				juce::FloatVectorOperations::clear(p, shift);
+			}
+			readIndex += shift;
+			bufferedLength += shift;
+		}
+	}
+	void resetHistory()
+	{
+		inputBuffer.clear();
+		readIndex = numTaps / 2 - 1;
+		bufferedLength = readIndex;
+		readFraction = 0;
+	}
+	void pullInput(int len)
+	{
+		if(len <= 0) return;
+		inputBuffer.clear(bufferedLength, len);
+		if(input) input->getNextAudioBlock(juce::AudioSourceChannelInfo(&inputBuffer, bufferedLength, len));
+		bufferedLength += len;
+	}
+	void discardHistory()
+	{
+		int drop = readIndex - (numTaps / 2 - 1);
+		if(drop <= 0) return;
+		int keep = bufferedLength - drop;
+		for(int ich = 0; ich < numChannels; ++ich)
+		{
+			float* p = inputBuffer.getWritePointer(ich);
+			std::memmove(p, p + drop, sizeof(float) * (size_t)keep);
+		}
+		readIndex -= drop;
+		bufferedLength = keep;
+	}
+	// --------------------------------------------------------------------------------
+	// juce::AudioSource
+	virtual void prepareToPlay(int lbuf, double fs) override
+	{
+		maxOutputPerPass = std::max(1, lbuf);
+		allocateBuffer();
+		resetHistory();
+		if(input) input->prepareToPlay(juce::roundToInt(lbuf * ratio), fs * ratio);
+	}
+	virtual void releaseResources() override
+	{
+		if(input) input->releaseResources();
+		inputBuffer.setSize(numChannels, 0);
+		bufferedLength = readIndex = 0;
+	}
+	virtual void getNextAudioBlock(const juce::AudioSourceChannelInfo& asci) override
+	{
+		if(inputBuffer.getNumSamples() <= numTaps) { asci.clearActiveBufferRegion(); return; }
+		int ccho = asci.buffer->getNumChannels();
+		int cch = std::min(numChannels, ccho);
+		int half = numTaps / 2;
+		bool bypass = (ratio == 1.0);
+		int pos = 0;
+		while(pos < asci.numSamples)
+		{
+			int lout = std::min(asci.numSamples - pos, maxOutputPerPass);
+			int lastindex = readIndex + (int)(readFraction + ratio * (lout - 1));
+			int need = lastindex + half + 1;
+			if(inputBuffer.getNumSamples() < need) lout = 1, need = readIndex + (int)readFraction + half + 1;
+			pullInput(need - bufferedLength);
+			for(int i = 0; i < lout; ++i)
+			{
+				int ib = readIndex - (half - 1);
+				if(bypass && (readFraction == 0))
+				{
+					for(int ich = 0; ich < cch; ++ich) asci.buffer->setSample(ich, asci.startSample + pos + i, inputBuffer.getSample(ich, readIndex));
+				}
+				else
+				{
+					double pf = readFraction * numPhases;
+					int p = std::min(numPhases - 1, (int)pf);
+					float t = (float)(pf - p);
+					const float* c0 = kernel->coefs.data() + (size_t)p * numTaps;
+					const float* c1 = c0 + numTaps;
+					for(int ich = 0; ich < cch; ++ich)
+					{
+						float r0, r1;
+						dotProduct2(c0, c1, inputBuffer.getReadPointer(ich, ib), numTaps, r0, r1);
+						asci.buffer->setSample(ich, asci.startSample + pos + i, r0 + t * (r1 - r0));
+					}
+				}
+				readFraction += ratio;
+				int adv = (int)readFraction;
+				readIndex += adv;
+				readFraction -= adv;
+			}
+			discardHistory();
+			pos += lout;
+		}
+		for(int ich = cch; ich < ccho; ++ich) asci.buffer->clear(ich, asci.startSample, asci.numSamples);
+	}
+	// --------------------------------------------------------------------------------
+	// WaveResampler
+	virtual int getNumChannels() const override
+	{
+		return numChannels;
+	}
+	virtual Quality getQuality() const override
+	{
+		return quality;
+	}
+	virtual void setQuality(Quality v) override
+	{
+		if((v < 0) || (NumQualities <= v) || (quality == v)) return;
+		std::unique_ptr<Kernel> k = createKernel(v, ratio);
+		swapKernel(k);
+	}
+	virtual double getResamplingRatio() const override
+	{
+		return ratio;
+	}
+	virtual void setResamplingRatio(double v) override
+	{
+		if((v <= 0) || (ratio == v)) return;
+		std::unique_ptr<Kernel> k = createKernel(quality, v);
+		swapKernel(k);
+	}
+	// the buffer only grows when a longer kernel or a higher ratio needs more history than it holds
+	virtual void swapKernel(std::unique_ptr<Kernel>& k) override
+	{
+		if(!k) return;
+		std::swap(kernel, k);
+		quality = kernel->quality;
+		ratio = kernel->ratio;
+		numTaps = kernel->numTaps;
+		numPhases = kernel->numPhases;
+		allocateBuffer();
+	}
+	virtual void flushBuffers() override
+	{
+		if(0 < inputBuffer.getNumSamples()) resetHistory();
+	}
+	virtual double getLookahead() const override
+	{
+		return std::max(0.0, (double)bufferedLength - ((double)readIndex + readFraction));
+	}
+};
+
+const char* WaveResampler::getQualityName(Quality q)
+{
+	switch(q)
+	{
+		case QualityPreview: return "Preview";
+		case QualityNormal: return "Normal";
+		case QualityMastering: return "Mastering";
+		default: return "";
+	}
+}
+
+std::unique_ptr<WaveResampler::Kernel> WaveResampler::createKernel(Quality q, double ratio)
+{
+	if((q < 0) || (NumQualities <= q) || (ratio <= 0)) return nullptr;
+	const QualitySpec& spec = QualitySpecs[q];
+	std::unique_ptr<Kernel> k = std::make_unique<Kernel>();
+	k->quality = q;
+	k->ratio = ratio;
+	double scale = std::min(1.0, 1.0 / ratio);
+	double fc = spec.passBand * scale;
+	k->numTaps = std::min(MaxTaps, (((int)std::ceil(spec.numTaps / scale) + 3) / 4) * 4);
+	k->numPhases = spec.numPhases;
+	k->coefs.assign((size_t)(k->numPhases + 1) * k->numTaps, 0.0f);
+	int half = k->numTaps / 2;
+	double i0beta = besselI0(spec.kaiserBeta);
+	std::vector<double> h((size_t)k->numTaps);
+	for(int p = 0; p <= k->numPhases; ++p)
+	{
+		float* row = k->coefs.data() + (size_t)p * k->numTaps;
+		double frac = (double)p / (double)k->numPhases, sum = 0;
+		std::fill(h.begin(), h.end(), 0.0);
+		for(int i = 0; i < k->numTaps; ++i)
+		{
+			double d = (double)(i - (half - 1)) - frac;
+			double w = d / (double)half;
+			if(1 <= std::abs(w)) continue;
+			double x = juce::MathConstants<double>::pi * fc * d;
+			double sinc = (x != 0) ? (std::sin(x) / x) : 1;
+			h[(size_t)i] = fc * sinc * besselI0(spec.kaiserBeta * std::sqrt(1 - w * w)) / i0beta;
+			sum += h[(size_t)i];
+		}
+		// unity gain at DC for every phase
+		for(int i = 0; i < k->numTaps; ++i) row[i] = (float)((0 != sum) ? (h[(size_t)i] / sum) : 0);
+	}
+	return k;
+}
+
+std::unique_ptr<WaveResampler> WaveResampler::createInstance(juce::AudioSource* input, int cch, Quality q)
+{
+	if((cch <= 0) || (q < 0) || (NumQualities <= q)) return nullptr;
+	return std::make_unique<WaveResamplerImpl>(input, cch, q);
+}
@@ -0,0 +1,47 @@
+//
+//  WaveResampler.h
+//  TestWaveEdit_App
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// polyphase windowed-sinc sample rate converter pulling from another AudioSource
+// the filter history survives changes of the input content; only flushBuffers() clears it
+class WaveResampler : public juce::AudioSource
+{
+public:
+	enum Quality
+	{
+		QualityPreview,		// short kernel, audible roll-off, lowest CPU
+		QualityNormal,
+		QualityMastering,	// long kernel, transparent pass band
+		NumQualities,
+	};
+	// the coefficient table of a quality at a ratio, too expensive to build where the audio thread waits for it
+	struct Kernel
+	{
+		Quality quality = QualityNormal;
+		double ratio = 1;	// source samples per output sample
+		int numTaps = 0;	// grows with the decimation ratio, a multiple of 4
+		int numPhases = 0;	// (numPhases + 1) rows of numTaps coefficients, row p is centered at the fraction p / numPhases
+		std::vector<float> coefs;
+	};
+	virtual ~WaveResampler() {}
+	virtual int getNumChannels() const = 0;
+	virtual Quality getQuality() const = 0;
+	// rebuilds the kernel, call it outside the audio thread
+	virtual void setQuality(Quality v) = 0;
+	virtual double getResamplingRatio() const = 0;
+	// source samples per output sample; rebuilds the kernel when the ratio changes, call it outside the audio thread
+	virtual void setResamplingRatio(double v) = 0;
+	// takes a kernel from createKernel() and hands back the previous one, to be released outside the lock of the audio thread, under which the swap is cheap
+	virtual void swapKernel(std::unique_ptr<Kernel>& k) = 0;
+	virtual void flushBuffers() = 0;
+	// input samples already pulled but not yet consumed by the output
+	virtual double getLookahead() const = 0;
+	static const char* getQualityName(Quality q);
+	static std::unique_ptr<Kernel> createKernel(Quality q, double ratio);
+	static std::unique_ptr<WaveResampler> createInstance(juce::AudioSource* input, int cch, Quality q);
+};
@@ -0,0 +1,226 @@
+//
+//  WaveScrubber.cpp
+//  TestWaveEdit_App
+//
+
+#include "WaveScrubber.h"
+
+class WaveScrubberImpl : public WaveScrubber, public juce::Thread
+{
+public:
+	static constexpr int WindowLength = 1 << 18;		// samples held around the target
+	static constexpr int ReadLength = 16384;
+	static constexpr double FollowTime = 0.05;			// seconds to close the distance to the target
+	static constexpr double MaxSpeed = 8;				// relative to the normal playback speed
+	static constexpr int FadeLength = 128;				// samples to fade across a jump or a missing window
+	struct Window
+	{
+		juce::AudioBuffer<float> buffer;
+		int64_t start = 0;
+		int length = 0;
+		uint32_t generation = 0;
+	};
+	// triple buffer: the loader owns windows[backIndex], the audio thread owns windows[frontIndex],
+	// the third one is handed over through middleIndex, flagged while it holds a window not yet taken
+	static constexpr int Fresh = 4;
+	Window windows[3];
+	int backIndex = 0;
+	int frontIndex = 2;
+	std::atomic<int> middleIndex{ 1 };
+	// shared state
+	std::atomic<int64_t> targetPosition{ 0 };
+	std::atomic<int64_t> currentPosition{ 0 };
+	std::atomic<uint32_t> generation{ 1 };
+	std::atomic<int64_t> totalLength{ 0 };
+	std::atomic<double> sourceSampleRate{ 0 };
+	std::atomic<bool> active{ false };
+	// loader state
+	juce::CriticalSection listLock;
+	WaveCutList pendingList;
+	bool listChanged = false;
+	WaveCutListReader::Ptr reader;
+	int numChannels = 0;
+	Range64 loadedRange{};
+	uint32_t loadedGeneration = 0;
+	// audio thread state
+	double position = 0;
+	double speed = 0;	// source samples per second
+	float gain = 0;
+	bool jumping = false;
+	int64_t headroom = 0;
+	WaveScrubberImpl() : juce::Thread("WaveScrubber")
+	{
+		reader = WaveCutListReader::createInstance(true);
+		startThread();
+	}
+	virtual ~WaveScrubberImpl()
+	{
+		stopThread(4000);
+	}
+	void publishWindow()
+	{
+		int prev = middleIndex.exchange(backIndex | Fresh);
+		backIndex = prev & 3;
+	}
+	const Window& acquireWindow()
+	{
+		if(middleIndex.load() & Fresh)
+		{
+			int prev = middleIndex.exchange(frontIndex);
+			frontIndex = prev & 3;
+		}
+		return windows[frontIndex];
+	}
+	void updateList()
+	{
+		juce::ScopedLock sl(listLock);
+		if(!listChanged) return;
+		reader->setWaveCutList(pendingList);
+		numChannels = pendingList.empty() ? 0 : pendingList.front().sourceFile->format.numChannels;
+		listChanged = false;
+		loadedGeneration = 0;
+	}
+	bool needsLoad(int64_t target, uint32_t gen) const
+	{
+		if(loadedGeneration != gen) return true;
+		// reload once the target leaves the middle half of the loaded window
+		int64_t margin = std::min((int64_t)WindowLength / 4, loadedRange.size() / 4);
+		Range64 rinner{ loadedRange.begin + margin, loadedRange.end - margin };
+		if(loadedRange.begin <= 0) rinner.begin = 0;
+		if(totalLength <= loadedRange.end) rinner.end = totalLength;
+		return !rinner.intersects(target) && (target != rinner.end);
+	}
+	void load(int64_t target, uint32_t gen)
+	{
+		int64_t len = std::min((int64_t)WindowLength, (int64_t)totalLength);
+		int64_t start = juce::jlimit((int64_t)0, totalLength - len, target - len / 2);
+		// only the back window belongs to this thread, so it is the only one that may be reallocated
+		Window& w = windows[backIndex];
+		if((w.buffer.getNumChannels() != numChannels) || (w.buffer.getNumSamples() < (int)len)) w.buffer.setSize(numChannels, WindowLength);
+		reader->setPosition(start);
+		std::vector<float*> pp((size_t)numChannels);
+		for(int off = 0; off < (int)len; off += ReadLength)
+		{
+			if(threadShouldExit()) return;
+			for(int ich = 0; ich < numChannels; ++ich) pp[(size_t)ich] = w.buffer.getWritePointer(ich, off);
+			if(!reader->read(pp.data(), numChannels, std::min(ReadLength, (int)len - off))) return;
+		}
+		w.start = start;
+		w.length = (int)len;
+		w.generation = gen;
+		publishWindow();
+		loadedRange = { start, start + len };
+		loadedGeneration = gen;
+	}
+	bool readSample(const Window& w, int ich, double pos, float& v) const
+	{
+		// 4-point Hermite interpolation inside the window
+		double x = pos - (double)w.start;
+		int i = (int)std::floor(x);
+		if((i < 1) || ((w.length - 2) <= i)) return false;
+		float t = (float)(x - i);
+		const float* p = w.buffer.getReadPointer(ich, i - 1);
+		float c1 = 0.5f * (p[2] - p[0]);
+		float c2 = p[0] - 2.5f * p[1] + 2 * p[2] - 0.5f * p[3];
+		float c3 = 0.5f * (p[3] - p[0]) + 1.5f * (p[1] - p[2]);
+		v = ((c3 * t + c2) * t + c1) * t + p[1];
+		return true;
+	}
+	// --------------------------------------------------------------------------------
+	// juce::Thread
+	virtual void run() override
+	{
+		while(!threadShouldExit())
+		{
+			updateList();
+			uint32_t gen = generation;
+			int64_t target = targetPosition;
+			if(active && (0 < numChannels) && (0 < totalLength) && needsLoad(target, gen)) load(target, gen);
+			else wait(active ? 10 : -1);
+		}
+	}
+	// --------------------------------------------------------------------------------
+	// WaveScrubber
+	virtual void setWaveCutList(const WaveCutList& cl) override
+	{
+		juce::ScopedLock sl(listLock);
+		pendingList = cl;
+		listChanged = true;
+		totalLength = cl.calcTotalSize();
+		sourceSampleRate = cl.empty() ? 0 : cl.front().sourceFile->format.sampleRate;
+		++generation;
+		notify();
+	}
+	virtual void start(int64_t pos) override
+	{
+		position = (double)pos;
+		speed = 0;
+		gain = 0;
+		jumping = false;
+		currentPosition = pos;
+		setTarget(pos);
+		active = true;
+		notify();
+	}
+	virtual void stop() override
+	{
+		active = false;
+	}
+	virtual void setTarget(int64_t pos) override
+	{
+		int64_t prev = targetPosition.exchange(pos);
+		if(std::abs(pos - prev) > (WindowLength / 8)) notify();
+	}
+	virtual int64_t getPosition() const override
+	{
+		return currentPosition;
+	}
+	virtual void render(float* const* ppo, int ccho, int len, double fsdev) override
+	{
+		for(int ich = 0; ich < ccho; ++ich) juce::FloatVectorOperations::clear(ppo[ich], len);
+		double fssrc = sourceSampleRate;
+		headroom = 0;
+		if((fsdev <= 0) || (fssrc <= 0)) return;
+		const Window& w = acquireWindow();
+		bool valid = (w.generation == generation) && (0 < w.length);
+		int cch = std::min(ccho, w.buffer.getNumChannels());
+		double target = (double)targetPosition.load();
+		// a target beyond the window is reached by a jump rather than by racing there
+		if(valid && ((target < (double)w.start) || ((double)(w.start + w.length) <= target))) jumping = true;
+		double speed1 = juce::jlimit(-MaxSpeed * fssrc, MaxSpeed * fssrc, (target - position) / FollowTime);
+		float gainstep = 1.0f / (float)FadeLength;
+		bool starved = !valid;
+		for(int i = 0; i < len; ++i)
+		{
+			double v = speed + (speed1 - speed) * (double)(i + 1) / (double)len;
+			position += v / fsdev;
+			bool readable = valid;
+			for(int ich = 0; (ich < cch) && readable; ++ich)
+			{
+				float smp;
+				if(readSample(w, ich, position, smp)) ppo[ich][i] = smp * gain;
+				else readable = false;
+			}
+			gain = (readable && !jumping) ? std::min(1.0f, gain + gainstep) : std::max(0.0f, gain - gainstep);
+			if(jumping && (gain <= 0))
+			{
+				position = target;
+				speed = speed1 = 0;
+				jumping = false;
+			}
+		}
+		speed = speed1;
+		position = juce::jlimit(0.0, (double)std::max((int64_t)0, totalLength - 1), position);
+		currentPosition = (int64_t)position;
+		if(!starved) headroom = std::max((int64_t)0, (int64_t)((0 <= speed) ? ((double)(w.start + w.length) - position) : (position - (double)w.start)));
+	}
+	virtual int64_t getHeadroom() const override
+	{
+		return headroom;
+	}
+};
+
+std::unique_ptr<WaveScrubber> WaveScrubber::createInstance()
+{
+	return std::make_unique<WaveScrubberImpl>();
+}
@@ -0,0 +1,29 @@
+//
+//  WaveScrubber.h
+//  TestWaveEdit_App
+//
+
+#pragma once
+
+#include "WaveCutList.h"
+
+// pointer-driven playback: the speed and direction follow the distance to a target position
+// a background thread keeps a window of the cut list around the target in memory, so render() never touches the disk
+class WaveScrubber
+{
+public:
+	virtual ~WaveScrubber() {}
+	// message thread
+	virtual void setWaveCutList(const WaveCutList& cl) = 0;
+	// call it with the audio callback lock held
+	virtual void start(int64_t pos) = 0;
+	virtual void stop() = 0;
+	// lock-free, callable from any thread
+	virtual void setTarget(int64_t pos) = 0;
+	virtual int64_t getPosition() const = 0;
+	// audio thread; outputs silence while the window around the position is not loaded yet
+	virtual void render(float* const* ppo, int ccho, int len, double fsdev) = 0;
+	// audio thread; the samples the window held ahead of the position in the playing direction after the last render(), zero when it ran dry
+	virtual int64_t getHeadroom() const = 0;
+	static std::unique_ptr<WaveScrubber> createInstance();
+};
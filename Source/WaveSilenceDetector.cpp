@@ -0,0 +1,195 @@
+//
+//  WaveSilenceDetector.cpp
+//  TestWaveEdit_App
+//
+
+#include "WaveSilenceDetector.h"
+#include "WavePeakIndex.h"
+#include "WaveTrace.h"
+
+namespace
+{
+	constexpr int64_t BlockLength = WavePeakIndex::BlockLength;
+	constexpr int ChunkLength = 64; // samples tested at once before looking at them one by one
+
+	enum BlockClass
+	{
+		BlockUnknown,	// to be read
+		BlockSilent,
+		BlockLoud,		// holds a loud sample, but its ends may be silent
+	};
+
+	// the runs of one cut in the positions of the list; those at either end of the cut are kept whatever their length, to be joined across the cuts
+	class WaveCutScanner
+	{
+	public:
+		const WaveCut& cut;
+		int64_t offset;
+		float threshold;
+		int64_t minLength;
+		std::vector<Range64> runs;
+		int64_t runBegin = -1; // in the positions of the source
+		WaveCutScanner(const WaveCut& wc, int64_t ofs, float th, int64_t minlen) : cut(wc), offset(ofs), threshold(th), minLength(minlen)
+		{
+		}
+		void openRun(int64_t t)
+		{
+			if(runBegin < 0) runBegin = t;
+		}
+		void closeRun(int64_t t)
+		{
+			if(runBegin < 0) return;
+			if((minLength <= (t - runBegin)) || (runBegin == cut.range.begin) || (t == cut.range.end)) runs.push_back({ offset + runBegin - cut.range.begin, offset + t - cut.range.begin });
+			runBegin = -1;
+		}
+		// a block only partly in the cut is never loud, its peak may come from the part outside
+		BlockClass classify(const WavePeakIndex* index, int64_t b, int64_t e) const
+		{
+			if(!index || (cut.range.end <= b)) return BlockUnknown;
+			bool loud = false;
+			for(int ich = 0; ich < index->getNumChannels(); ++ich)
+			{
+				WavePeakIndex::Peak pk;
+				if(index->getPeak(ich, b, e, pk) != WavePeakIndex::PrecisionExact) return BlockUnknown;
+				if(threshold <= std::max(-pk.min, pk.max)) loud = true;
+			}
+			if(!loud) return BlockSilent;
+			return ((e - b) == BlockLength) ? BlockLoud : BlockUnknown;
+		}
+		bool scanSamples(juce::AudioBuffer<float>& buf, WaveSourceFile::Decoder& decoder, int64_t pos, int len)
+		{
+			WaveSourceFile& src = *cut.sourceFile;
+			int cch = buf.getNumChannels();
+			if(!src.readWith(decoder, buf.getArrayOfWritePointers(), cch, pos, len)) return false;
+			for(int i = 0; i < len; i += ChunkLength)
+			{
+				int n = std::min(ChunkLength, len - i);
+				bool quiet = true;
+				for(int ich = 0; quiet && (ich < cch); ++ich)
+				{
+					juce::Range<float> mm = juce::FloatVectorOperations::findMinAndMax(buf.getReadPointer(ich, i), n);
+					quiet = (-threshold < mm.getStart()) && (mm.getEnd() < threshold);
+				}
+				if(quiet)
+				{
+					openRun(pos + i);
+					continue;
+				}
+				for(int j = i; j < (i + n); ++j)
+				{
+					bool loud = false;
+					for(int ich = 0; !loud && (ich < cch); ++ich) loud = threshold <= std::abs(buf.getSample(ich, j));
+					if(loud) closeRun(pos + j);
+					else openRun(pos + j);
+				}
+			}
+			return true;
+		}
+		// a loud block between two loud ones is skipped: a run inside it is shorter than a block, and the minimum length is two when the index is used
+		bool scan(juce::AudioBuffer<float>& buf, WaveSourceFile::Decoder& decoder, const std::function<bool()>& shouldcancel)
+		{
+			std::shared_ptr<const WavePeakIndex> index = ((2 * BlockLength) <= minLength) ? cut.sourceFile->peakIndex.get() : nullptr;
+			auto blockend = [&](int64_t t) { return std::min(cut.range.end, (t / BlockLength + 1) * BlockLength); };
+			BlockClass prev = BlockUnknown;
+			BlockClass cur = classify(index.get(), cut.range.begin, blockend(cut.range.begin));
+			for(int64_t pos = cut.range.begin; pos < cut.range.end; )
+			{
+				if(shouldcancel && shouldcancel()) return false;
+				int64_t end = blockend(pos);
+				BlockClass next = classify(index.get(), end, blockend(end));
+				if(cur == BlockSilent) openRun(pos);
+				else if((prev == BlockLoud) && (cur == BlockLoud) && (next == BlockLoud)) closeRun(pos);
+				else if(!scanSamples(buf, decoder, pos, (int)(end - pos))) closeRun(pos); // unreadable counts as loud
+				prev = cur;
+				cur = next;
+				pos = end;
+			}
+			closeRun(cut.range.end);
+			return true;
+		}
+	};
+
+	class WaveSilenceScanJob : public juce::ThreadPoolJob
+	{
+	public:
+		std::vector<WaveCutScanner>::iterator first, last;
+		const std::function<bool()>& shouldCancel;
+		bool completed = false;
+		std::map<WaveSourceFile*, WaveSourceFile::Decoder> decoders; // of its own, so that the scan does not hold up the playback
+		WaveSilenceScanJob(std::vector<WaveCutScanner>::iterator b, std::vector<WaveCutScanner>::iterator e, const std::function<bool()>& shouldcancel) : juce::ThreadPoolJob("WaveSilenceScan"), first(b), last(e), shouldCancel(shouldcancel)
+		{
+		}
+		virtual JobStatus runJob() override
+		{
+			WAVE_TRACE_SCOPE("analysis", "WaveSilenceScanJob::runJob");
+			if(first == last) return jobHasFinished;
+			juce::AudioBuffer<float> buf(first->cut.sourceFile->format.numChannels, (int)BlockLength);
+			auto cancelled = [this]() { return shouldExit() || (shouldCancel && shouldCancel()); };
+			for(std::vector<WaveCutScanner>::iterator it = first; it != last; ++it)
+			{
+				if(!it->scan(buf, decoders[it->cut.sourceFile.get()], cancelled)) return jobHasFinished;
+			}
+			completed = true;
+			return jobHasFinished;
+		}
+	};
+}
+
+std::vector<Range64> WaveSilenceDetector::findSilences(const WaveCutList& cl, float threshold, int64_t minlength, const std::function<bool()>& shouldcancel, int maxthreads)
+{
+	WAVE_TRACE_SCOPE("analysis", "WaveSilenceDetector::findSilences");
+	if(cl.empty() || (threshold <= 0)) return {};
+	minlength = std::max((int64_t)1, minlength);
+	std::vector<WaveCutScanner> scanners;
+	scanners.reserve(cl.size());
+	int64_t total = 0;
+	for(const WaveCut& wc : cl)
+	{
+		scanners.emplace_back(wc, total, threshold, minlength);
+		total += wc.range.size();
+	}
+	// groups of consecutive cuts of about the same length, a few per thread so that a slow source does not hold up the rest
+	int numthreads = (0 < maxthreads) ? maxthreads : juce::SystemStats::getNumCpus();
+	std::vector<std::unique_ptr<WaveSilenceScanJob>> jobs;
+	if(numthreads == 1)
+	{
+		// a caller that already runs on a worker of its own, e.g. a batch job, so no pool under it
+		jobs.push_back(std::make_unique<WaveSilenceScanJob>(scanners.begin(), scanners.end(), shouldcancel));
+		jobs.back()->runJob();
+		if(!jobs.back()->completed) return {};
+	}
+	else
+	{
+		int64_t grouplength = std::max((int64_t)1, total / (numthreads * 4));
+		juce::ThreadPool pool(numthreads);
+		for(std::vector<WaveCutScanner>::iterator it = scanners.begin(); it != scanners.end(); )
+		{
+			std::vector<WaveCutScanner>::iterator first = it;
+			int64_t limit = first->offset + grouplength;
+			while((it != scanners.end()) && (it->offset < limit)) ++it;
+			jobs.push_back(std::make_unique<WaveSilenceScanJob>(first, it, shouldcancel));
+			pool.addJob(jobs.back().get(), false);
+		}
+		bool completed = true;
+		for(std::unique_ptr<WaveSilenceScanJob>& job : jobs)
+		{
+			pool.waitForJobToFinish(job.get(), -1);
+			completed = completed && job->completed;
+		}
+		if(!completed) return {};
+	}
+	// the runs that meet at the cut boundaries are joined, then the short ones dropped
+	std::vector<Range64> joined;
+	for(const WaveCutScanner& s : scanners)
+	{
+		for(const Range64& r : s.runs)
+		{
+			if(!joined.empty() && (joined.back().end == r.begin)) joined.back().end = r.end;
+			else joined.push_back(r);
+		}
+	}
+	std::vector<Range64> silences;
+	std::copy_if(joined.begin(), joined.end(), std::back_inserter(silences), [minlength](const Range64& r) { return minlength <= r.size(); });
+	DBG("[WaveSilenceDetector] findSilences() cuts=" << (int)cl.size() << " groups=" << (int)jobs.size() << " silences=" << (int)silences.size());
+	return silences;
+}
@@ -0,0 +1,23 @@
+//
+//  WaveSilenceDetector.h
+//  TestWaveEdit_App
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "WaveCutList.h"
+
+// the regions of a cut list that stay below a level for long enough, e.g. the pauses of a speech recording
+class WaveSilenceDetector
+{
+protected:
+	WaveSilenceDetector() {}
+public:
+	static constexpr float DefaultThresholdDb = -50;
+	static constexpr double DefaultMinSeconds = 0.5;
+	// the silent ranges in the positions of the list, sorted and disjoint, empty if cancelled; silent is every channel below the threshold
+	// the exact peak summaries decide whole blocks without reading them where the minimum length spans two blocks, the rest is read and scanned
+	// the cuts are scanned in parallel on at most maxthreads workers, 0 for one per CPU; 1 scans them on the calling thread
+	static std::vector<Range64> findSilences(const WaveCutList& cl, float threshold, int64_t minlength, const std::function<bool()>& shouldcancel = {}, int maxthreads = 0);
+};
@@ -0,0 +1,114 @@
+//
+//  WaveSnap.cpp
+//  TestWaveEdit_App
+//
+
+#include "WaveSnap.h"
+#include "WaveTrace.h"
+
+namespace
+{
+	// the channel sum of the range into mono, reading straight from the cuts it spans rather than through a reader, which would copy the list
+	bool readMono(const WaveCutList& cl, const Range64& r, std::map<WaveSourceFile*, WaveSourceFile::Decoder>& decoders, juce::AudioBuffer<float>& buf, std::vector<float>& mono)
+	{
+		mono.assign((size_t)r.size(), 0.0f);
+		int64_t offset = 0;
+		for(const WaveCut& wc : cl)
+		{
+			Range64 rtile{ offset, offset + wc.range.size() };
+			offset = rtile.end;
+			if(rtile.end <= r.begin) continue;
+			if(r.end <= rtile.begin) break;
+			Range64 rx = rtile.intersection(r);
+			int cch = wc.sourceFile->format.numChannels;
+			int len = (int)rx.size();
+			buf.setSize(cch, len, false, false, true);
+			if(!wc.sourceFile->readWith(decoders[wc.sourceFile.get()], buf.getArrayOfWritePointers(), cch, wc.range.begin + (rx.begin - rtile.begin), len)) return false;
+			float* dst = mono.data() + (rx.begin - r.begin);
+			for(int ich = 0; ich < cch; ++ich) juce::FloatVectorOperations::add(dst, buf.getReadPointer(ich), len);
+		}
+		return true;
+	}
+
+	// the boundary nearest to i, within maxdistance, between two samples of opposite sign or at a zero; -1 if there is none
+	// the products of the neighbours are taken in one vector pass, the walk outwards only compares them
+	int64_t findZeroCrossing(const std::vector<float>& x, int64_t i, int64_t maxdistance, std::vector<float>& products)
+	{
+		int64_t n = (int64_t)x.size();
+		if(n < 2) return -1;
+		products.resize((size_t)n);
+		products[0] = 1;
+		juce::FloatVectorOperations::multiply(products.data() + 1, x.data(), x.data() + 1, (int)(n - 1));
+		for(int64_t d = 0; d <= maxdistance; ++d)
+		{
+			if(juce::isPositiveAndBelow(i - d, n) && (products[(size_t)(i - d)] <= 0)) return i - d;
+			if(juce::isPositiveAndBelow(i + d, n) && (products[(size_t)(i + d)] <= 0)) return i + d;
+		}
+		return -1;
+	}
+
+	// the start of the frame whose energy rises the most over the one before, -1 if no frame rises enough
+	int64_t findTransient(const std::vector<float>& x, std::vector<float>& squares)
+	{
+		constexpr int F = WaveSnap::TransientFrameLength;
+		constexpr float MinFrameEnergy = 1e-6f * (float)F; // ignores the rises out of the noise floor
+		int numframes = (int)(x.size() / F);
+		if(numframes < 2) return -1;
+		squares.resize(x.size());
+		juce::FloatVectorOperations::multiply(squares.data(), x.data(), x.data(), (int)x.size());
+		float eprev = 0;
+		float bestrise = WaveSnap::MinTransientRise;
+		int64_t best = -1;
+		for(int f = 0; f < numframes; ++f)
+		{
+			const float* p = squares.data() + (size_t)f * F;
+			float e = std::accumulate(p, p + F, 0.0f);
+			if((0 < f) && (MinFrameEnergy <= e))
+			{
+				float rise = e / std::max(eprev, MinFrameEnergy);
+				if(bestrise < rise)
+				{
+					bestrise = rise;
+					best = (int64_t)f * F;
+				}
+			}
+			eprev = e;
+		}
+		return best;
+	}
+}
+
+int64_t WaveSnap::snap(const WaveCutList& cl, int64_t t, Mode mode, int64_t maxdistance, std::map<WaveSourceFile*, WaveSourceFile::Decoder>& decoders)
+{
+	WAVE_TRACE_SCOPE("ui", "WaveSnap::snap");
+	if((mode == SnapOff) || cl.empty() || (maxdistance <= 0)) return t;
+	int64_t total = cl.calcTotalSize();
+	// the window ends one past the boundary, so that the sample on either side of it is read
+	Range64 rwin = Range64{ t - maxdistance - 1, t + maxdistance + 1 }.intersection(0, total);
+	if(rwin.size() < 2) return t;
+	juce::AudioBuffer<float> buf;
+	std::vector<float> mono, work;
+	if(!readMono(cl, rwin, decoders, buf, mono)) return t;
+	int64_t i = t - rwin.begin;
+	if(mode == SnapTransient)
+	{
+		int64_t onset = findTransient(mono, work);
+		if(onset < 0) return t;
+		// the onset itself is only known to a frame, its crossing is looked for within one
+		i = onset;
+		maxdistance = TransientFrameLength;
+	}
+	int64_t k = findZeroCrossing(mono, i, maxdistance, work);
+	if(k < 0) return (mode == SnapTransient) ? (rwin.begin + i) : t;
+	return rwin.begin + k;
+}
+
+int64_t WaveSnap::getMaxDistance(Mode mode, double fs)
+{
+	switch(mode)
+	{
+		case SnapZeroCrossing: return (int64_t)(MaxZeroCrossingSeconds * fs);
+		case SnapTransient: return (int64_t)(MaxTransientSeconds * fs);
+		default: return 0;
+	}
+}
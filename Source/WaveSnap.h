@@ -0,0 +1,32 @@
+//
+//  WaveSnap.h
+//  TestWaveEdit_App
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "WaveCutList.h"
+
+// moves an edit point to a nearby sample where a cut does not click, quick enough to run on every mouse drag
+class WaveSnap
+{
+protected:
+	WaveSnap() {}
+public:
+	enum Mode
+	{
+		SnapOff,
+		SnapZeroCrossing,	// the nearest sign change of the channel sum
+		SnapTransient,		// the onset of the strongest rise in level, at its zero crossing
+	};
+	static constexpr double MaxZeroCrossingSeconds = 0.005;	// the search reaches this far either way
+	static constexpr double MaxTransientSeconds = 0.05;
+	static constexpr int TransientFrameLength = 64;
+	static constexpr float MinTransientRise = 4;			// in energy from one frame to the next, +6 dB
+	// the snapped position within maxdistance samples of t, or t itself if there is none; reads at most 2 * maxdistance samples of the list
+	// through the caller's decoders, see WaveSourceFile::readWith(), so that a drag neither waits for the playback nor holds it up
+	static int64_t snap(const WaveCutList& cl, int64_t t, Mode mode, int64_t maxdistance, std::map<WaveSourceFile*, WaveSourceFile::Decoder>& decoders);
+	// the largest distance the mode searches, in samples
+	static int64_t getMaxDistance(Mode mode, double fs);
+};
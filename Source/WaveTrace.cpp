@@ -0,0 +1,124 @@
+//
+//  WaveTrace.cpp
+//  TestWaveEdit_App
+//
+
+#include "WaveTrace.h"
+
+namespace
+{
+	constexpr size_t MaxEvents = 1 << 20;	// about 40 MB, recording stops silently beyond it
+
+	struct TraceEvent
+	{
+		const char* category;
+		const char* name;
+		int64_t begin;
+		int64_t end;
+		int threadIndex;
+	};
+
+	struct TraceBuffer
+	{
+		std::atomic<bool> recording{ false };
+		juce::SpinLock lock;
+		std::vector<TraceEvent> events;
+		std::map<int, juce::String> threadNames;
+		int64_t origin = 0;
+		static TraceBuffer& getInstance()
+		{
+			static TraceBuffer instance;
+			return instance;
+		}
+	};
+
+	int getThreadIndex(TraceBuffer& tb)
+	{
+		// small sequential ids read better in a trace viewer than native thread handles
+		static std::atomic<int> counter{ 0 };
+		thread_local int index = 0;
+		if(index == 0)
+		{
+			index = ++counter;
+			juce::String name;
+			if(juce::Thread* t = juce::Thread::getCurrentThread()) name = t->getThreadName();
+			else if(juce::MessageManager::existsAndIsCurrentThread()) name = "Message Thread";
+			else name = "Thread " + juce::String(index);
+			juce::SpinLock::ScopedLockType sl(tb.lock);
+			tb.threadNames[index] = name;
+		}
+		return index;
+	}
+}
+
+void WaveTrace::start()
+{
+	TraceBuffer& tb = TraceBuffer::getInstance();
+	{
+		juce::SpinLock::ScopedLockType sl(tb.lock);
+		tb.events.clear();
+		tb.events.reserve(65536);
+		tb.origin = juce::Time::getHighResolutionTicks();
+	}
+	tb.recording = true;
+}
+
+void WaveTrace::stop()
+{
+	TraceBuffer::getInstance().recording = false;
+}
+
+bool WaveTrace::isRecording()
+{
+	return TraceBuffer::getInstance().recording;
+}
+
+juce::Result WaveTrace::writeTo(const juce::File& file)
+{
+	TraceBuffer& tb = TraceBuffer::getInstance();
+	std::vector<TraceEvent> events;
+	std::map<int, juce::String> threadnames;
+	int64_t origin;
+	{
+		juce::SpinLock::ScopedLockType sl(tb.lock);
+		events = tb.events;
+		threadnames = tb.threadNames;
+		origin = tb.origin;
+	}
+	file.deleteFile();
+	juce::FileOutputStream ostr(file);
+	if(ostr.failedToOpen()) return juce::Result::fail("failed to open " + file.getFullPathName());
+	auto us = [origin](int64_t t) { return juce::Time::highResolutionTicksToSeconds(t - origin) * 1e6; };
+	ostr << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	for(const auto& [index, name] : threadnames)
+	{
+		ostr << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << index << ",\"args\":{\"name\":\"" << juce::JSON::escapeString(name) << "\"}}";
+		first = false;
+	}
+	for(const TraceEvent& e : events)
+	{
+		ostr << (first ? "" : ",\n") << juce::String::formatted("{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+			e.name, e.category, us(e.begin), us(e.end) - us(e.begin), e.threadIndex);
+		first = false;
+	}
+	ostr << "\n]}\n";
+	ostr.flush();
+	return ostr.getStatus();
+}
+
+WaveTrace::Scope::Scope(const char* cat, const char* n) : category(cat), name(n), begin(TraceBuffer::getInstance().recording ? juce::Time::getHighResolutionTicks() : 0)
+{
+}
+
+WaveTrace::Scope::~Scope()
+{
+	TraceBuffer& tb = TraceBuffer::getInstance();
+	if((begin == 0) || !tb.recording) return;
+	int64_t end = juce::Time::getHighResolutionTicks();
+	int index = getThreadIndex(tb);
+	juce::SpinLock::ScopedLockType sl(tb.lock);
+	// a span that started before the last start() is dropped
+	if((begin < tb.origin) || (MaxEvents <= tb.events.size())) return;
+	tb.events.push_back({ category, name, begin, end, index });
+}
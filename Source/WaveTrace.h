@@ -0,0 +1,43 @@
+//
+//  WaveTrace.h
+//  TestWaveEdit_App
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// scoped spans saved as trace-event JSON, which chrome://tracing and ui.perfetto.dev load as a timeline
+// the spans compile in only when WAVE_TRACE is defined to 1, e.g. in the preprocessor definitions of a profiling build
+#ifndef WAVE_TRACE
+#define WAVE_TRACE 0
+#endif
+
+class WaveTrace
+{
+public:
+	// a span costs two clock reads, and an append under a spin lock while recording
+	static void start();
+	static void stop();
+	static bool isRecording();
+	// writes the spans recorded since the last start()
+	static juce::Result writeTo(const juce::File& file);
+	class Scope
+	{
+	public:
+		Scope(const char* cat, const char* n);
+		~Scope();
+	private:
+		const char* category;
+		const char* name;
+		int64_t begin;
+		JUCE_DECLARE_NON_COPYABLE(Scope)
+	};
+};
+
+// category and name must be string literals
+#if WAVE_TRACE
+#define WAVE_TRACE_SCOPE(category, name) WaveTrace::Scope JUCE_JOIN_MACRO(waveTraceScope_, __LINE__)(category, name)
+#else
+#define WAVE_TRACE_SCOPE(category, name)
+#endif